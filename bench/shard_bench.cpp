@@ -0,0 +1,243 @@
+// shard_bench — параллельные писатели в одном файле и в шардах (ShardedNodeRepository).
+// Каждый писатель — свой поток, своё соединение и своё поддерево верхнего уровня cell_<i>:
+// в режиме single все поддеревья в одном файле (писатели делят блокировку записи), в режиме
+// sharded — каждое в своём файле. Меряет задержку вставки и общую пропускную способность,
+// для sharded — ещё перенос поддерева между файлами и resolvePath после него. Печатает JSON.
+#include "Db.h"
+#include "Errors.h"
+#include "INodeFactory.h"
+#include "INodeRepository.h"
+#include "ShardedNodeRepository.h"
+#include "TreeService.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <algorithm>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BenchConfig {
+    int writers {4};
+    int inserts {2000};
+    int payloadSize {64};
+};
+
+// Результат одного режима: задержки вставок всех писателей, повторы по Busy, время всего прогона
+struct ModeResult {
+    QString mode;
+    std::vector<qint64> ns;
+    qint64 busyRetries {0};
+    qint64 wallNs {0};
+    QJsonArray extra;
+    QString error;
+};
+
+// Ближайший ранг по отсортированной выборке
+qint64 percentile(const std::vector<qint64> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = size_t(p * double(sorted.size()) + 0.5);
+    rank = std::clamp<size_t>(rank, 1, sorted.size());
+    return sorted[rank - 1];
+}
+
+double us(qint64 ns) {
+    return double(ns) / 1000.0;
+}
+
+QString cellName(int i) {
+    return QString("cell_%1").arg(i);
+}
+
+ShardedRepoOptions layout(const QString &dir, const QString &mode, int writers, const QString &prefix) {
+    ShardedRepoOptions options;
+    options.homePath = QDir(dir).filePath(mode + "_home.sqlite");
+    options.connectionPrefix = prefix;
+    if (mode == "sharded") {
+        for (int i = 0; i < writers; ++i) {
+            options.shards.push_back(ShardSpec{QDir(dir).filePath(QString("%1_%2.sqlite").arg(mode, cellName(i))),
+                                               {cellName(i)}});
+        }
+    }
+    return options;
+}
+
+ModeResult runMode(const QString &dir, const QString &mode, const BenchConfig &cfg) {
+    ModeResult result;
+    result.mode = mode;
+
+    // Файлы и поддеревья писателей создаются заранее в главном потоке (схема, корень, cell_<i>)
+    std::vector<qint64> cells;
+    {
+        auto repo = makeShardedNodeRepository(layout(dir, mode, cfg.writers, mode + "_setup"));
+        for (int i = 0; i < cfg.writers; ++i) cells.push_back(repo->insert(TreeService::ROOT_ID, cellName(i), std::nullopt));
+    }
+
+    const std::optional<QString> payload = cfg.payloadSize > 0
+                                               ? std::optional<QString>(QString(cfg.payloadSize, QLatin1Char('x')))
+                                               : std::nullopt;
+    std::mutex mutex;
+    std::latch ready(cfg.writers + 1);
+    std::latch start(1);
+    std::vector<std::thread> threads;
+    for (int w = 0; w < cfg.writers; ++w) {
+        threads.emplace_back([&, w]() {
+            std::vector<qint64> ns;
+            qint64 busy = 0;
+            QString error;
+            bool counted = false;
+            try {
+                // Соединения принадлежат потоку: репозиторий создаётся и закрывается здесь
+                auto repo = makeShardedNodeRepository(layout(dir, mode, cfg.writers, QString("%1_w%2").arg(mode).arg(w)));
+                ns.reserve(size_t(cfg.inserts));
+                ready.count_down();
+                counted = true;
+                start.wait();
+                for (int i = 0; i < cfg.inserts; ++i) {
+                    const QString name = QString("n%1").arg(i);
+                    QElapsedTimer t;
+                    t.start();
+                    Result<qint64> inserted = repo->tryInsert(cells[size_t(w)], name, payload);
+                    while (!inserted && inserted.error().code == ErrorCode::Busy) {
+                        ++busy;
+                        inserted = repo->tryInsert(cells[size_t(w)], name, payload);
+                    }
+                    if (!inserted) {
+                        error = inserted.error().message;
+                        break;
+                    }
+                    ns.push_back(t.nsecsElapsed());
+                }
+            } catch (const std::exception &ex) {
+                error = QString::fromUtf8(ex.what());
+                if (!counted) ready.count_down();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            result.ns.insert(result.ns.end(), ns.begin(), ns.end());
+            result.busyRetries += busy;
+            if (!error.isEmpty() && result.error.isEmpty()) result.error = error;
+        });
+    }
+    ready.arrive_and_wait();
+    QElapsedTimer wall;
+    wall.start();
+    start.count_down();
+    for (std::thread &t : threads) t.join();
+    result.wallNs = wall.nsecsElapsed();
+
+    // Перенос поддерева писателя в соседний файл и поиск по пути через тот же интерфейс
+    if (mode == "sharded" && cfg.writers >= 2 && result.error.isEmpty()) {
+        TreeService service(makeShardedNodeRepository(layout(dir, mode, cfg.writers, mode + "_move")), makeNodeFactory());
+        QElapsedTimer t;
+        t.start();
+        service.moveNode(cells[0], cells[1]);
+        const qint64 moveNs = t.nsecsElapsed();
+        t.restart();
+        const qint64 resolved = service.resolvePath(cellName(1) + "/" + cellName(0) + "/n0");
+        const qint64 resolveNs = t.nsecsElapsed();
+        QJsonObject move;
+        move["op"] = "service.moveNode.cross_shard";
+        move["nodes"] = cfg.inserts + 1;
+        move["us"] = us(moveNs);
+        move["resolved"] = resolved > 0;
+        result.extra.append(move);
+        QJsonObject resolve;
+        resolve["op"] = "service.resolvePath.after_move";
+        resolve["us"] = us(resolveNs);
+        result.extra.append(resolve);
+    }
+    return result;
+}
+
+QJsonObject summarize(ModeResult &r) {
+    std::sort(r.ns.begin(), r.ns.end());
+    QJsonObject o;
+    o["mode"] = r.mode;
+    o["inserts"] = qint64(r.ns.size());
+    o["busy_retries"] = r.busyRetries;
+    o["wall_ms"] = double(r.wallNs) / 1e6;
+    o["ops_per_sec"] = r.wallNs > 0 ? double(r.ns.size()) * 1e9 / double(r.wallNs) : 0.0;
+    o["p50_us"] = us(percentile(r.ns, 0.50));
+    o["p90_us"] = us(percentile(r.ns, 0.90));
+    o["p99_us"] = us(percentile(r.ns, 0.99));
+    o["max_us"] = r.ns.empty() ? 0.0 : us(r.ns.back());
+    if (!r.extra.isEmpty()) o["ops"] = r.extra;
+    if (!r.error.isEmpty()) o["error"] = r.error;
+    return o;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Concurrent writers: one database file vs. sharded files");
+    parser.addHelpOption();
+    const QCommandLineOption writersOpt("writers", "Writer threads (one top-level subtree each).", "n", "4");
+    const QCommandLineOption insertsOpt("inserts", "Inserts per writer.", "n", "2000");
+    const QCommandLineOption payloadOpt("payload-size", "Payload size in characters.", "n", "64");
+    const QCommandLineOption dirOpt("dir", "Directory for database files (default: temporary).", "path");
+    const QCommandLineOption outOpt("out", "Write JSON to file instead of stdout.", "path");
+    parser.addOptions({writersOpt, insertsOpt, payloadOpt, dirOpt, outOpt});
+    parser.process(app);
+
+    BenchConfig cfg;
+    cfg.writers = std::max(1, parser.value(writersOpt).toInt());
+    cfg.inserts = std::max(1, parser.value(insertsOpt).toInt());
+    cfg.payloadSize = std::max(0, parser.value(payloadOpt).toInt());
+
+    QTemporaryDir tmpDir;
+    const QString dir = parser.isSet(dirOpt) ? parser.value(dirOpt) : tmpDir.path();
+
+    QJsonArray modes;
+    bool failed = false;
+    for (const QString &mode : {QString("single"), QString("sharded")}) {
+        try {
+            ModeResult r = runMode(dir, mode, cfg);
+            failed = failed || !r.error.isEmpty();
+            modes.append(summarize(r));
+        } catch (const std::exception &ex) {
+            QTextStream(stderr) << "shard_bench " << mode << " failed: " << ex.what() << "\n";
+            return 1;
+        }
+    }
+
+    QJsonObject config;
+    config["writers"] = cfg.writers;
+    config["inserts"] = cfg.inserts;
+    config["payload_size"] = cfg.payloadSize;
+
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["qt_version"] = QString::fromLatin1(qVersion());
+    root["config"] = config;
+    root["results"] = modes;
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outOpt)) {
+        QFile f(parser.value(outOpt));
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QTextStream(stderr) << "Cannot write " << parser.value(outOpt) << "\n";
+            return 1;
+        }
+        f.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,360 @@
+// tree_bench — синтетический замер операций репозитория, сервиса и заполнения виджета.
+// Строит дерево с заданными fanout/depth/длиной имени/размером payload во временной БД,
+// меряет каждую операцию по отдельности и печатает JSON (ops/s, перцентили задержки в мкс),
+// чтобы сравнивать прогоны между собой. Работает без дисплея (QT_QPA_PLATFORM=offscreen).
+#include "Db.h"
+#include "Errors.h"
+#include "INodeFactory.h"
+#include "INodeRepository.h"
+#include "TreeService.h"
+#include "TreeWidgetEx.h"
+#include "widgetsTreeFeeler.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTreeWidgetItem>
+#include <QtSql/QSqlDatabase>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace {
+
+struct BenchConfig {
+    int fanout {10};
+    int depth {4};
+    int nameLength {12};
+    int payloadSize {256};
+    int iterations {1000};
+    quint32 seed {42};
+};
+
+// Задержки одной операции в наносекундах
+struct Series {
+    QString op;
+    std::vector<qint64> ns;
+};
+
+class Bench {
+public:
+    explicit Bench(const BenchConfig &cfg) : m_cfg(cfg), m_rng(cfg.seed) {}
+
+    // Замер одного вызова; если вызов бросил исключение, замер не записывается
+    void measure(Series &s, const std::function<void()> &fn) {
+        QElapsedTimer t;
+        t.start();
+        fn();
+        s.ns.push_back(t.nsecsElapsed());
+    }
+
+    QString randomName() {
+        static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyz";
+        QString out(m_cfg.nameLength, Qt::Uninitialized);
+        for (int i = 0; i < m_cfg.nameLength; ++i) {
+            out[i] = QLatin1Char(ALPHABET[m_rng.bounded(26)]);
+        }
+        return out;
+    }
+
+    std::optional<QString> randomPayload() {
+        if (m_cfg.payloadSize <= 0) return std::nullopt;
+        QString filler(m_cfg.payloadSize, QLatin1Char('x'));
+        return QString("{\"diameter\":\"%1\",\"note\":\"%2\"}").arg(m_rng.bounded(100)).arg(filler);
+    }
+
+    template <typename T>
+    const T &pick(const std::vector<T> &v) {
+        return v[m_rng.bounded(quint32(v.size()))];
+    }
+
+    QRandomGenerator &rng() { return m_rng; }
+
+private:
+    BenchConfig m_cfg;
+    QRandomGenerator m_rng;
+};
+
+// Ближайший ранг по отсортированной выборке
+qint64 percentile(const std::vector<qint64> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = size_t(p * double(sorted.size()) + 0.5);
+    rank = std::clamp<size_t>(rank, 1, sorted.size());
+    return sorted[rank - 1];
+}
+
+QJsonObject summarize(const Series &s) {
+    std::vector<qint64> sorted = s.ns;
+    std::sort(sorted.begin(), sorted.end());
+    qint64 total = 0;
+    for (qint64 v : sorted) total += v;
+    const auto us = [](qint64 ns) { return double(ns) / 1000.0; };
+    QJsonObject o;
+    o["op"] = s.op;
+    o["count"] = qint64(sorted.size());
+    o["ops_per_sec"] = total > 0 ? double(sorted.size()) * 1e9 / double(total) : 0.0;
+    o["mean_us"] = sorted.empty() ? 0.0 : us(total) / double(sorted.size());
+    o["p50_us"] = us(percentile(sorted, 0.50));
+    o["p90_us"] = us(percentile(sorted, 0.90));
+    o["p99_us"] = us(percentile(sorted, 0.99));
+    o["max_us"] = sorted.empty() ? 0.0 : us(sorted.back());
+    return o;
+}
+
+// Пересоздаёт виджет и feeler (как при открытии окна)
+struct WidgetRig {
+    std::unique_ptr<TreeWidgetEx> tree;
+    std::unique_ptr<WidgetsTreeFeeler> feeler;
+
+    explicit WidgetRig(TreeService *service)
+        : tree(std::make_unique<TreeWidgetEx>()),
+          feeler(std::make_unique<WidgetsTreeFeeler>(tree.get(), service)) {
+        tree->resize(800, 600);
+    }
+};
+
+}
+
+int main(int argc, char *argv[]) {
+    // Виджеты создаются, но не показываются — платформа без дисплея
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    QApplication::setApplicationName("tree_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Synthetic benchmark for the tree repository, service and widget layers");
+    parser.addHelpOption();
+    const QCommandLineOption fanoutOpt("fanout", "Children per node.", "n", "10");
+    const QCommandLineOption depthOpt("depth", "Tree depth below root.", "n", "4");
+    const QCommandLineOption nameOpt("name-length", "Characters per node name.", "n", "12");
+    const QCommandLineOption payloadOpt("payload-size", "Payload filler size in characters (0 - no payload).", "n", "256");
+    const QCommandLineOption iterOpt("iterations", "Samples per measured operation.", "n", "1000");
+    const QCommandLineOption seedOpt("seed", "Random seed.", "n", "42");
+    const QCommandLineOption dbOpt("db", "SQLite file to use (default: temporary file).", "path");
+    const QCommandLineOption outOpt("out", "Write JSON to file instead of stdout.", "path");
+    parser.addOptions({fanoutOpt, depthOpt, nameOpt, payloadOpt, iterOpt, seedOpt, dbOpt, outOpt});
+    parser.process(app);
+
+    BenchConfig cfg;
+    cfg.fanout = std::max(1, parser.value(fanoutOpt).toInt());
+    cfg.depth = std::max(2, parser.value(depthOpt).toInt());
+    cfg.nameLength = std::clamp(parser.value(nameOpt).toInt(), 1, 255);
+    cfg.payloadSize = std::max(0, parser.value(payloadOpt).toInt());
+    cfg.iterations = std::max(1, parser.value(iterOpt).toInt());
+    cfg.seed = parser.value(seedOpt).toUInt();
+
+    QTemporaryDir tmpDir;
+    const QString dbPath = parser.isSet(dbOpt) ? parser.value(dbOpt) : tmpDir.filePath("bench.sqlite");
+
+    Bench bench(cfg);
+    std::vector<Series> results;
+    const auto series = [&results](const QString &op) -> Series & {
+        results.push_back(Series{op, {}});
+        return results.back();
+    };
+
+    int exitCode = 0;
+    {
+        const QString conn = Db::openAndInit("bench_conn", dbPath);
+        QSqlDatabase db = QSqlDatabase::database(conn);
+        auto repo = makeSqliteNodeRepository(db);
+        TreeService service(makeSqliteNodeRepository(db), makeNodeFactory());
+
+        try {
+            // Генерация уровнями; каждая вставка — отдельная транзакция, как из UI
+            std::vector<std::vector<qint64>> levels(size_t(cfg.depth) + 1);
+            levels[0].push_back(TreeService::ROOT_ID);
+            {
+                Series &s = series("insert");
+                for (int d = 1; d <= cfg.depth; ++d) {
+                    for (qint64 parent : levels[size_t(d - 1)]) {
+                        for (int i = 0; i < cfg.fanout; ++i) {
+                            qint64 id = 0;
+                            const auto payload = bench.randomPayload();
+                            while (id == 0) {
+                                const QString name = bench.randomName();
+                                try {
+                                    bench.measure(s, [&]() { id = service.createNode(parent, name, payload); });
+                                } catch (const Errors::DuplicateName &) {
+                                    // короткие имена: повтор с другим именем
+                                }
+                            }
+                            levels[size_t(d)].push_back(id);
+                        }
+                    }
+                }
+            }
+
+            std::vector<qint64> internal;
+            std::vector<qint64> all;
+            for (int d = 0; d <= cfg.depth; ++d) {
+                all.insert(all.end(), levels[size_t(d)].begin(), levels[size_t(d)].end());
+                if (d < cfg.depth) internal.insert(internal.end(), levels[size_t(d)].begin(), levels[size_t(d)].end());
+            }
+
+            {
+                Series &s = series("repo.getChildren");
+                for (int i = 0; i < cfg.iterations; ++i) {
+                    const qint64 id = bench.pick(internal);
+                    bench.measure(s, [&]() { (void)repo->getChildren(id); });
+                }
+            }
+            {
+                Series &s = series("service.listChildren");
+                for (int i = 0; i < cfg.iterations; ++i) {
+                    const qint64 id = bench.pick(internal);
+                    bench.measure(s, [&]() { (void)service.listChildren(id); });
+                }
+            }
+
+            std::vector<QString> paths;
+            {
+                Series &s = series("service.buildPath");
+                for (int i = 0; i < cfg.iterations; ++i) {
+                    const qint64 id = bench.pick(all);
+                    bench.measure(s, [&]() { paths.push_back(service.buildPath(id)); });
+                }
+            }
+            {
+                Series &s = series("service.resolvePath");
+                for (const QString &path : paths) {
+                    bench.measure(s, [&]() { (void)service.resolvePath(path); });
+                }
+            }
+
+            // Перенос листа к другому родителю предпоследнего уровня (включает проверку цикла)
+            const std::vector<qint64> &leaves = levels[size_t(cfg.depth)];
+            const std::vector<qint64> &leafParents = levels[size_t(cfg.depth - 1)];
+            {
+                Series &s = series("service.moveNode");
+                for (int i = 0; i < cfg.iterations; ++i) {
+                    const qint64 id = bench.pick(leaves);
+                    const qint64 target = bench.pick(leafParents);
+                    try {
+                        bench.measure(s, [&]() { service.moveNode(id, target); });
+                    } catch (const Errors::DuplicateName &) {
+                        // совпало имя у нового родителя — не замер
+                    }
+                }
+            }
+            // Отказ переноса узла первого уровня в его же потомка: стоимость проверки цикла (getAncestorIds).
+            // Уровни строились по порядку родителей, поэтому потомки k-го узла уровня 1 на уровне d
+            // занимают отрезок [k * fanout^(d-1), (k + 1) * fanout^(d-1)).
+            {
+                Series &s = series("service.moveNode.rejectIntoDescendant");
+                const std::vector<qint64> &tops = levels[1];
+                size_t span = 1;
+                for (int d = 2; d < cfg.depth; ++d) span *= size_t(cfg.fanout);
+                for (int i = 0; i < cfg.iterations; ++i) {
+                    const size_t k = bench.rng().bounded(quint32(tops.size()));
+                    const qint64 target = leafParents[k * span + bench.rng().bounded(quint32(span))];
+                    bench.measure(s, [&]() {
+                        try {
+                            service.moveNode(tops[k], target);
+                        } catch (const Errors::MoveIntoDescendant &) {
+                        }
+                    });
+                }
+            }
+
+            // Виджет: начальная загрузка, ленивое раскрытие, восстановление раскрытого состояния
+            {
+                Series &s = series("widget.initialize");
+                const int reps = std::max(1, std::min(cfg.iterations, 50));
+                for (int i = 0; i < reps; ++i) {
+                    WidgetRig rig(&service);
+                    bench.measure(s, [&]() { rig.feeler->initialize(); });
+                }
+            }
+            {
+                Series &s = series("widget.expand");
+                WidgetRig rig(&service);
+                rig.feeler->initialize();
+                std::vector<QTreeWidgetItem*> queue;
+                for (int i = 0; i < rig.tree->topLevelItemCount(); ++i) queue.push_back(rig.tree->topLevelItem(i));
+                for (size_t i = 0; i < queue.size() && int(s.ns.size()) < cfg.iterations; ++i) {
+                    QTreeWidgetItem *item = queue[i];
+                    if (item->childCount() == 0) continue;
+                    bench.measure(s, [&]() { item->setExpanded(true); });
+                    for (int c = 0; c < item->childCount(); ++c) queue.push_back(item->child(c));
+                }
+            }
+            {
+                Series &s = series("widget.restoreState");
+                QList<qint64> expanded;
+                for (int d = 1; d < cfg.depth - 1; ++d) {
+                    for (qint64 id : levels[size_t(d)]) expanded.append(id);
+                }
+                const int reps = std::max(1, std::min(cfg.iterations, 20));
+                for (int i = 0; i < reps; ++i) {
+                    WidgetRig rig(&service);
+                    rig.feeler->initialize();
+                    bench.measure(s, [&]() { rig.feeler->restoreState(expanded, {}); });
+                }
+            }
+
+            // Каскадное удаление поддеревьев второго уровня — последним, дерево после него неполное
+            {
+                Series &s = series("service.deleteNode.cascade");
+                std::vector<qint64> victims = levels[2];
+                std::shuffle(victims.begin(), victims.end(), bench.rng());
+                const size_t n = std::min(victims.size(), size_t(cfg.iterations));
+                for (size_t i = 0; i < n; ++i) {
+                    bench.measure(s, [&]() { service.deleteNode(victims[i]); });
+                }
+            }
+        } catch (const std::exception &ex) {
+            QTextStream(stderr) << "tree_bench failed: " << ex.what() << "\n";
+            exitCode = 1;
+        }
+    }
+    {
+        QSqlDatabase db = QSqlDatabase::database("bench_conn", false);
+        if (db.isValid()) db.close();
+    }
+    QSqlDatabase::removeDatabase("bench_conn");
+    if (exitCode != 0) return exitCode;
+
+    QJsonObject config;
+    config["fanout"] = cfg.fanout;
+    config["depth"] = cfg.depth;
+    config["name_length"] = cfg.nameLength;
+    config["payload_size"] = cfg.payloadSize;
+    config["iterations"] = cfg.iterations;
+    config["seed"] = qint64(cfg.seed);
+
+    QJsonArray ops;
+    for (const Series &s : results) ops.append(summarize(s));
+
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["qt_version"] = QString::fromLatin1(qVersion());
+    root["config"] = config;
+    root["results"] = ops;
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outOpt)) {
+        QFile f(parser.value(outOpt));
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QTextStream(stderr) << "Cannot write " << parser.value(outOpt) << "\n";
+            return 1;
+        }
+        f.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
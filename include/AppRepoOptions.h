@@ -0,0 +1,9 @@
+// AppRepoOptions — параметры хранения payload, общие для приложения и утилит (treectl, tree_replay)
+#pragma once
+
+#include "INodeRepository.h"
+
+// Параметры, с которыми приложение пишет payload: storage/dedupPayloads (по умолчанию включено)
+// и storage/compressThreshold (по умолчанию 4 КиБ) из QSettings "qt_mill"/"tree".
+// Статистика и диапазон id не заполняются — их задаёт вызывающий.
+RepoOptions appRepoOptions();
@@ -0,0 +1,50 @@
+// BackgroundBatchRunner — выполнение длинных фоновых задач короткими порциями в цикле событий
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <functional>
+#include <vector>
+
+// Запускает зарегистрированные задачи по одной порции за тик таймера (по кругу),
+// чтобы длинная работа (миграции, сжатие, сборка мусора) не блокировала UI.
+class BackgroundBatchRunner : public QObject {
+    Q_OBJECT
+public:
+    // Одна ограниченная порция работы. true — работа ещё осталась.
+    using Step = std::function<bool()>;
+
+    explicit BackgroundBatchRunner(QObject *parent = nullptr);
+
+    // repeatMs > 0: после завершения задача перезапускается через repeatMs (периодическое обслуживание)
+    void addTask(const QString &name, Step step, int repeatMs = 0);
+
+    // Пауза между порциями; между ними UI успевает обработать свои события
+    void setTickInterval(int ms);
+
+    void start();
+    void stop();
+
+signals:
+    void taskFinished(const QString &name);
+    void taskFailed(const QString &name, const QString &error);
+
+private slots:
+    void onTick();
+
+private:
+    struct Task {
+        QString name;
+        Step step;
+        int repeatMs {0};
+        qint64 nextRunMs {0};
+        bool finished {false};
+    };
+
+    std::vector<Task> m_tasks;
+    size_t m_next {0};
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+};
@@ -0,0 +1,47 @@
+// BackupJob — резервная копия БД (OnlineBackup) в рабочем потоке, с прогрессом и уступкой переднему плану
+#pragma once
+
+#include "OnlineBackup.h"
+
+#include <QObject>
+#include <QMetaType>
+#include <QString>
+#include <functional>
+#include <memory>
+
+class QTimer;
+
+// Живёт в отдельном QThread (как ChildPrefetcher): start/cancel вызываются в нём же.
+// Между шагами — пауза; пока foregroundBusy() возвращает true, шаги пропускаются.
+class BackupJob : public QObject {
+    Q_OBJECT
+public:
+    BackupJob(const QString &dbPath, const QString &targetPath, std::function<bool()> foregroundBusy);
+    ~BackupJob() override;
+
+    QString targetPath() const { return m_targetPath; }
+
+public slots:
+    void start();
+    // Незавершённая копия удаляется; finished не испускается
+    void cancel();
+
+signals:
+    void progress(const BackupProgress &progress);
+    void finished(bool ok, const QString &targetPath, const QString &error);
+
+private slots:
+    void onTick();
+
+private:
+    void fail(const QString &error);
+
+    QString m_dbPath;
+    QString m_targetPath;
+    std::function<bool()> m_foregroundBusy;
+    std::unique_ptr<OnlineBackup> m_backup;
+    QTimer *m_timer {nullptr};
+    int m_ticks {0};
+};
+
+Q_DECLARE_METATYPE(BackupProgress)
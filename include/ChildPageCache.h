@@ -0,0 +1,62 @@
+// ChildPageCache — общий (UI + фоновая предвыборка) кеш списков детей с учётом попаданий
+#pragma once
+
+#include <QtGlobal>
+#include <QElapsedTimer>
+#include <mutex>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "Node.h"
+
+// Потокобезопасный LRU-кеш «parentId -> дети в ручном порядке». Заполняется фоновым
+// ChildPrefetcher, читается loadChildrenInto до обращения к БД. Любое изменение дерева
+// сбрасывает кеш целиком (clear); поколение не даёт фоновому потоку положить в кеш
+// список, прочитанный до сброса.
+class ChildPageCache {
+public:
+    struct Stats {
+        qint64 lookups {0};     // обращения loadChildrenInto
+        qint64 hits {0};        // из них обслужены кешем
+        qint64 prefetched {0};  // списков положено фоновым потоком
+        qint64 wasted {0};      // положено, но вытеснено/сброшено без использования
+        double hitRate() const { return lookups > 0 ? double(hits) / double(lookups) : 0.0; }
+    };
+
+    explicit ChildPageCache(size_t capacity = 256);
+
+    // Забирает список детей (запись удаляется: дальше актуальность держат элементы виджета)
+    std::optional<std::vector<NodeDTO>> take(qint64 parentId);
+
+    bool contains(qint64 parentId) const;
+
+    // Текущее поколение — запоминается перед чтением из БД и передаётся в put
+    quint64 generation() const;
+    // false — кеш сбрасывался после generation, список мог устареть и не сохранён
+    bool put(qint64 parentId, std::vector<NodeDTO> children, quint64 generation);
+    void clear();
+
+    // Отметка активности переднего плана: предвыборка уступает, пока UI недавно обращался к БД
+    void noteForegroundActivity();
+    qint64 msSinceForegroundActivity() const;
+
+    Stats stats() const;
+
+private:
+    using Lru = std::list<qint64>;
+    struct Entry {
+        std::vector<NodeDTO> children;
+        Lru::iterator lruPos;
+    };
+
+    mutable std::mutex m_mutex;
+    size_t m_capacity;
+    quint64 m_generation {0};
+    std::unordered_map<qint64, Entry> m_entries;
+    Lru m_lru; // спереди — самые свежие
+    Stats m_stats;
+    QElapsedTimer m_clock;
+    qint64 m_lastForegroundMs {0};
+};
@@ -0,0 +1,45 @@
+// ChildPrefetcher — фоновая предвыборка детей узлов, которые пользователь вероятно раскроет
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class QTimer;
+class TreeService;
+class ChildPageCache;
+
+// Живёт в отдельном QThread со своим соединением только для чтения (WAL: не мешает записи UI).
+// По таймеру берёт один id из очереди подсказок и кладёт его детей в общий ChildPageCache.
+// Пока передний план недавно обращался к БД, предвыборка пропускает тики.
+class ChildPrefetcher : public QObject {
+    Q_OBJECT
+public:
+    ChildPrefetcher(const QString &dbPath, std::shared_ptr<ChildPageCache> cache);
+    ~ChildPrefetcher() override;
+
+    // Потокобезопасно. Подсказки идут в начало очереди (свежие вероятнее), повторы убираются,
+    // длина очереди ограничена — старые подсказки отбрасываются.
+    void hint(const std::vector<qint64> &parentIds);
+
+public slots:
+    // Вызываются в рабочем потоке: открытие/закрытие собственного соединения и таймера
+    void start();
+    void stop();
+
+private slots:
+    void onTick();
+
+private:
+    QString m_dbPath;
+    QString m_connectionName;
+    std::shared_ptr<ChildPageCache> m_cache;
+    std::unique_ptr<TreeService> m_service;
+    QTimer *m_timer {nullptr};
+
+    std::mutex m_queueMutex;
+    std::deque<qint64> m_queue;
+};
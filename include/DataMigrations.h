@@ -0,0 +1,41 @@
+// DataMigrations — возобновляемые миграции данных, выполняемые порциями в фоне
+#pragma once
+
+#include <QString>
+#include <QtSql/QSqlDatabase>
+#include <vector>
+
+// Прогресс одной миграции данных (строка таблицы data_migrations)
+struct DataMigrationProgress {
+    QString name;
+    qint64 lastId {0};   // курсор: строки с id <= lastId обработаны
+    qint64 targetId {0}; // MAX(id) на момент старта; строки новее пишутся уже в новом формате
+    qint64 processed {0};
+    bool done {false};
+
+    double fraction() const {
+        if (done) return 1.0;
+        return targetId > 0 ? double(lastId) / double(targetId) : 0.0;
+    }
+};
+
+// Миграции схемы (Db) только добавляют колонки/таблицы; перезапись существующих строк
+// выполняет этот раннер: keyset-порции по id, каждая порция и её курсор фиксируются одной
+// транзакцией. Прерванная миграция продолжается с сохранённого курсора при следующем запуске.
+// Список миграций — в DataMigrations.cpp, выполняются по очереди.
+class DataMigrationRunner {
+public:
+    explicit DataMigrationRunner(QSqlDatabase db);
+
+    // Одна порция первой незавершённой миграции (не больше limit строк). true — работа осталась.
+    bool step(int limit);
+
+    // Прогресс всех миграций; ещё не начатые — с нулевым курсором
+    std::vector<DataMigrationProgress> progress() const;
+
+private:
+    DataMigrationProgress load(const QString &name) const;
+    void save(const DataMigrationProgress &p);
+
+    QSqlDatabase m_db;
+};
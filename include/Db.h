@@ -10,6 +10,31 @@ public:
     // Возвращает имя соединения (то же самое, что передали)
     static QString openAndInit(const QString &connectionName, const QString &filePath);
 
+    // Дополнительное соединение к уже инициализированной БД (без миграций) — для фоновых потоков.
+    // Открывать и использовать в том потоке, где оно будет работать. readOnly — PRAGMA query_only.
+    static QString openConnection(const QString &connectionName, const QString &filePath, bool readOnly);
+
+    // Согласованная копия открытой БД в новый файл (VACUUM INTO; существующий файл заменяется).
+    // Нельзя вызывать внутри транзакции соединения.
+    static void snapshotTo(const QString &connectionName, const QString &targetPath);
+
+    // Приводит схему файла к текущей версии через временное соединение и закрывает его.
+    // Рассчитано на рабочий поток при запуске: последующий openAndInit увидит совпавшую
+    // версию (PRAGMA user_version) и пропустит миграции.
+    static void prepareSchema(const QString &filePath);
+
+    // Версия схемы, которую дают миграции; хранится в PRAGMA user_version.
+    // Миграции схемы — упорядоченный список шагов в Db.cpp, по одному на версию.
+    static constexpr int SCHEMA_VERSION = 6;
+
+    // Режим PRAGMA auto_vacuum (2 = INCREMENTAL): новый файл получает его при создании схемы, старый
+    // переводит DbMaintenance::enableIncrementalVacuum; свободные страницы DbMaintenance возвращает порциями
+    static constexpr int AUTO_VACUUM_INCREMENTAL = 2;
+
     // Имя таблицы
     static constexpr const char* TABLE_NODES = "nodes";
+    static constexpr const char* TABLE_PAYLOADS = "payloads";
+    static constexpr const char* TABLE_ATTACHMENTS = "attachments";
+    static constexpr const char* TABLE_DATA_MIGRATIONS = "data_migrations";
+    static constexpr const char* TABLE_ID_FLOORS = "id_floors";
 };
@@ -0,0 +1,72 @@
+// DbMaintenance — обслуживание файла БД короткими шагами: PRAGMA optimize, incremental_vacuum, WAL checkpoint
+#pragma once
+
+#include <QString>
+#include <QtSql/QSqlDatabase>
+
+struct MaintenanceOptions {
+    // Бюджет шага incremental_vacuum: страницы освобождаются, пока шаг укладывается в это время
+    int stepBudgetMs {20};
+    // Свободных страниц меньше порога — файл не ужимается (каждый шаг — запись и fsync)
+    int minFreePages {256};
+    // Страниц за один вызов PRAGMA incremental_vacuum(N)
+    int pagesPerExec {64};
+    // PRAGMA analysis_limit для optimize: ANALYZE читает не больше стольких строк индекса
+    int analysisLimit {400};
+};
+
+// Размеры файла на момент замера
+struct MaintenanceStats {
+    qint64 fileBytes {0};
+    qint64 walBytes {0};
+    qint64 pageSize {0};
+    qint64 pageCount {0};
+    qint64 freePages {0};
+};
+
+struct MaintenanceReport {
+    QString step;          // optimize / incremental_vacuum / checkpoint
+    MaintenanceStats before;
+    MaintenanceStats after;
+    qint64 elapsedMs {0};
+    QString detail;        // для checkpoint — кадры WAL, для vacuum — освобождённые страницы
+    bool performed {false}; // false — шаг пропущен (нечего делать)
+    bool more {false};      // осталась работа для следующего шага
+
+    // Одна строка для журнала: шаг, время, размеры до/после
+    QString toText() const;
+};
+
+// Журнал обслуживания: пропущенные шаги (нечего делать) не пишутся
+void logMaintenance(const MaintenanceReport &report);
+
+// Работает на соединении приложения в потоке GUI (как DataMigrationRunner): шаги вызываются
+// из BackgroundBatchRunner в простое. Новый файл создаётся с auto_vacuum = INCREMENTAL, старый
+// переводится один раз (enableIncrementalVacuum); без этого режима incremental_vacuum ничего не делает.
+// Ошибки — Errors::DbError.
+class DbMaintenance {
+public:
+    explicit DbMaintenance(QSqlDatabase db, MaintenanceOptions options = {});
+
+    // Однократный перевод старого файла в auto_vacuum = INCREMENTAL полной перестройкой (VACUUM) через
+    // своё соединение. Долго на больших файлах — только из фонового потока подготовки схемы приложения.
+    // Файл уже в этом режиме — performed = false. Занят другим соединением — Errors::DbError, перевод
+    // повторится при следующем запуске.
+    static MaintenanceReport enableIncrementalVacuum(const QString &filePath);
+
+    MaintenanceStats stats() const;
+
+    // Обновление статистики планировщика для таблиц, где она устарела (ограничено analysisLimit)
+    MaintenanceReport optimize();
+    // Возврат свободных страниц файлу в пределах stepBudgetMs; more — свободных ещё больше порога
+    MaintenanceReport incrementalVacuumStep();
+    // PASSIVE: переносит в файл кадры WAL, не дожидаясь читателей и не блокируя писателей
+    MaintenanceReport checkpoint();
+
+private:
+    qint64 pragmaValue(const QString &pragma) const;
+
+    QSqlDatabase m_db;
+    MaintenanceOptions m_options;
+    bool m_vacuuming {false}; // порог пройден — освобождаем до конца списка свободных страниц
+};
@@ -26,4 +26,10 @@ struct DbError : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
+// Структура дерева нарушена (цикл по parent_id, превышен предел глубины): файл повреждён.
+// Наследует DbError — существующие обработчики сбоев БД ловят и её
+struct CorruptTree : public DbError {
+    using DbError::DbError;
+};
+
 }
@@ -0,0 +1,58 @@
+// IAttachmentRepository — потоковое хранение больших вложений узлов (G-code, STL, PDF)
+//
+// Назначение:
+//  - Вложение хранится порциями фиксированного размера (attachment_chunks), поэтому ни запись,
+//    ни чтение не держат файл целиком в памяти: данные идут через QIODevice порция за порцией.
+//  - SHA-256 считается по ходу записи; метаданные (размер, хеш) доступны без чтения содержимого.
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class QIODevice;
+
+struct AttachmentInfo {
+    qint64 id {0};
+    qint64 nodeId {0};
+    QString name;
+    qint64 size {0};
+    // SHA-256 hex содержимого
+    QString sha256;
+};
+
+// Сводка по вложениям узла для отображения в дереве (без чтения содержимого)
+struct AttachmentSummary {
+    int count {0};
+    qint64 totalBytes {0};
+};
+
+class IAttachmentRepository {
+public:
+    virtual ~IAttachmentRepository() = default;
+
+    // Потоково записывает содержимое source как вложение name узла nodeId (в одной транзакции).
+    // Вложение с тем же именем у узла заменяется. source должен быть открыт на чтение и читается до
+    // atEnd(); ошибка чтения или обрыв источника — DbError, вложение не появляется.
+    virtual AttachmentInfo write(qint64 nodeId, const QString &name, QIODevice &source) = 0;
+
+    // Открывает вложение на чтение: QIODevice с произвольным доступом, порции подгружаются по мере чтения.
+    // Устройство использует соединение репозитория — читать в том же потоке.
+    virtual std::unique_ptr<QIODevice> openRead(qint64 attachmentId) = 0;
+
+    // Метаданные вложений узла (без содержимого), по имени.
+    virtual std::vector<AttachmentInfo> list(qint64 nodeId) = 0;
+
+    // Количество и суммарный размер вложений для набора узлов — одним запросом на порцию id.
+    virtual std::unordered_map<qint64, AttachmentSummary> summarize(const std::vector<qint64> &nodeIds) = 0;
+
+    virtual void remove(qint64 attachmentId) = 0;
+
+    // Перечитывает содержимое потоково и сверяет SHA-256 с сохранённым.
+    virtual bool verify(qint64 attachmentId) = 0;
+};
+
+class QSqlDatabase;
+std::unique_ptr<IAttachmentRepository> makeSqliteAttachmentRepository(const QSqlDatabase &db);
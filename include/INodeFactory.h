@@ -13,6 +13,9 @@ public:
     // trim + единые правила (без пустых и без '/')
     virtual QString normalizeName(const QString &raw) const = 0;
 
+    // Причина, по которой имя недопустимо; пустая строка — имя допустимо (без исключений)
+    virtual QString nameError(const QString &name) const = 0;
+
     // пробрасывает InvalidName при нарушении правил
     virtual void validateName(const QString &name) const = 0;
 
@@ -11,9 +11,18 @@
 #include <optional>
 #include <qtmetamacros.h>
 #include <vector>
+#include <utility>
+#include <unordered_map>
+#include <memory>
 #include <QObject>
 
+#include "Result.h"
 
+class QueryStats;
+
+// Предел глубины для обходов по parent_id: цикл в повреждённом файле не должен зациклить обход.
+// Превышение — Errors::CorruptTree
+inline constexpr int MAX_TREE_DEPTH = 4096;
 
 struct RepoRow {
     // Уникальный идентификатор строки (PRIMARY KEY)
@@ -24,10 +33,69 @@ struct RepoRow {
     std::optional<qint64> parentId;
     // Имя узла (используется в ограничении уникальности вместе с parent_id)
     QString name;
-    // Дополнительные данные. Semantics:
+    // Дополнительные данные (заполняется только get(); getChildren/findChildByName payload не читают,
+    // чтобы не тянуть и не распаковывать большие тексты — для них есть getPayload). Semantics:
     //  - std::nullopt => поле payload в БД равно NULL
     //  - std::optional("") => пустая строка сохранена в БД как пустая строка, не NULL
     std::optional<QString> payload;
+    // Ключ ручного порядка среди сиблингов; пустая строка => sort_key IS NULL
+    QString sortKey;
+};
+
+// Строка поддерева (getSubtree): метаданные узла, уровень (0 — дети корня выборки) и признак наличия детей
+struct SubtreeRow {
+    RepoRow row;
+    int depth {0};
+    bool hasChildren {false};
+};
+
+// Порядок выдачи детей
+enum class ChildOrder {
+    ByName,           // name COLLATE BINARY
+    Manual,           // sort_key (узлы без ключа первыми), затем name
+    CaseInsensitive,  // name_fold, затем name
+    Natural,          // name_natural ("T2" < "T10"), затем name
+};
+
+// Направление страницы относительно узла-якоря (сам якорь в страницу не входит)
+enum class PageDirection {
+    After,            // следующие за якорем
+    Before,           // предшествующие якорю; выдаются в том же прямом порядке
+};
+
+// Сравнение имени при поиске ребёнка
+enum class NameMatch {
+    Exact,            // BINARY, как в уникальном индексе
+    CaseInsensitive,  // по name_fold; при нескольких совпадениях первым идёт точное
+};
+
+// Отчёт о хранении payload для текущего файла БД
+struct PayloadStats {
+    // Узлов с непустым (не NULL) payload
+    qint64 nodesWithPayload {0};
+    // Из них хранят текст прямо в строке nodes
+    qint64 inlinePayloads {0};
+    // Уникальных текстов в общем хранилище payloads
+    qint64 sharedBlobs {0};
+    // Суммарный объём payload, как его видят узлы (байты UTF-8)
+    qint64 logicalBytes {0};
+    // Фактически записанный объём (inline + payloads)
+    qint64 storedBytes {0};
+
+    // Из них хранятся сжатыми (payload_format != 0)
+    qint64 compressedPayloads {0};
+
+    double dedupRatio() const {
+        return storedBytes > 0 ? double(logicalBytes) / double(storedBytes) : 1.0;
+    }
+};
+
+// Позиция фонового сжатия старых payload: сначала таблица nodes, затем payloads (по rowid)
+struct PayloadCompactCursor {
+    int table {0};
+    qint64 lastRowId {0};
+    int shard {0}; // номер файла в ShardedNodeRepository; одиночный репозиторий не использует
+    bool done() const { return table >= 2; }
 };
 
 class INodeRepository : public QObject {
@@ -35,15 +103,20 @@ public:
     virtual ~INodeRepository() = default;
 
     Q_OBJECT
-    // Создаёт новую запись узла.
+    // Создаёт новую запись узла (в конце ручного порядка сиблингов).
     //  - parentId: идентификатор родителя (ожидается существование)
     //  - name: имя узла; в БД предполагается уникальный индекс (parent_id, name)
     //  - payload: если не задано => сохранится NULL, иначе строка
     // Возвращает id вставленной записи. Должна быть транзакция.
-    virtual qint64 insert(qint64 parentId, const QString &name, const std::optional<QString> &payload) = 0;
+    // Конфликт имени и отсутствие родителя — ошибки в результате (DuplicateName / NotFound), без исключений.
+    virtual Result<qint64> tryInsert(qint64 parentId, const QString &name, const std::optional<QString> &payload) = 0;
+    qint64 insert(qint64 parentId, const QString &name, const std::optional<QString> &payload) {
+        return tryInsert(parentId, name, payload).valueOrThrow();
+    }
 
-    // Обновляет имя узла по id. Должна учитывать уникальность среди сиблингов.
-    virtual void updateName(qint64 id, const QString &newName) = 0;
+    // Обновляет имя узла по id. Должна учитывать уникальность среди сиблингов (DuplicateName; NotFound — нет узла).
+    virtual Result<void> tryUpdateName(qint64 id, const QString &newName) = 0;
+    void updateName(qint64 id, const QString &newName) { tryUpdateName(id, newName).valueOrThrow(); }
 
     // Меняет родителя узла. Должна учитывать уникальность (parent_id, name).
     virtual void updateParent(qint64 id, qint64 newParentId) = 0;
@@ -51,22 +124,93 @@ public:
     // Удаляет узел по id. Если есть внешние ключи/потомки — ответственность на уровне БД/вызывающего кода.
     virtual void remove(qint64 id) = 0;
 
+    // Пакетное удаление одной транзакцией (поддеревья удаляются каскадом)
+    virtual void removeMany(const std::vector<qint64> &ids) = 0;
+
     // Возвращает полную запись по id.
     //  - std::nullopt => запись не найдена
     virtual std::optional<RepoRow> get(qint64 id) = 0;
 
-    // Ищет прямого потомка по имени у заданного родителя.
+    // Метаданные узла (id, parent_id, name, sort_key) без payload: без чтения общего хранилища и
+    // распаковки — для обхода предков (buildPath) и кеша имён.
+    //  - std::nullopt => запись не найдена
+    virtual std::optional<RepoRow> getMeta(qint64 id) = 0;
+
+    // Ищет прямого потомка по имени у заданного родителя (payload не заполняется).
     //  - std::nullopt => не найден
-    virtual std::optional<RepoRow> findChildByName(qint64 parentId, const QString &name) = 0;
+    virtual std::optional<RepoRow> findChildByName(qint64 parentId, const QString &name,
+                                                   NameMatch match = NameMatch::Exact) = 0;
 
-    // Возвращает всех детей родителя, отсортированных по имени.
+    // Возвращает всех детей родителя, отсортированных по имени (payload не заполняется).
     virtual std::vector<RepoRow> getChildren(qint64 parentId) = 0;
 
+    // Страница детей в заданном порядке (LIMIT/OFFSET на стороне БД). limit < 0 — без ограничения.
+    virtual std::vector<RepoRow> getChildrenPage(qint64 parentId, ChildOrder order, qint64 limit, qint64 offset) = 0;
+
+    // Страница соседей узла anchorId (ребёнка parentId) в заданном порядке: не более limit строк сразу
+    // после него или перед ним. Продолжение по ключу порядка, а не по OFFSET — цена не растёт с позицией.
+    // Якорь не найден среди детей parentId — пусто.
+    virtual std::vector<RepoRow> getChildrenFrom(qint64 parentId, ChildOrder order, qint64 anchorId,
+                                                 PageDirection direction, qint64 limit) = 0;
+
+    // Позиция узла среди сиблингов в заданном порядке (число сиблингов перед ним); -1 — узел не найден.
+    // Считается диапазонами индекса порядка без выборки строк, но всё равно O(сиблингов перед узлом).
+    virtual qint64 childPosition(qint64 id, ChildOrder order) = 0;
+
+    // Поддерево rootId (без него самого) одним рекурсивным запросом: maxDepth уровней (< 0 — все),
+    // не более limit строк (< 0 — без ограничения). Порядок: по уровням, внутри родителя — ручной.
+    virtual std::vector<SubtreeRow> getSubtree(qint64 rootId, int maxDepth, qint64 limit) = 0;
+
+    // Размер того же поддерева, но не больше limit: рекурсия останавливается на limit строках,
+    // без сортировки и чтения колонок — проверка порога перед полной выборкой.
+    virtual qint64 countSubtree(qint64 rootId, int maxDepth, qint64 limit) = 0;
+
+    // Дети сразу нескольких родителей (WHERE parent_id IN (...), порциями) с признаком наличия детей.
+    // Порядок — по родителю, внутри родителя — order. Несуществующие parentIds просто ничего не дают.
+    virtual std::vector<SubtreeRow> getChildrenOfMany(const std::vector<qint64> &parentIds, ChildOrder order) = 0;
+
+    // Диапазонный просмотр детей по индексу (parent_id, name) в BINARY-порядке:
+    // name > from (или >= при inclusive) и name < to (пустой to — без верхней границы).
+    // Продолжение страницы — from = имя последней строки, inclusive = false.
+    virtual std::vector<RepoRow> scanChildrenByName(qint64 parentId, const QString &from, bool inclusive,
+                                                    const QString &to, int limit) = 0;
+
+    // Ручной порядок (sort_key):
+    //  - sortKeyOf: ключ узла; пустая строка — ключа нет или узел не найден
+    //  - neighborSortKey: ближайший ключ сиблинга строго после (after=true) или до key, без excludeId; пусто — нет такого
+    //  - lastSortKey: наибольший ключ среди детей parentId, без excludeId; пусто — ключей нет
+    //  - moveTo: меняет родителя и ключ одной строки (остальные сиблинги не трогаются)
+    //  - assignSortKeys: записывает ключи набору узлов в одной транзакции (перебалансировка)
+    //  - findUnkeyedRows: до limit пар (rowid, parent_id) узлов без ключа с rowid > afterRowId
+    virtual QString sortKeyOf(qint64 id) = 0;
+    virtual QString neighborSortKey(qint64 parentId, const QString &key, bool after, qint64 excludeId) = 0;
+    virtual QString lastSortKey(qint64 parentId, qint64 excludeId) = 0;
+    virtual Result<void> tryMoveTo(qint64 id, qint64 newParentId, const QString &sortKey) = 0;
+    void moveTo(qint64 id, qint64 newParentId, const QString &sortKey) {
+        tryMoveTo(id, newParentId, sortKey).valueOrThrow();
+    }
+
+    // Пакетное перемещение к newParentId одной транзакцией: (id, новый sort_key) для каждого узла.
+    // Конфликт имён откатывает всю пачку (DuplicateName).
+    virtual Result<void> tryMoveManyTo(const std::vector<std::pair<qint64, QString>> &idKeys, qint64 newParentId) = 0;
+    void moveManyTo(const std::vector<std::pair<qint64, QString>> &idKeys, qint64 newParentId) {
+        tryMoveManyTo(idKeys, newParentId).valueOrThrow();
+    }
+    virtual void assignSortKeys(const std::vector<std::pair<qint64, QString>> &keys) = 0;
+    virtual std::vector<std::pair<qint64, qint64>> findUnkeyedRows(qint64 afterRowId, int limit) = 0;
+
+    // Заполняет name_fold/name_natural у до limit строк, где их ещё нет. Возвращает число обновлённых строк.
+    virtual int backfillNameKeys(int limit) = 0;
+
     // Возвращает parent_id для узла.
     //  - std::nullopt => запись не найдена
     //  - пустой optional (has_value == false) => parent_id IS NULL (корневой узел)
     virtual std::optional<qint64> getParentId(qint64 id) = 0;
 
+    // Цепочка предков одним рекурсивным запросом: сам id, его родитель, ... корень. Пусто — узел не найден.
+    // Цепочка длиннее MAX_TREE_DEPTH (цикл) — Errors::CorruptTree.
+    virtual std::vector<qint64> getAncestorIds(qint64 id) = 0;
+
     // Быстрая проверка наличия хотя бы одного ребёнка.
     virtual bool hasChildren(qint64 id) = 0;
 
@@ -76,6 +220,21 @@ public:
     virtual void setPayload(qint64 id, const QString &payloadJson) = 0;
     virtual std::optional<QString> getPayload(qint64 id) = 0;
 
+    // Payload нескольких узлов одним запросом (порциями IN (...)); узлы без payload в ответ не попадают
+    virtual std::unordered_map<qint64, QString> getPayloads(const std::vector<qint64> &ids) = 0;
+
+    // Общее хранилище payload (см. RepoOptions::dedupPayloads):
+    //  - payloadStats: объём логический/фактический и коэффициент дедупликации
+    //  - collectPayloadGarbage: удаляет тексты без ссылок (например, после каскадного удаления), возвращает их число
+    //  - dedupInlinePayloads: переносит до limit inline-payload в общее хранилище, возвращает число перенесённых строк
+    virtual PayloadStats payloadStats() = 0;
+    virtual int collectPayloadGarbage() = 0;
+    virtual int dedupInlinePayloads(int limit) = 0;
+
+    // Онлайн-сжатие старых payload (RepoOptions::compressThreshold): просматривает до limit строк
+    // после cursor, сжимает подходящие и сдвигает cursor. Возвращает true, пока работа не закончена.
+    virtual bool compressPayloadBatch(PayloadCompactCursor &cursor, int limit) = 0;
+
     signals:
         void treeMapChanged();
 };
@@ -83,4 +242,23 @@ public:
 // Фабрика репозитория (скрываем QSqlDatabase в реализационном cpp)
 // Ожидается, что реализация инкапсулирует подключение и обеспечит корректные транзакции для write-операций.
 class QSqlDatabase;
-std::unique_ptr<INodeRepository> makeSqliteNodeRepository(const QSqlDatabase &db);
+
+// Необязательные возможности хранения
+struct RepoOptions {
+    // Дедупликация: новые payload пишутся в таблицу payloads (по SHA-256),
+    // а строка nodes хранит только payload_hash. Чтение работает в обоих режимах.
+    bool dedupPayloads {false};
+    // Порог сжатия в байтах UTF-8: payload не короче порога пишутся через qCompress в BLOB
+    // (с тегом формата). 0 — сжатие выключено. Несжатые строки читаются как раньше.
+    int compressThreshold {0};
+    // Статистика запросов (QueryStats.h): задержки по методам, строки, медленные запросы.
+    // nullptr — замеры выключены. Может быть общей для нескольких репозиториев.
+    std::shared_ptr<QueryStats> stats;
+    // Диапазон id новых узлов [idBase, idBase + idSpan) — для шардов (ShardedNodeRepository.h):
+    // id задаётся явно, MAX(id) в диапазоне + 1, но не ниже границы диапазона из таблицы id_floors
+    // (id узлов, ушедших в другой файл, не выдаются повторно). idSpan = 0 — id назначает SQLite.
+    qint64 idBase {0};
+    qint64 idSpan {0};
+};
+
+std::unique_ptr<INodeRepository> makeSqliteNodeRepository(const QSqlDatabase &db, const RepoOptions &options = {});
@@ -0,0 +1,66 @@
+// IntegrityChecker — проверка структуры дерева в файле БД: сироты, циклы, дубликаты имён, корень, индексы
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include <atomic>
+#include <vector>
+
+enum class IntegrityIssueKind {
+    MissingRoot,    // нет узла id = 1 (его создаёт ensureRoot)
+    RootInvalid,    // у корня есть родитель или непустое имя
+    ExtraRoot,      // ещё один узел с parent_id IS NULL
+    Orphan,         // parent_id ссылается на несуществующий узел
+    Cycle,          // цепочка родителей замкнута
+    Detached,       // узлы под сиротой или лишним корнем: от корня недостижимы
+    TooDeep,        // глубже MAX_TREE_DEPTH: обходы с ограничением глубины до них не дойдут
+    DuplicateName,  // одинаковые имена у сиблингов (уникальный индекс не сработал)
+    IndexCorrupt,   // PRAGMA integrity_check по таблице nodes и её индексам
+};
+
+const char *integrityIssueKindName(IntegrityIssueKind kind);
+
+struct IntegrityIssue {
+    IntegrityIssueKind kind {IntegrityIssueKind::Orphan};
+    qint64 nodeId {0};
+    qint64 parentId {0};
+    QString detail;
+};
+
+struct IntegrityOptions {
+    // Предел записей в отчёте: при массовом повреждении память и отчёт не растут без границ
+    int maxIssues {200};
+    // Недостижимых от корня строк разбирается не больше (классификация — обходом вверх по одной строке)
+    int maxUnreachableScan {100000};
+    // Полная проверка страниц таблицы nodes и её индексов; самая долгая часть
+    bool checkIndexes {true};
+};
+
+struct IntegrityReport {
+    std::vector<IntegrityIssue> issues;
+    bool truncated {false}; // проблем больше, чем вошло в отчёт
+    bool cancelled {false};
+    qint64 nodeCount {0};
+    qint64 reachableCount {0}; // включая корень
+    qint64 elapsedMs {0};
+
+    bool ok() const { return issues.empty() && !cancelled; }
+    // Многострочный текст для диалога и журнала
+    QString toText() const;
+};
+
+// Своё соединение только для чтения к файлу dbPath; все запросы — в одной транзакции чтения
+// (согласованный снимок, WAL — запись приложения не ждёт). Обход от корня — рекурсивный CTE
+// с пределом глубины, без множества посещённых: память ограничена фронтом обхода. Разбор
+// недостижимых узлов (сирота/цикл/отрезанная ветка) идёт, только если счётчики не сошлись.
+// run() вызывается в рабочем потоке; флаг cancel проверяется между этапами. Ошибки — Errors::DbError.
+class IntegrityChecker {
+public:
+    explicit IntegrityChecker(const QString &dbPath, IntegrityOptions options = {});
+
+    IntegrityReport run(const std::atomic<bool> *cancel = nullptr);
+
+private:
+    QString m_dbPath;
+    IntegrityOptions m_options;
+};
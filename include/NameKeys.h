@@ -0,0 +1,17 @@
+// NameKeys — производные ключи имени для индексированного поиска без учёта регистра и натуральной сортировки
+#pragma once
+
+#include <QString>
+
+// Ключи вычисляются при вставке/переименовании и хранятся в nodes.name_fold / nodes.name_natural,
+// поэтому сортировка и пагинация по ним идут по индексу, а не в C++ после выборки.
+namespace NameKeys {
+
+// Имя, приведённое к единому регистру (case folding)
+QString fold(const QString &name);
+
+// Ключ натуральной сортировки: case folding + каждая группа цифр кодируется длиной без ведущих нулей,
+// поэтому "T2" < "T10" при обычном BINARY-сравнении строк
+QString natural(const QString &name);
+
+}
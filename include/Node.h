@@ -19,6 +19,9 @@ struct NodeDTO {
     qint64 parentId {0};
     QString name;
     bool hasChildren {false};
+    // Сводка по вложениям (заполняется, если у сервиса есть хранилище вложений)
+    int attachmentCount {0};
+    qint64 attachmentBytes {0};
 };
 
 // Доменная модель (в памяти)
@@ -0,0 +1,79 @@
+// OnlineBackup — копия открытой БД по частям из фонового соединения, не блокируя запись приложения
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <vector>
+
+struct BackupOptions {
+    // Бюджет одного шага: число строк за шаг подстраивается так, чтобы шаг укладывался в это время
+    int stepBudgetMs {8};
+};
+
+struct BackupProgress {
+    QString table;          // копируемая сейчас таблица
+    qint64 rowsCopied {0};
+    qint64 bytesWritten {0}; // размер файла копии
+    qint64 elapsedMs {0};
+    double fraction {0.0};   // оценка по rowid (0..1)
+    bool done {false};
+
+    double bytesPerSec() const { return elapsedMs > 0 ? double(bytesWritten) * 1000.0 / double(elapsedMs) : 0.0; }
+};
+
+// Согласованный снимок: собственное соединение держит одну транзакцию чтения на всю копию (WAL — запись
+// приложения не блокируется и в копию не попадает; контрольная точка не перенесёт кадры новее снимка,
+// пока копия не закончится). Схема копии — DDL из sqlite_master источника (все таблицы и колонки,
+// auto_vacuum и user_version); таблицу, которую нельзя копировать по rowid (WITHOUT ROWID, виртуальная),
+// копия не пропускает, а завершается ошибкой. Таблицы копируются по возрастанию rowid порциями, индексы
+// и триггеры создаются после данных; нарушение внешних ключей в готовой копии — ошибка, копия не правится.
+// Копия пишется во временный файл рядом с целевым и заменяет его только в конце.
+// Все методы — в одном потоке (там, где вызван begin). Ошибки — Errors::DbError.
+class OnlineBackup {
+public:
+    OnlineBackup(const QString &sourcePath, const QString &targetPath, BackupOptions options = {});
+    // Незавершённая копия откатывается, временный файл удаляется
+    ~OnlineBackup();
+    OnlineBackup(const OnlineBackup &) = delete;
+    OnlineBackup &operator=(const OnlineBackup &) = delete;
+
+    void begin();
+    // Одна порция (в пределах stepBudgetMs); false — копия завершена и лежит в targetPath
+    bool step();
+    BackupProgress progress() const;
+
+    // Имя снимка по расписанию: <prefix>-yyyyMMdd-HHmmss.sqlite
+    static QString snapshotFileName(const QString &prefix, const QDateTime &at);
+    // Оставляет keep самых новых снимков prefix-* в dir; возвращает удалённые файлы
+    static QStringList rotateSnapshots(const QString &dir, const QString &prefix, int keep);
+
+private:
+    struct TableCopy {
+        QString name;
+        QString columns;     // колонки таблицы, через запятую
+        qint64 maxRowId {0}; // в снимке
+        qint64 cursor {0};   // последний скопированный rowid
+    };
+
+    void exec(const QString &sql);
+    void finish();
+    void abort();
+
+    QString m_sourcePath;
+    QString m_targetPath;
+    QString m_tmpPath;
+    QString m_connectionName;
+    BackupOptions m_options;
+    std::vector<TableCopy> m_tables;
+    std::vector<QString> m_deferredDdl; // индексы, триггеры, представления — после данных
+    size_t m_current {0};
+    int m_rowsPerStep {64};
+    qint64 m_rowsCopied {0};
+    qint64 m_totalRowIds {0};
+    QElapsedTimer m_clock;
+    bool m_open {false};
+    bool m_done {false};
+};
@@ -0,0 +1,76 @@
+// PathMatcher — glob-запросы по путям дерева ("Mills/*/D6*/**") с ленивой выдачей совпадений
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include <QRegularExpression>
+#include <optional>
+#include <vector>
+
+#include "INodeRepository.h"
+class INodeFactory;
+
+// Сегмент плана запроса (один уровень пути)
+struct PathSegment {
+    enum class Kind {
+        Literal,   // точное имя — индекс (parent_id, name)
+        Pattern,   // шаблон с '*', '?', '[...]' — диапазон по литеральному префиксу + проверка regex
+        AnyDepth,  // "**" — ноль и более уровней
+    };
+    Kind kind{Kind::Literal};
+    QString text;             // имя без экранирования (Literal) или исходный шаблон (Pattern)
+    QString rangeFrom;        // литеральный префикс шаблона: name >= rangeFrom
+    QString rangeTo;          // name < rangeTo; пусто — без верхней границы
+    bool prefixOnly{false};   // шаблон вида "D6*": попадание в диапазон уже означает совпадение
+    QRegularExpression regex; // проверка кандидата для остальных шаблонов
+};
+
+// Разбирает шаблон пути в план. Сегменты нормализуются и валидируются фабрикой имён;
+// подряд идущие "**" схлопываются в один. "\x" — буквальный символ x (в том числе '*', '?', '[', '\').
+std::vector<PathSegment> compilePathPattern(const QString &pattern, const INodeFactory &factory);
+
+// Ленивый обход плана в глубину: next() выдаёт id очередного совпадения, std::nullopt — конец.
+// Каждый узел посещается не больше одного раза: уровень стека хранит множество позиций плана, которых
+// достигает узел (при нескольких "**" одна и та же ветка подходит под разные разбиения пути), поэтому
+// повторов нет без запоминания выданных id. В памяти — только стек уровней и по одной странице детей
+// на уровень; широкий шаблон над большим деревом не буферизует результат. Курсор ссылается на
+// репозиторий и не должен его переживать; изменения дерева во время обхода не отслеживаются.
+class PathMatchCursor {
+public:
+    PathMatchCursor(INodeRepository &repo, qint64 startId, std::vector<PathSegment> plan, int pageSize = 256);
+
+    std::optional<qint64> next();
+
+private:
+    // Как перебирать детей уровня
+    enum class Scan {
+        None,     // дальше плана нет
+        Literal,  // одна позиция, точное имя — поиск по индексу
+        Range,    // одна позиция, шаблон — диапазон префикса
+        All,      // "**" или несколько позиций — все дети по порядку
+    };
+
+    struct Frame {
+        qint64 nodeId;
+        std::vector<size_t> states; // позиции плана (с учётом "**" как нуля уровней), по возрастанию
+        Scan scan{Scan::None};
+        size_t seg{0};          // позиция для Literal/Range
+        bool yielded{false};    // узел уже проверен на совпадение
+        bool started{false};    // Literal: поиск выполнен
+        bool scanned{false};    // первая страница детей уже прочитана
+        bool exhausted{false};  // больше страниц нет
+        QString after;          // имя последней прочитанной строки (keyset-пагинация)
+        std::vector<RepoRow> page;
+        size_t pos{0};
+    };
+
+    Frame makeFrame(qint64 nodeId, std::vector<size_t> states) const;
+    void closeStates(std::vector<size_t> &states) const;
+    std::vector<size_t> advance(const std::vector<size_t> &states, const QString &childName) const;
+    void fetchPage(Frame &f);
+
+    INodeRepository *m_repo;
+    std::vector<PathSegment> m_plan;
+    int m_pageSize;
+    std::vector<Frame> m_stack;
+};
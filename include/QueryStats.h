@@ -0,0 +1,130 @@
+// QueryStats — гистограммы задержек операций репозитория, счётчики строк и журнал медленных запросов
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVariant>
+#include <QElapsedTimer>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class QSqlQuery;
+
+// Лог-линейная гистограмма (в духе HDR): каждый интервал [2^k, 2^(k+1)) делится на 16 равных корзин,
+// относительная погрешность перцентилей ~6%, память постоянная, запись — O(1) без выделений.
+class LatencyHistogram {
+public:
+    void record(qint64 ns);
+    qint64 count() const { return m_count; }
+    qint64 totalNs() const { return m_totalNs; }
+    qint64 maxNs() const { return m_maxNs; }
+    // Верхняя граница корзины, в которую попал перцентиль p (0..1)
+    qint64 percentileNs(double p) const;
+
+private:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    static int bucketOf(quint64 ns);
+    static qint64 bucketUpperBound(int bucket);
+
+    std::array<qint64, BUCKETS> m_counts {};
+    qint64 m_count {0};
+    qint64 m_totalNs {0};
+    qint64 m_maxNs {0};
+};
+
+// Медленная операция: последний выполненный ею SQL с параметрами
+struct SlowQuery {
+    QString op;
+    QString sql;
+    QStringList params;
+    qint64 durationNs {0};
+    qint64 atMs {0}; // epoch-ms
+};
+
+struct OpStats {
+    QString op;
+    qint64 calls {0};
+    qint64 rows {0};
+    qint64 totalNs {0};
+    qint64 maxNs {0};
+    qint64 p50Ns {0};
+    qint64 p90Ns {0};
+    qint64 p99Ns {0};
+};
+
+struct QueryStatsSnapshot {
+    std::vector<OpStats> ops; // по убыванию суммарного времени
+    std::vector<SlowQuery> slow; // свежие последними
+    qint64 slowTotal {0};
+    qint64 slowThresholdMs {0};
+};
+
+// Общий сборщик для одного или нескольких репозиториев (потокобезопасен).
+// Выключенный (setEnabled(false)) не замеряет ничего: QueryScope остаётся пустым объектом.
+class QueryStats {
+public:
+    explicit QueryStats(qint64 slowThresholdMs = 50, size_t slowLogCapacity = 256);
+
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    void setSlowThresholdMs(qint64 ms);
+
+    // op — строковый литерал (ключ по указателю, без копирования строки на каждый вызов).
+    // Параметры переводятся в текст (с обрезкой) только для медленной операции
+    void recordOp(const char *op, qint64 ns, qint64 rows, const QString &sql, const QVariantList &params);
+
+    QueryStatsSnapshot snapshot() const;
+    void reset();
+
+    // Снимок в JSON: операции с перцентилями в мкс и журнал медленных запросов
+    QByteArray toJson() const;
+
+private:
+    struct OpData {
+        LatencyHistogram histogram;
+        qint64 rows {0};
+    };
+
+    std::atomic<bool> m_enabled {true};
+    mutable std::mutex m_mutex;
+    std::unordered_map<const char*, OpData> m_ops;
+    std::deque<SlowQuery> m_slow;
+    size_t m_slowCapacity;
+    qint64 m_slowThresholdNs;
+    qint64 m_slowTotal {0};
+};
+
+// Замер одной операции репозитория (RAII). Регистрирует себя текущей в *current, чтобы выполненные
+// внутри запросы добавили число изменённых строк и запомнились для журнала медленных запросов.
+class QueryScope {
+public:
+    QueryScope(QueryStats *stats, const char *op, QueryScope **current);
+    ~QueryScope();
+    QueryScope(const QueryScope &) = delete;
+    QueryScope &operator=(const QueryScope &) = delete;
+
+    void addRows(qint64 n) { m_rows += n; }
+    // После exec: изменённые строки для записи и ссылки (без копирования данных) на SQL и параметры
+    // последнего запроса — в текст они переводятся, только если операция окажется медленной
+    void noteStatement(const QSqlQuery &q);
+
+private:
+    QueryStats *m_stats;
+    const char *m_op;
+    QueryScope **m_current;
+    QueryScope *m_previous {nullptr};
+    QElapsedTimer m_timer;
+    qint64 m_rows {0};
+    QString m_sql;
+    QVariantList m_params;
+};
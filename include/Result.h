@@ -0,0 +1,77 @@
+// Result — результат операции без исключений для обычных исходов (дубликат имени, узел не найден, цикл)
+#pragma once
+
+#include <QString>
+#include <optional>
+#include <utility>
+#include <variant>
+
+class QSqlError;
+
+// Обычные исходы отдельно от сбоев БД: пакетные задачи ветвятся по коду, а не по тексту ошибки
+enum class ErrorCode {
+    DuplicateName,      // SQLITE_CONSTRAINT_UNIQUE
+    InvalidName,
+    NotFound,           // в т.ч. SQLITE_CONSTRAINT_FOREIGNKEY (родителя нет)
+    MoveIntoDescendant,
+    Busy,               // SQLITE_BUSY / SQLITE_LOCKED — можно повторить
+    Constraint,         // прочие нарушения ограничений
+    Db,
+};
+
+const char *errorCodeName(ErrorCode code);
+
+struct Error {
+    ErrorCode code {ErrorCode::Db};
+    QString message;
+};
+
+// Исключение Errors::*, соответствующее коду (для бросающих обёрток)
+[[noreturn]] void throwError(const Error &error);
+
+// Код по расширенному коду результата SQLite (QSqlError::nativeErrorCode), без разбора текста
+ErrorCode classifySqlError(const QSqlError &error);
+Error sqlError(const QSqlError &error);
+
+template <typename T>
+class [[nodiscard]] Result {
+public:
+    Result(T value) : m_value(std::in_place_index<0>, std::move(value)) {}
+    Result(Error error) : m_value(std::in_place_index<1>, std::move(error)) {}
+
+    bool ok() const { return m_value.index() == 0; }
+    explicit operator bool() const { return ok(); }
+
+    const T &value() const { return std::get<0>(m_value); }
+    const Error &error() const { return std::get<1>(m_value); }
+    ErrorCode code() const { return error().code; }
+
+    // Значение или исключение Errors::* (поведение прежнего API)
+    T valueOrThrow() && {
+        if (!ok()) throwError(error());
+        return std::get<0>(std::move(m_value));
+    }
+
+private:
+    std::variant<T, Error> m_value;
+};
+
+template <>
+class [[nodiscard]] Result<void> {
+public:
+    Result() = default;
+    Result(Error error) : m_error(std::move(error)) {}
+
+    bool ok() const { return !m_error.has_value(); }
+    explicit operator bool() const { return ok(); }
+
+    const Error &error() const { return *m_error; }
+    ErrorCode code() const { return m_error->code; }
+
+    void valueOrThrow() const {
+        if (m_error) throwError(*m_error);
+    }
+
+private:
+    std::optional<Error> m_error;
+};
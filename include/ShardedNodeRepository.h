@@ -0,0 +1,47 @@
+// ShardedNodeRepository — выбранные поддеревья верхнего уровня в отдельных файлах БД, маршрутизация по узлу
+#pragma once
+
+#include "INodeRepository.h"
+
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <vector>
+
+// Диапазон id на файл: шард k выдаёт новые id из [k * SHARD_ID_SPAN, (k + 1) * SHARD_ID_SPAN).
+// Основной файл — шард 0, поэтому id существующей БД остаются на месте.
+inline constexpr qint64 SHARD_ID_SPAN = qint64(1) << 40;
+
+struct ShardSpec {
+    QString path;
+    // Узлы верхнего уровня (дети корня) с этими именами создаются в этом файле и переносятся в него
+    // при перемещении в корень
+    QStringList topLevelNames;
+};
+
+struct ShardedRepoOptions {
+    QString homePath;              // корень и остальные узлы верхнего уровня (шард 0)
+    std::vector<ShardSpec> shards; // шарды 1..N
+    // Префикс имён соединений (<prefix>_<номер шарда>): у каждого экземпляра — свой
+    QString connectionPrefix {"shard"};
+    // Общие настройки файлов; idBase/idSpan выставляются по номеру шарда
+    RepoOptions repo;
+};
+
+// Каждый файл — своё соединение (Db::openAndInit) и свой SqliteNodeRepository: запись в разные шарды
+// не делит блокировку файла, писатели в разных потоках (у каждого потока свой экземпляр) не ждут друг
+// друга. Узел и всё его поддерево лежат в одном файле. Корень (id = 1) есть в каждом файле; его дети —
+// объединение детей корня всех шардов, уникальность их имён по всем файлам проверяет маршрутизатор.
+// Маршрут по id — по диапазону; узлы, перенесённые между файлами, собираются при открытии (id вне
+// диапазона своего файла). Маршрут проверяется в файле при каждом обращении по id: узел, который
+// перенёс другой экземпляр, ищется во всех файлах. id, ушедшие из файла, шард-владелец диапазона
+// повторно не выдаёт (граница в таблице id_floors этого файла).
+// Перенос между шардами: запись в источник блокируется, поддерево (узлы, payload, вложения) копируется
+// на соединении приёмника (источник подключён через ATTACH) и фиксируется, затем вторая транзакция
+// источника удаляет оригинал. id узлов сохраняются, id вложений — нет. При сбое между фиксациями
+// поддерево остаётся в двух файлах (при открытии — предупреждение в журнале), но не теряется. Поддерево
+// глубже MAX_TREE_DEPTH не переносится (Constraint). Пакетное перемещение атомарно и поэтому допустимо
+// только в пределах одного файла: пачка, затрагивающая несколько файлов, отклоняется целиком
+// (Constraint). Внутри внешней транзакции перенос между шардами недоступен. Экземпляр — в одном потоке;
+// соединения закрываются в деструкторе. Ошибки — как у SqliteNodeRepository.
+std::unique_ptr<INodeRepository> makeShardedNodeRepository(const ShardedRepoOptions &options);
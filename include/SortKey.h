@@ -0,0 +1,18 @@
+// SortKey — дробные лексикографические ключи ручного порядка сиблингов (nodes.sort_key)
+#pragma once
+
+#include <QString>
+#include <QStringList>
+
+// Ключи — строки из цифр base-62 ("0-9A-Za-z", порядок совпадает с BINARY-сравнением SQLite)
+// без завершающего '0'. Между любыми двумя ключами всегда найдётся третий, поэтому
+// вставка между соседями меняет только перемещаемую строку, без перенумерации остальных.
+namespace SortKey {
+
+// Ключ строго между lo и hi. Пустой lo — «минус бесконечность», пустой hi — «плюс бесконечность».
+QString between(const QString &lo, const QString &hi);
+
+// count возрастающих ключей строго между lo и hi, распределённых равномерно (для перебалансировки)
+QStringList sequence(const QString &lo, const QString &hi, int count);
+
+}
@@ -0,0 +1,21 @@
+// SqlTransaction — вложенные транзакции на одном соединении (внешняя BEGIN, внутренние SAVEPOINT)
+#pragma once
+
+#include <QtSql/QSqlDatabase>
+
+// Глубина вложенности хранится на драйвере соединения — он общий у всех копий QSqlDatabase,
+// поэтому репозитории узлов и вложений видят внешнюю транзакцию пакетного сценария (treectl)
+// и вместо BEGIN открывают SAVEPOINT. Вне пакета поведение прежнее: одна операция — одна транзакция.
+// Откат вложенного уровня отменяет только его изменения; решение по внешней транзакции — за её владельцем.
+namespace SqlTx {
+
+// false — ошибка; текст в db.lastError() (BEGIN/COMMIT) или в логе (SAVEPOINT).
+// Неудачный commit откатывает свой уровень — вызывающему остаётся только сообщить об ошибке
+bool begin(const QSqlDatabase &db);
+bool commit(const QSqlDatabase &db);
+bool rollback(const QSqlDatabase &db);
+
+// 0 — транзакции нет
+int depth(const QSqlDatabase &db);
+
+}
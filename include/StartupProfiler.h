@@ -0,0 +1,27 @@
+// StartupProfiler — отметки фаз запуска приложения (время от старта процесса) и отчёт по ним
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+
+class QWidget;
+
+// Часы запускаются в start() (первой строкой main). mark() потокобезопасен: миграции
+// отмечаются из рабочего потока. Каждая отметка сразу пишется в лог.
+namespace StartupProfiler {
+
+void start();
+
+// Отметка фазы; повторная отметка с тем же именем игнорируется (считается первое наступление)
+void mark(const QString &phase);
+
+// Отметит "first-frame" при первой отрисовке окна (time-to-first-frame)
+void watchFirstFrame(QWidget *window);
+
+// Миллисекунды от start() до фазы; -1 — фаза ещё не наступила
+qint64 elapsedAt(const QString &phase);
+
+// Текстовый отчёт: фазы в порядке наступления с временем от старта и приростом
+QString report();
+
+}
@@ -0,0 +1,45 @@
+// Trace — вложенные интервалы (span) по потокам и экспорт в Chrome trace_event JSON (Perfetto, chrome://tracing)
+#pragma once
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+
+// Span пишет одно событие "complete" (начало + длительность) при выходе из области видимости.
+// Каждый поток пишет в собственный кольцевой буфер без блокировок (старые события затираются);
+// экспорт читает буферы всех потоков, в том числе завершившихся.
+// Выключенная трассировка (по умолчанию): конструктор Span — одна relaxed-загрузка флага.
+namespace Trace {
+
+void setEnabled(bool enabled);
+bool enabled();
+
+// Имя текущего потока в трассе (по умолчанию — имя QThread или "thread-N")
+void setThreadName(const QString &name);
+
+// Все буферы в формате {"traceEvents": [...]}; ts/dur — в микросекундах
+QByteArray exportChromeJson();
+
+// Очистка буферов (события, записанные во время очистки, могут остаться)
+void clear();
+
+// name и category — строковые литералы: хранятся указатели, не копии
+class Span {
+public:
+    Span(const char *category, const char *name);
+    ~Span();
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+private:
+    const char *m_category;
+    const char *m_name;
+    qint64 m_startNs; // < 0 — трассировка была выключена при входе
+};
+
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+// Span до конца текущего блока
+#define TRACE_SPAN(category, name) ::Trace::Span TRACE_CONCAT(traceSpan_, __LINE__)(category, name)
@@ -3,17 +3,27 @@
 
 #include <QtGlobal>
 #include <QString>
+#include <functional>
 #include <optional>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "Node.h"
-class INodeRepository;
+#include "INodeRepository.h"
+#include "IAttachmentRepository.h"
+#include "PathMatcher.h"
+#include "Result.h"
+#include "WorkloadRecorder.h"
 class INodeFactory;
+class QIODevice;
 
 // Сервис работы с деревом узлов: CRUD-операции, перемещение, построение и
 // разрешение путей, чтение/запись payload. Хранит небольшой кеш метаданных
 // (parentId, name) для ускорения операций с путями.
+// Методы try* возвращают Result: дубликат имени, недопустимое имя, отсутствующий узел/путь и цикл —
+// код ошибки без исключения (пакетные задачи, где такие исходы обычны). Одноимённые методы без try —
+// обёртки, бросающие Errors::*. Сбои БД во вспомогательных запросах бросают DbError в обоих вариантах.
 class TreeService {
 public:
     static constexpr qint64 ROOT_ID = 1;
@@ -27,33 +37,133 @@ public:
     // Создает дочерний узел: нормализует и валидирует имя, затем сохраняет.
     // Уникальность среди сиблингов обеспечивает репозиторий/БД.
     qint64 createNode(qint64 parentId, const QString &name, std::optional<QString> payload = {});
+    Result<qint64> tryCreateNode(qint64 parentId, const QString &name, std::optional<QString> payload = {});
 
     // Переименовывает узел: нормализует/валидирует имя и инвалидирует кеш.
     void renameNode(qint64 id, const QString &newName);
+    Result<void> tryRenameNode(qint64 id, const QString &newName);
 
-    // Перемещает узел к новому родителю; запрещено перемещение в собственного потомка.
+    // Перемещает узел к новому родителю (в конец ручного порядка); запрещено перемещение в собственного потомка.
     void moveNode(qint64 id, qint64 newParentId);
+    Result<void> tryMoveNode(qint64 id, qint64 newParentId);
+
+    // Перемещает узел к newParentId и ставит его в ручном порядке сразу после prevSiblingId
+    // (или перед nextSiblingId, если prev = 0; оба 0 — в конец). Пишется только строка перемещаемого узла.
+    void moveNodeBetween(qint64 id, qint64 newParentId, qint64 prevSiblingId, qint64 nextSiblingId);
+
+    // Пакетное перемещение: узлы ставятся подряд (в порядке ids) между prevSiblingId и nextSiblingId
+    // (оба 0 — в конец). Циклы проверяются одним запросом цепочки предков нового родителя,
+    // запись — одной транзакцией; при любой ошибке не перемещается ни один узел.
+    void moveNodes(const std::vector<qint64> &ids, qint64 newParentId,
+                   qint64 prevSiblingId = 0, qint64 nextSiblingId = 0);
+    Result<void> tryMoveNodes(const std::vector<qint64> &ids, qint64 newParentId,
+                              qint64 prevSiblingId = 0, qint64 nextSiblingId = 0);
+
+    // Перебалансировка ключей ручного порядка: одна «длинная» группа сиблингов за вызов.
+    // true — в очереди остались ещё группы.
+    bool rebalancePendingSortKeys();
+
+    // Выдача ключей узлам без sort_key (старые файлы): порция строк после cursor; true — работа не закончена.
+    bool backfillSortKeysBatch(qint64 &cursor, int limit);
 
     // Удаляет узел (кроме корня). Кеш очищается для затронутых узлов.
     void deleteNode(qint64 id);
 
+    // Пакетное удаление одной транзакцией (корень в списке недопустим)
+    void deleteNodes(const std::vector<qint64> &ids);
+
     // Строит путь вида "a/b/c" от корня до указанного узла, используя кеш.
+    // Глубже MAX_TREE_DEPTH (цикл по parent_id) — Errors::CorruptTree.
     QString buildPath(qint64 id);
 
     // Разрешает строковый путь в id узла. Каждый сегмент нормализуется и валидируется.
-    qint64 resolvePath(const QString &path);
+    // При NameMatch::CaseInsensitive сегменты сравниваются без учёта регистра (по индексу name_fold).
+    qint64 resolvePath(const QString &path, NameMatch match = NameMatch::Exact);
+    Result<qint64> tryResolvePath(const QString &path, NameMatch match = NameMatch::Exact);
+
+    // Glob-запрос от корня: '*', '?', '[...]' внутри сегмента, "**" — любое число уровней.
+    // Совпадения выдаются лениво (см. PathMatchCursor); курсор не должен переживать сервис.
+    PathMatchCursor match(const QString &pattern);
+
+    // Цепочка от корня до узла включительно (один рекурсивный запрос); пусто — узел не найден.
+    std::vector<qint64> ancestorChain(qint64 id);
+
+    // Позиция узла среди сиблингов в заданном порядке; -1 — узел не найден.
+    qint64 childPosition(qint64 id, ChildOrder order = ChildOrder::Manual);
+
+    // Ищет прямого потомка по имени; std::nullopt — не найден.
+    std::optional<NodeDTO> findChild(qint64 parentId, const QString &name, NameMatch match = NameMatch::Exact);
+
+    // Порция заполнения ключей имени у старых строк; true — работа не закончена.
+    bool backfillNameKeysBatch(int limit);
 
     // Возвращает список детей родителя с пагинацией и признаком наличия потомков.
-    std::vector<NodeDTO> listChildren(qint64 parentId, size_t limit = SIZE_MAX, size_t offset = 0);
+    std::vector<NodeDTO> listChildren(qint64 parentId, size_t limit = SIZE_MAX, size_t offset = 0,
+                                      ChildOrder order = ChildOrder::ByName);
+
+    // Соседи узла anchorId среди детей parentId: до limit узлов после или перед ним (сам он не входит).
+    // Продолжение страниц по ключу порядка — для окон вокруг узла и подгрузки «ещё выше/ниже».
+    std::vector<NodeDTO> listChildrenFrom(qint64 parentId, qint64 anchorId, PageDirection direction, size_t limit,
+                                          ChildOrder order = ChildOrder::Manual);
+
+    // Поддерево rootId (без него самого) одним запросом: maxDepth уровней (< 0 — все), не более limit узлов.
+    // Порядок — по уровням, внутри родителя — ручной; parentId заполнен у каждого узла.
+    std::vector<NodeDTO> listSubtree(qint64 rootId, int maxDepth, size_t limit = SIZE_MAX);
+
+    // Число узлов того же поддерева, но не больше limit — дешёвая проверка перед listSubtree
+    size_t countSubtree(qint64 rootId, int maxDepth, size_t limit);
+
+    // Дети нескольких родителей одним запросом (восстановление раскрытых папок). Удалённые родители
+    // просто не дают строк. parentId заполнен у каждого узла.
+    std::vector<NodeDTO> listChildrenOfMany(const std::vector<qint64> &parentIds, ChildOrder order = ChildOrder::Manual);
 
     // Записывает/читает произвольный JSON payload, связанный с узлом.
     void setPayload(qint64 id, const QString &payloadJson);
     QString getPayload(qint64 id);
 
+    // Payload нескольких узлов одним запросом; узлы без payload отсутствуют в ответе
+    std::unordered_map<qint64, QString> getPayloads(const std::vector<qint64> &ids);
+
+    // Общее хранилище payload: отчёт о дедупликации, сборка мусора и перенос inline-текстов.
+    PayloadStats payloadStats();
+    int collectPayloadGarbage();
+    int dedupInlinePayloads(int limit);
+
+    // Порция онлайн-сжатия старых payload; true — пока работа не закончена.
+    bool compressPayloadBatch(PayloadCompactCursor &cursor, int limit);
+
+    // Хранилище вложений (необязательно). Без него listChildren не заполняет сводку вложений,
+    // а методы вложений бросают DbError.
+    void setAttachmentRepository(std::unique_ptr<IAttachmentRepository> attachments);
+
+    // Потоковая запись вложения из source (файл не загружается в память целиком).
+    AttachmentInfo attachFile(qint64 nodeId, const QString &name, QIODevice &source);
+    std::vector<AttachmentInfo> listAttachments(qint64 nodeId);
+    std::unique_ptr<QIODevice> openAttachment(qint64 attachmentId);
+    void removeAttachment(qint64 attachmentId);
+
+    // Запись нагрузки (tree_replay): изменения, чтения детей/поддеревьев/payload и операции с путями.
+    // nullptr — запись выключена.
+    void setRecorder(std::shared_ptr<WorkloadRecorder> recorder) { m_recorder = std::move(recorder); }
+
+    // Вызывается в начале каждой изменяющей операции (создание, переименование, перемещение, удаление,
+    // payload, вложения): фоновые задачи (резервная копия, обслуживание) уступают записи UI.
+    // Фоновые порционные методы (ключи, дедупликация, сжатие) его не вызывают. Пусто — не вызывается.
+    void setWriteObserver(std::function<void()> observer) { m_writeObserver = std::move(observer); }
+
 private:
     // Доступ к хранилищу узлов (БД) и бизнес-правилам имен.
     std::unique_ptr<INodeRepository> m_repo;
     std::unique_ptr<INodeFactory> m_factory;
+    std::unique_ptr<IAttachmentRepository> m_attachments;
+
+    IAttachmentRepository &attachments();
+
+    // Заполняет сводку вложений одним запросом (если хранилище вложений подключено)
+    void fillAttachmentSummary(std::vector<NodeDTO> &nodes);
+
+    // DTO страницы детей: признак потомков и сводка вложений
+    std::vector<NodeDTO> childDtos(const std::vector<RepoRow> &rows);
 
     // Простой кеш id -> (parentId, name) для ускорения buildPath/resolvePath
     struct CacheEntry { qint64 parentId; QString name; };
@@ -61,13 +171,41 @@ private:
 
     // Унифицирует и валидирует имя через фабрику.
     void ensureValidName(const QString &name) const;
+    Result<QString> checkedName(const QString &raw) const;
 
-    // Проверяет, является ли nodeId потомком potentialAncestorId (или совпадает с ним).
-    bool isDescendant(qint64 nodeId, qint64 potentialAncestorId);
+    Result<void> moveNodesImpl(const std::vector<qint64> &ids, qint64 newParentId,
+                               qint64 prevSiblingId, qint64 nextSiblingId);
 
     // Подгружает метаданные узла в кеш при необходимости.
     void warmCache(qint64 id);
 
     // Удаляет запись о метаданных узла из кеша.
     void invalidateCache(qint64 id);
+
+    std::shared_ptr<WorkloadRecorder> m_recorder;
+    int m_recordDepth {0};
+
+    std::function<void()> m_writeObserver;
+    void noteWrite() {
+        if (m_writeObserver) m_writeObserver();
+    }
+
+    // Запись вызова; аргументы собираются (makeArgs) только при включённой записи и только для внешнего вызова
+    template <typename MakeArgs>
+    WorkloadCall record(WorkloadOp op, MakeArgs &&makeArgs) {
+        if (!m_recorder || m_recordDepth > 0) return WorkloadCall();
+        return WorkloadCall(m_recorder.get(), &m_recordDepth, op, makeArgs());
+    }
+
+    // Длина payload (-1 — нет) и, если рекордер хранит payload, сам текст
+    void appendPayloadArgs(QVariantList &args, const std::optional<QString> &payload) const;
+
+    // Родители, чьи ключи ручного порядка стали слишком длинными
+    std::unordered_set<qint64> m_rebalanceQueue;
+
+    // Границы (lo, hi) ключей для позиции между соседями (см. moveNodeBetween); пустая граница — открытая
+    std::pair<QString, QString> sortKeyBounds(qint64 parentId, qint64 id, qint64 prevSiblingId, qint64 nextSiblingId);
+
+    // Переписывает ключи всех детей parentId равномерно, сохраняя текущий ручной порядок.
+    void rebalanceSortKeys(qint64 parentId);
 };
@@ -9,9 +9,18 @@ class TreeWidgetEx : public QTreeWidget {
 public:
     explicit TreeWidgetEx(QWidget *parent = nullptr);
 
+    // Выделенные элементы без тех, чей предок тоже выделен (перемещается/удаляется вместе с ним),
+    // в порядке отображения. Плейсхолдеры не включаются.
+    QList<QTreeWidgetItem*> selectedTopMostItems() const;
+
 signals:
-    void requestMove(qint64 nodeId, qint64 newParentId, bool &accepted);
+    // items — перетаскиваемые элементы (верхние в выделении); newParentItem — новый родитель (nullptr — верхний уровень);
+    // row — позиция среди его детей (-1 — в конец). Если обработчик подтвердил перемещение (accepted),
+    // он же переносит элементы в виджете — базовая реализация Qt не применяется.
+    void requestMove(const QList<QTreeWidgetItem*> &items, QTreeWidgetItem *newParentItem, int row, bool &accepted);
 
 protected:
     void dropEvent(QDropEvent *event) override;
+    // Только span трассы вокруг отрисовки базового класса
+    void paintEvent(QPaintEvent *event) override;
 };
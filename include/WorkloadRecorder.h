@@ -0,0 +1,117 @@
+// WorkloadRecorder — запись вызовов TreeService (аргументы, время, длительность) для воспроизведения в tree_replay
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include <QVariant>
+#include <QVariantList>
+#include <QFile>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include "INodeRepository.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Коды операций в файле; только дописываются (старые записи должны читаться новыми сборками)
+enum class WorkloadOp : quint8 {
+    CreateNode = 1,         // parentId, name, payloadLen (-1 — без payload) [, payload]
+    RenameNode = 2,         // id, newName
+    MoveNodes = 3,          // ids (список), newParentId, prevSiblingId, nextSiblingId
+    DeleteNodes = 4,        // ids (список)
+    SetPayload = 5,         // id, payloadLen [, payload]
+    GetPayload = 6,         // id
+    ListChildren = 7,       // parentId, limit (-1 — все), offset, order
+    ListChildrenOfMany = 8, // parentIds (список), order
+    ListSubtree = 9,        // rootId, maxDepth, limit
+    BuildPath = 10,         // id
+    ResolvePath = 11,       // path, match
+    FindChild = 12,         // parentId, name, match
+    DeleteNode = 13,        // id
+    ListChildrenFrom = 14,  // parentId, anchorId, direction, limit (-1 — все), order
+};
+
+const char *workloadOpName(WorkloadOp op);
+
+// Одна запись журнала. result — id созданного узла (CreateNode), для сопоставления id при воспроизведении.
+struct WorkloadRecord {
+    WorkloadOp op {WorkloadOp::GetPayload};
+    qint64 atUs {0};       // от начала записи
+    qint64 durationNs {0};
+    bool ok {true};        // false — вызов завершился исключением
+    qint64 result {0};
+    QVariantList args;
+};
+
+// Файл: заголовок (magic, версия, параметры хранения payload) и записи QDataStream подряд. Payload по умолчанию
+// не сохраняется — только длина (воспроизведение подставляет текст той же длины); keepPayloads — полный текст.
+// Из storage в заголовок пишутся dedupPayloads и compressThreshold — tree_replay повторяет тот же путь записи.
+// Потокобезопасен; ошибки записи файла — Errors::DbError при открытии, дальше запись молча прекращается.
+class WorkloadRecorder {
+public:
+    static constexpr quint32 MAGIC = 0x54524C57; // "TRLW"
+    static constexpr quint16 VERSION = 2; // 2 — параметры хранения в заголовке
+
+    WorkloadRecorder(const QString &filePath, const RepoOptions &storage, bool keepPayloads = false);
+    ~WorkloadRecorder();
+    WorkloadRecorder(const WorkloadRecorder &) = delete;
+    WorkloadRecorder &operator=(const WorkloadRecorder &) = delete;
+
+    bool keepPayloads() const { return m_keepPayloads; }
+    qint64 elapsedUs() const { return m_clock.nsecsElapsed() / 1000; }
+    qint64 recordCount() const;
+
+    void append(const WorkloadRecord &record);
+    void flush();
+
+private:
+    mutable std::mutex m_mutex;
+    QFile m_file;
+    QDataStream m_out;
+    QElapsedTimer m_clock;
+    bool m_keepPayloads;
+    qint64 m_count {0};
+};
+
+// Чтение журнала записью за записью; неверный заголовок — Errors::DbError
+class WorkloadReader {
+public:
+    explicit WorkloadReader(const QString &filePath);
+
+    // false — конец файла (или обрезанная последняя запись)
+    bool next(WorkloadRecord &record);
+
+    // Параметры хранения payload при записи (dedupPayloads, compressThreshold); nullopt — журнал версии 1
+    const std::optional<RepoOptions> &storage() const { return m_storage; }
+
+private:
+    QFile m_file;
+    QDataStream m_in;
+    std::optional<RepoOptions> m_storage;
+};
+
+// Один вызов сервиса (RAII): пишет запись при выходе. Неактивен без рекордера и для вложенных вызовов
+// (moveNode → moveNodes пишется один раз — внешним методом).
+class WorkloadCall {
+public:
+    WorkloadCall() = default;
+    WorkloadCall(WorkloadRecorder *recorder, int *depth, WorkloadOp op, QVariantList args);
+    ~WorkloadCall();
+    WorkloadCall(const WorkloadCall &) = delete;
+    WorkloadCall &operator=(const WorkloadCall &) = delete;
+
+    void setResult(qint64 result) { m_record.result = result; }
+    // Ошибка, возвращённая через Result (исключения отмечаются сами)
+    void setFailed(bool failed) { m_failed = failed; }
+
+private:
+    WorkloadRecorder *m_recorder {nullptr};
+    int *m_depth {nullptr};
+    int m_exceptions {0};
+    bool m_failed {false};
+    QElapsedTimer m_timer;
+    WorkloadRecord m_record;
+};
+
+// Аргумент-список id в виде, пригодном для QDataStream
+QVariantList workloadIdList(const std::vector<qint64> &ids);
@@ -5,11 +5,14 @@
 
 // Подключаем базовый класс для главного окна
 #include <QMainWindow>
+#include <QString>
+#include <memory>
 
 // Предварительное объявление класса SecondWindow
 // Это позволяет избежать циклических зависимостей заголовочных файлов
 // Полное определение класса подключим в .cpp файле
 class SecondWindow;
+class QThread;
 
 // Макросы Qt для работы с UI-классами
 QT_BEGIN_NAMESPACE
@@ -44,12 +47,20 @@ private slots:
     void onShowFirstWindow();
 
 private:
+    // Второе окно создаётся при первом переходе к нему: до этого дождаться
+    // фоновой подготовки схемы БД. false — окно создать не удалось.
+    bool ensureSecondWindow();
+
     // Указатель на UI-объект (содержит все элементы интерфейса)
     Ui::MainWindow* ui;
 
     // Указатель на второе окно
     // Храним его здесь, чтобы управлять видимостью и жизненным циклом
     SecondWindow* secondWindow;
+
+    // Фоновая подготовка схемы (Db::prepareSchema) и текст её ошибки, если была
+    QThread* m_schemaThread {nullptr};
+    std::shared_ptr<QString> m_schemaError;
 };
 
 #endif // MAINWINDOW_H
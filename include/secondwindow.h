@@ -8,8 +8,14 @@
 // Подключаем базовый класс для создания окон в Qt
 #include <QMainWindow>
 #include "INodeRepository.h"
-#include <map>
+#include <atomic>
 class QSqlDatabase;
+class BackgroundBatchRunner;
+class QLineEdit;
+class QThread;
+class ChildPageCache;
+class ChildPrefetcher;
+struct IntegrityReport;
 
 class QTreeWidgetItem;
 class QString;
@@ -38,15 +44,15 @@ public:
     bool addItemToTreeWidget(QTreeWidgetItem *parent, const QString &text);
     bool removeItemFromTreeWidget(QTreeWidgetItem *item);
 
-    // Рекурсивная функция для заполнения map дерева
-    void fillTreeMapRecursive(qint64 nodeId, std::map<qint64, RepoRow>& tree);
-
     // Конструктор класса
     // explicit - запрещает неявное преобразование типов
     // QWidget* parent = nullptr - родительский виджет (для управления памятью)
     // По умолчанию nullptr - окно будет независимым
     explicit SecondWindow(QWidget* parent = nullptr);
 
+    // Файл БД дерева; MainWindow готовит его схему в фоне до создания окна
+    static QString databaseFile();
+
     // Деструктор - освобождает память при удалении окна
     // override - указывает, что мы переопределяем виртуальный метод базового класса
     ~SecondWindow() override;
@@ -63,6 +69,31 @@ private slots:
     // Этот слот будет вызываться при нажатии кнопки "Назад"
     void onBackButtonClicked();
 
+    // Отчёт о дедупликации payload для текущего файла БД
+    void onPayloadReport();
+
+    // Отметки фаз запуска (StartupProfiler)
+    void onStartupReport();
+
+    // Снимок статистики запросов репозитория в JSON-файл
+    void onDumpQueryStats();
+
+    // Трасса (Trace) в Chrome trace_event JSON — открывается в Perfetto / chrome://tracing
+    void onSaveTrace();
+
+    // Запись нагрузки для tree_replay: снимок БД + журнал вызовов сервиса до выключения
+    void onToggleWorkloadRecording(bool on);
+
+    // Резервная копия в выбранный файл / интервал снимков по расписанию
+    void onBackupNow();
+    void onBackupSchedule();
+
+    // Полная проверка целостности дерева (с индексами) и отчёт в диалоге
+    void onIntegrityCheck();
+
+    // Переход по строке навигации: путь "a/b/c" или "#id"
+    void onJumpToPath();
+
 
 private:
     // Указатель на UI-класс, автоматически генерируемый из .ui файла
@@ -76,12 +107,60 @@ private:
     std::unique_ptr<class INodeRepository> m_repo;
     std::unique_ptr<class INodeFactory> m_factory;
     QSqlDatabase *m_db {nullptr};
+    // Параметры хранения payload (appRepoOptions): фоновый перенос в общее хранилище, заголовок журнала нагрузки
+    RepoOptions m_storageOptions;
+    BackgroundBatchRunner *m_batchRunner {nullptr};
+    // Фоновые миграции данных (перезапись строк порциями), прогресс — в строке состояния
+    std::unique_ptr<class DataMigrationRunner> m_dataMigrations;
+    QLineEdit *m_pathEdit {nullptr};  // строка навигации (путь выбранного узла / ввод пути для перехода)
 
-    std::map<qint64, RepoRow> m_treeMap;
+    // Фоновая предвыборка детей: общий кеш и рабочий поток со своим соединением только для чтения
+    std::shared_ptr<ChildPageCache> m_pageCache;
+    // Задержки методов репозитория и медленные запросы (строка состояния, выгрузка в JSON)
+    std::shared_ptr<class QueryStats> m_queryStats;
+    // Журнал нагрузки (пока идёт запись) и пункт меню, который её включает
+    std::shared_ptr<class WorkloadRecorder> m_workloadRecorder;
+    QAction *m_recordWorkloadAct {nullptr};
+    QThread *m_prefetchThread {nullptr};
+    ChildPrefetcher *m_prefetcher {nullptr};
+    void setupPrefetch();
+    void stopPrefetch();
 
-public:
-    const std::map<qint64, RepoRow>& getTreeMap() const { return m_treeMap; }
-    void resetTreeMap();
+    // Резервное копирование в рабочем потоке (BackupJob); снимки по расписанию — в <папка БД>/backups
+    // с ротацией. Одновременно идёт не больше одной копии.
+    QThread *m_backupThread {nullptr};
+    class BackupJob *m_backupJob {nullptr};
+    QAction *m_backupAct {nullptr};
+    bool m_backupScheduled {false};
+    QString m_backupStatus; // для строки состояния; пусто — копии нет
+    void setupBackupSchedule();
+    void checkBackupSchedule();
+    void startBackup(const QString &targetPath, bool scheduled);
+    void stopBackup();
+    void onBackupFinished(bool ok, const QString &targetPath, const QString &error);
+
+    // Проверка целостности (IntegrityChecker) в рабочем потоке со своим соединением. После запуска —
+    // облегчённая проверка без индексов, с записью в журнал; из меню — полная, с диалогом.
+    QThread *m_integrityThread {nullptr};
+    std::shared_ptr<std::atomic<bool>> m_integrityCancel;
+    QAction *m_integrityAct {nullptr};
+    void startIntegrityCheck(bool interactive);
+    void stopIntegrityCheck();
+    void onIntegrityFinished(const IntegrityReport &report, const QString &error, bool interactive);
+
+    // Панель навигации над деревом: ввод пути или id и «хлебные крошки» выбранного узла
+    void setupNavigationBar();
+
+    // Раскрытые/выделенные узлы сохраняются в QSettings отдельно для каждого файла БД
+    void saveTreeState();
+    void restoreTreeState();
+
+    // Постоянная метка строки состояния с числом живых элементов дерева
+    void setupStatusMetrics();
+
+    // Регистрирует фоновые задачи: обслуживание payload (перенос, сжатие, сборка мусора)
+    // и ключей ручного порядка (выдача старым строкам, перебалансировка)
+    void setupBackgroundTasks();
 };
 
 #endif // SECONDWINDOW_H
@@ -7,8 +7,16 @@
 #include <QMenu>
 #include <QHash>
 #include <QTreeWidgetItem>
+#include <QElapsedTimer>
+#include <QCache>
+#include <vector>
+#include <memory>
+#include "Node.h"
 
 class TreeService;
+class QTimer;
+class ChildPageCache;
+class ChildPrefetcher;
 class TreeWidgetEx;
 
 // Связывает QTreeWidget и TreeService: ленивая подгрузка, контекстное меню, rename, add, delete
@@ -19,15 +27,58 @@ public:
 
     void initialize(); // Подписка на сигналы и начальная загрузка root-детей
 
+    // Загружает и раскрывает поддерево узла на depth уровней (< 0 — целиком) одним запросом.
+    // Элементы строятся вне виджета и вставляются одной пачкой; при большом поддереве — запрос подтверждения.
+    void expandSubtree(qint64 id, int depth = -1);
+
+    // Показывает узел: цепочка предков — одним запросом, у каждого промежуточного родителя
+    // загружается только окно детей вокруг нужного (остальное — элементы «… ещё»).
+    // Цель выделяется и прокручивается в видимую область. false — узел не найден.
+    bool revealNode(qint64 id);
+
+    // Состояние дерева для сохранения между запусками: раскрытые и выделенные узлы
+    QList<qint64> expandedIds() const;
+    QList<qint64> selectedIds() const;
+
+    // Перестраивает дерево за один проход: дети корня и всех expanded читаются одним запросом
+    // (parent_id IN (...)), элементы собираются вне виджета. Узлы, удалённые с прошлого запуска
+    // или ставшие недостижимыми, молча пропускаются.
+    void restoreState(const QList<qint64> &expanded, const QList<qint64> &selected);
+
+    // Выгрузка свёрнутых веток: дети узла, свёрнутого дольше collapsedMs, удаляются из виджета
+    // (возвращается плейсхолдер); при числе элементов больше itemBudget — начиная с давно свёрнутых,
+    // не дожидаясь срока.
+    void setUnloadPolicy(qint64 collapsedMs, int itemBudget);
+
+    // Фоновая предвыборка: loadChildrenInto сначала смотрит в cache; подсказки (наведение, соседи
+    // раскрытых, история раскрытий) уходят в prefetcher. Без вызова предвыборка выключена.
+    void setPrefetch(std::shared_ptr<ChildPageCache> cache, ChildPrefetcher *prefetcher);
+    void hintPrefetch(const std::vector<qint64> &ids);
+
+    // Недавно раскрытые узлы (свежие первыми) — для сохранения и подсказок предвыборки
+    QList<qint64> expandHistory() const { return m_expandHistory; }
+    void setExpandHistory(const QList<qint64> &ids);
+
+    // Сбрасывает кеш колонок payload: после записи в дерево (id могут переиспользоваться после удаления)
+    // и при возврате в приложение (правки из treectl); видимые строки перечитываются одним запросом
+    void clearPayloadColumns();
+
+    // Число живых элементов узлов в виджете (= размер m_idToItem)
+    int liveItemCount() const { return int(m_idToItem.size()); }
+
     signals:
     void itemClicked(qint64 id);
 
 private slots:
     void onItemExpanded(QTreeWidgetItem *item);
+    void onItemCollapsed(QTreeWidgetItem *item);
+    void unloadCollapsed();
+    void refreshVisibleColumns();
+    void onItemEntered(QTreeWidgetItem *item, int column);
     void onItemChanged(QTreeWidgetItem *item, int column);
     void onCustomContextMenuRequested(const QPoint &pos);
     void onItemClicked(QTreeWidgetItem *item, int column);
-    void onRequestMove(qint64 nodeId, qint64 newParentId, bool &accepted);
+    void onRequestMove(const QList<QTreeWidgetItem*> &items, QTreeWidgetItem *newParentItem, int row, bool &accepted);
 
 private:
     QPointer<TreeWidgetEx> m_tree;
@@ -36,10 +87,45 @@ private:
     // id->item и item->id загружаем через Qt::UserRole, а map держим для быстрых обращений
     QHash<qint64, QTreeWidgetItem*> m_idToItem;
 
+    // Когда узел свернули (мс по m_clock); запись удаляется при раскрытии и при выгрузке/удалении элемента
+    QHash<qint64, qint64> m_collapsedAt;
+    QElapsedTimer m_clock;
+    QTimer *m_unloadTimer {nullptr};
+    qint64 m_unloadAfterMs;
+    int m_itemBudget;
+
+    // Колонки из payload (diameter/length/holder): читаются только для видимых строк и экрана вперёд,
+    // одним запросом на прокрутку/перерисовку; разобранные значения — в LRU-кеше
+    struct PayloadColumns { QString diameter; QString length; QString holder; };
+    QCache<qint64, PayloadColumns> m_columnCache;
+    QTimer *m_columnsTimer {nullptr};
+    void scheduleColumnsRefresh();
+
+    std::shared_ptr<ChildPageCache> m_pageCache;
+    ChildPrefetcher *m_prefetcher {nullptr}; // не владеем (живёт в своём потоке)
+    QList<qint64> m_expandHistory;
+    void rememberExpanded(qint64 id);
+    // Соседи раскрытого элемента с нераскрытыми детьми — вероятные следующие раскрытия
+    void hintSiblings(QTreeWidgetItem *item);
+
+    // Удаляет загруженных детей элемента и возвращает плейсхолдер
+    void unloadChildren(QTreeWidgetItem *item);
+
     void loadChildrenInto(QTreeWidgetItem *parentItem, qint64 parentId);
     void addPlaceholderIfNeeded(QTreeWidgetItem *item, bool hasChildren);
+    // Окно детей вокруг anchorId с элементами «… ещё» выше/ниже; подгрузка — щелчком по ним
+    void loadWindowInto(QTreeWidgetItem *container, qint64 parentId, qint64 anchorId);
+    void loadStub(QTreeWidgetItem *stub);
+    QList<QTreeWidgetItem*> makeNodeItems(const std::vector<NodeDTO> &nodes, size_t count);
     bool isPlaceholder(QTreeWidgetItem *item) const;
     void createChild(QTreeWidgetItem *parentItem);
     void renameItem(QTreeWidgetItem *item);
     void deleteItem(QTreeWidgetItem *item);
+    void deleteItems(const QList<QTreeWidgetItem*> &items);
+    void attachFile(QTreeWidgetItem *item);
+    void saveAttachment(QTreeWidgetItem *item);
+    void refreshAttachmentInfo(QTreeWidgetItem *item);
+
+    // Убирает из m_idToItem (и m_collapsedAt) элемент и всех его потомков (перед удалением/выгрузкой элементов)
+    void forgetSubtree(QTreeWidgetItem *item);
 };
@@ -0,0 +1,15 @@
+// AppRepoOptions.cpp — чтение настроек хранения payload из QSettings
+#include "AppRepoOptions.h"
+
+#include <QSettings>
+
+// Payload от 4 КиБ хранятся сжатыми
+static constexpr int DEFAULT_COMPRESS_THRESHOLD = 4096;
+
+RepoOptions appRepoOptions() {
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "qt_mill", "tree");
+    RepoOptions options;
+    options.dedupPayloads = settings.value("storage/dedupPayloads", true).toBool();
+    options.compressThreshold = settings.value("storage/compressThreshold", DEFAULT_COMPRESS_THRESHOLD).toInt();
+    return options;
+}
@@ -0,0 +1,61 @@
+// BackgroundBatchRunner.cpp — круговой запуск порций фоновых задач по таймеру
+#include "BackgroundBatchRunner.h"
+
+#include <QDebug>
+#include <exception>
+
+static constexpr int DEFAULT_TICK_MS = 50;
+
+BackgroundBatchRunner::BackgroundBatchRunner(QObject *parent)
+    : QObject(parent) {
+    m_timer.setInterval(DEFAULT_TICK_MS);
+    connect(&m_timer, &QTimer::timeout, this, &BackgroundBatchRunner::onTick);
+    m_clock.start();
+}
+
+void BackgroundBatchRunner::addTask(const QString &name, Step step, int repeatMs) {
+    Task t;
+    t.name = name;
+    t.step = std::move(step);
+    t.repeatMs = repeatMs;
+    m_tasks.push_back(std::move(t));
+}
+
+void BackgroundBatchRunner::setTickInterval(int ms) {
+    m_timer.setInterval(ms);
+}
+
+void BackgroundBatchRunner::start() {
+    m_timer.start();
+}
+
+void BackgroundBatchRunner::stop() {
+    m_timer.stop();
+}
+
+void BackgroundBatchRunner::onTick() {
+    const qint64 now = m_clock.elapsed();
+    // Ищем следующую готовую задачу по кругу; за тик выполняется ровно одна порция
+    for (size_t i = 0; i < m_tasks.size(); ++i) {
+        Task &t = m_tasks[(m_next + i) % m_tasks.size()];
+        if (t.finished || t.nextRunMs > now) continue;
+        m_next = (m_next + i + 1) % m_tasks.size();
+
+        bool more = false;
+        try {
+            more = t.step();
+        } catch (const std::exception &ex) {
+            qWarning() << "background task" << t.name << "failed:" << ex.what();
+            emit taskFailed(t.name, QString::fromUtf8(ex.what()));
+        }
+        if (!more) {
+            if (t.repeatMs > 0) {
+                t.nextRunMs = now + t.repeatMs;
+            } else {
+                t.finished = true;
+                emit taskFinished(t.name);
+            }
+        }
+        return;
+    }
+}
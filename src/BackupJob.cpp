@@ -0,0 +1,59 @@
+// BackupJob.cpp — шаги OnlineBackup по таймеру рабочего потока
+#include "BackupJob.h"
+
+#include <QTimer>
+#include <exception>
+
+// Пауза между шагами: запись UI получает соединение и диск между порциями копии
+static constexpr int BACKUP_TICK_MS = 15;
+// Прогресс — не на каждом шаге
+static constexpr int PROGRESS_EVERY_TICKS = 10;
+
+BackupJob::BackupJob(const QString &dbPath, const QString &targetPath, std::function<bool()> foregroundBusy)
+    : m_dbPath(dbPath), m_targetPath(targetPath), m_foregroundBusy(std::move(foregroundBusy)) {}
+
+BackupJob::~BackupJob() = default;
+
+void BackupJob::start() {
+    m_backup = std::make_unique<OnlineBackup>(m_dbPath, m_targetPath);
+    try {
+        m_backup->begin();
+    } catch (const std::exception &ex) {
+        fail(QString::fromUtf8(ex.what()));
+        return;
+    }
+    m_timer = new QTimer(this);
+    m_timer->setInterval(BACKUP_TICK_MS);
+    connect(m_timer, &QTimer::timeout, this, &BackupJob::onTick);
+    m_timer->start();
+}
+
+void BackupJob::cancel() {
+    if (m_timer) m_timer->stop();
+    // Соединение копии закрывается в этом же потоке
+    m_backup.reset();
+}
+
+void BackupJob::onTick() {
+    if (!m_backup) return;
+    if (m_foregroundBusy && m_foregroundBusy()) return;
+    bool more = false;
+    try {
+        more = m_backup->step();
+    } catch (const std::exception &ex) {
+        fail(QString::fromUtf8(ex.what()));
+        return;
+    }
+    if (more && ++m_ticks % PROGRESS_EVERY_TICKS != 0) return;
+    emit progress(m_backup->progress());
+    if (more) return;
+    m_timer->stop();
+    m_backup.reset();
+    emit finished(true, m_targetPath, QString());
+}
+
+void BackupJob::fail(const QString &error) {
+    if (m_timer) m_timer->stop();
+    m_backup.reset();
+    emit finished(false, m_targetPath, error);
+}
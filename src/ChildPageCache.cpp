@@ -0,0 +1,71 @@
+// ChildPageCache.cpp — LRU под мьютексом, поколения для защиты от устаревших списков
+#include "ChildPageCache.h"
+
+ChildPageCache::ChildPageCache(size_t capacity)
+    : m_capacity(capacity) {
+    m_clock.start();
+}
+
+std::optional<std::vector<NodeDTO>> ChildPageCache::take(qint64 parentId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.lookups;
+    auto it = m_entries.find(parentId);
+    if (it == m_entries.end()) return std::nullopt;
+    ++m_stats.hits;
+    std::vector<NodeDTO> children = std::move(it->second.children);
+    m_lru.erase(it->second.lruPos);
+    m_entries.erase(it);
+    return children;
+}
+
+bool ChildPageCache::contains(qint64 parentId) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.find(parentId) != m_entries.end();
+}
+
+quint64 ChildPageCache::generation() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_generation;
+}
+
+bool ChildPageCache::put(qint64 parentId, std::vector<NodeDTO> children, quint64 generation) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (generation != m_generation) return false;
+    auto it = m_entries.find(parentId);
+    if (it != m_entries.end()) {
+        m_lru.erase(it->second.lruPos);
+        m_entries.erase(it);
+    }
+    m_lru.push_front(parentId);
+    m_entries.emplace(parentId, Entry{ std::move(children), m_lru.begin() });
+    ++m_stats.prefetched;
+    while (m_entries.size() > m_capacity) {
+        m_entries.erase(m_lru.back());
+        m_lru.pop_back();
+        ++m_stats.wasted;
+    }
+    return true;
+}
+
+void ChildPageCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_generation;
+    m_stats.wasted += qint64(m_entries.size());
+    m_entries.clear();
+    m_lru.clear();
+}
+
+void ChildPageCache::noteForegroundActivity() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lastForegroundMs = m_clock.elapsed();
+}
+
+qint64 ChildPageCache::msSinceForegroundActivity() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_clock.elapsed() - m_lastForegroundMs;
+}
+
+ChildPageCache::Stats ChildPageCache::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
@@ -0,0 +1,90 @@
+// ChildPrefetcher.cpp — очередь подсказок, фоновое соединение и троттлинг предвыборки
+#include "ChildPrefetcher.h"
+#include "ChildPageCache.h"
+#include "Db.h"
+#include "INodeFactory.h"
+#include "INodeRepository.h"
+#include "IAttachmentRepository.h"
+#include "TreeService.h"
+#include "Trace.h"
+
+#include <QtSql/QSqlDatabase>
+#include <QTimer>
+#include <QDebug>
+#include <algorithm>
+
+// Одна подсказка за тик
+static constexpr int PREFETCH_TICK_MS = 30;
+// Столько тишины на переднем плане нужно, чтобы предвыборка заняла соединение
+static constexpr qint64 FOREGROUND_QUIET_MS = 150;
+// Длина очереди подсказок
+static constexpr size_t MAX_QUEUE = 64;
+
+ChildPrefetcher::ChildPrefetcher(const QString &dbPath, std::shared_ptr<ChildPageCache> cache)
+    : m_dbPath(dbPath), m_connectionName("prefetch_conn"), m_cache(std::move(cache)) {}
+
+ChildPrefetcher::~ChildPrefetcher() = default;
+
+void ChildPrefetcher::hint(const std::vector<qint64> &parentIds) {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    // В обратном порядке: первая подсказка окажется в начале очереди
+    for (auto it = parentIds.rbegin(); it != parentIds.rend(); ++it) {
+        const auto old = std::find(m_queue.begin(), m_queue.end(), *it);
+        if (old != m_queue.end()) m_queue.erase(old);
+        m_queue.push_front(*it);
+    }
+    while (m_queue.size() > MAX_QUEUE) m_queue.pop_back();
+}
+
+void ChildPrefetcher::start() {
+    Trace::setThreadName("prefetch");
+    try {
+        const QString conn = Db::openConnection(m_connectionName, m_dbPath, true);
+        QSqlDatabase db = QSqlDatabase::database(conn);
+        m_service = std::make_unique<TreeService>(makeSqliteNodeRepository(db), makeNodeFactory());
+        m_service->setAttachmentRepository(makeSqliteAttachmentRepository(db));
+    } catch (const std::exception &ex) {
+        qWarning() << "Prefetcher disabled:" << ex.what();
+        return;
+    }
+    m_timer = new QTimer(this);
+    m_timer->setInterval(PREFETCH_TICK_MS);
+    connect(m_timer, &QTimer::timeout, this, &ChildPrefetcher::onTick);
+    m_timer->start();
+}
+
+void ChildPrefetcher::stop() {
+    if (m_timer) m_timer->stop();
+    // Сервис держит копии QSqlDatabase — освобождаем до removeDatabase
+    m_service.reset();
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+        if (db.isValid()) db.close();
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+void ChildPrefetcher::onTick() {
+    if (!m_service) return;
+    // Передний план важнее: не конкурируем с запросами UI
+    if (m_cache->msSinceForegroundActivity() < FOREGROUND_QUIET_MS) return;
+
+    qint64 parentId = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        if (m_queue.empty()) return;
+        parentId = m_queue.front();
+        m_queue.pop_front();
+    }
+    if (m_cache->contains(parentId)) return;
+
+    // Span только на реальную загрузку: пустые тики таймера не забивают кольцевой буфер
+    TRACE_SPAN("prefetch", "prefetchChildren");
+    const quint64 generation = m_cache->generation();
+    try {
+        auto children = m_service->listChildren(parentId, SIZE_MAX, 0, ChildOrder::Manual);
+        m_cache->put(parentId, std::move(children), generation);
+    } catch (const std::exception &ex) {
+        qWarning() << "Prefetch failed for" << parentId << ":" << ex.what();
+    }
+}
@@ -0,0 +1,119 @@
+// DataMigrations.cpp — список миграций данных, keyset-порции и курсоры в data_migrations
+#include "DataMigrations.h"
+#include "Errors.h"
+
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QVariant>
+#include <QDateTime>
+
+namespace {
+
+// Миграция данных: UPDATE одной таблицы по диапазону id (два параметра: id > ? AND id <= ?).
+// UPDATE должен быть идемпотентным — порция может повториться после сбоя до фиксации курсора.
+struct DataMigration {
+    const char *name;
+    const char *table;
+    const char *updateRangeSql;
+};
+
+// Порядок выполнения — порядок в списке. Сейчас список пуст: запись пишет строки сразу в текущем
+// формате. Новая миграция добавляется сюда вместе с шагом схемы, который вводит её колонки, и только
+// когда новые колонки кто-то читает.
+const std::vector<DataMigration> DATA_MIGRATIONS = {};
+
+}
+
+DataMigrationRunner::DataMigrationRunner(QSqlDatabase db)
+    : m_db(std::move(db)) {}
+
+DataMigrationProgress DataMigrationRunner::load(const QString &name) const {
+    DataMigrationProgress p;
+    p.name = name;
+    QSqlQuery q(m_db);
+    q.prepare("SELECT last_id, target_id, processed, done FROM data_migrations WHERE name = ?");
+    q.addBindValue(name);
+    if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+    if (q.next()) {
+        p.lastId = q.value(0).toLongLong();
+        p.targetId = q.value(1).toLongLong();
+        p.processed = q.value(2).toLongLong();
+        p.done = q.value(3).toInt() != 0;
+    }
+    return p;
+}
+
+void DataMigrationRunner::save(const DataMigrationProgress &p) {
+    QSqlQuery q(m_db);
+    q.prepare("INSERT OR REPLACE INTO data_migrations(name, last_id, target_id, processed, done, updated_ms) "
+              "VALUES(?, ?, ?, ?, ?, ?)");
+    q.addBindValue(p.name);
+    q.addBindValue(p.lastId);
+    q.addBindValue(p.targetId);
+    q.addBindValue(p.processed);
+    q.addBindValue(p.done ? 1 : 0);
+    q.addBindValue(QDateTime::currentMSecsSinceEpoch());
+    if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+}
+
+bool DataMigrationRunner::step(int limit) {
+    for (const DataMigration &m : DATA_MIGRATIONS) {
+        DataMigrationProgress p = load(m.name);
+        if (p.done) continue;
+
+        if (!m_db.transaction()) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        try {
+            if (p.targetId == 0) {
+                // Граница фиксируется при первом запуске: строки новее пишутся уже в новом формате
+                QSqlQuery maxQ(m_db);
+                if (!maxQ.exec(QString("SELECT COALESCE(MAX(id), 0) FROM %1").arg(m.table)) || !maxQ.next()) {
+                    throw Errors::DbError(maxQ.lastError().text().toStdString());
+                }
+                p.targetId = maxQ.value(0).toLongLong();
+            }
+
+            // Граница порции по первичному ключу: LIMIT по индексу, без сканирования хвоста
+            QSqlQuery range(m_db);
+            range.prepare(QString("SELECT MAX(id), COUNT(*) FROM "
+                                  "(SELECT id FROM %1 WHERE id > ? AND id <= ? ORDER BY id LIMIT ?)").arg(m.table));
+            range.addBindValue(p.lastId);
+            range.addBindValue(p.targetId);
+            range.addBindValue(limit);
+            if (!range.exec() || !range.next()) {
+                throw Errors::DbError(range.lastError().text().toStdString());
+            }
+            const qint64 count = range.value(1).toLongLong();
+            if (count == 0) {
+                p.done = true;
+            } else {
+                const qint64 batchMax = range.value(0).toLongLong();
+                QSqlQuery upd(m_db);
+                upd.prepare(m.updateRangeSql);
+                upd.addBindValue(p.lastId);
+                upd.addBindValue(batchMax);
+                if (!upd.exec()) throw Errors::DbError(upd.lastError().text().toStdString());
+                p.lastId = batchMax;
+                p.processed += count;
+            }
+            save(p);
+        } catch (...) {
+            m_db.rollback();
+            throw;
+        }
+        if (!m_db.commit()) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        return true;
+    }
+    return false;
+}
+
+std::vector<DataMigrationProgress> DataMigrationRunner::progress() const {
+    std::vector<DataMigrationProgress> out;
+    for (const DataMigration &m : DATA_MIGRATIONS) {
+        out.push_back(load(m.name));
+    }
+    return out;
+}
@@ -7,6 +7,9 @@
 #include <QtSql/QSqlError>
 #include <QVariant>
 #include <QDateTime>
+#include <QFile>
+#include <QThread>
+#include <iterator>
 
 namespace {
 void execOrThrow(QSqlDatabase &db, const QString &sql) {
@@ -20,7 +23,32 @@ void enableForeignKeys(QSqlDatabase &db) {
     execOrThrow(db, "PRAGMA foreign_keys = ON");
 }
 
-void applyMigrations(QSqlDatabase &db) {
+// Ожидание занятой БД вместо немедленной ошибки SQLITE_BUSY (несколько соединений)
+void setBusyTimeout(QSqlDatabase &db) {
+    execOrThrow(db, "PRAGMA busy_timeout = 5000");
+}
+
+// SQLite не умеет ADD COLUMN IF NOT EXISTS — проверяем наличие колонки через table_info
+bool hasColumn(QSqlDatabase &db, const QString &table, const QString &column) {
+    QSqlQuery q(db);
+    if (!q.exec(QString("PRAGMA table_info(%1)").arg(table))) {
+        throw Errors::DbError(q.lastError().text().toStdString());
+    }
+    while (q.next()) {
+        if (q.value(1).toString() == column) return true;
+    }
+    return false;
+}
+
+void ensureColumn(QSqlDatabase &db, const QString &table, const QString &column, const QString &decl) {
+    if (!hasColumn(db, table, column)) {
+        execOrThrow(db, QString("ALTER TABLE %1 ADD COLUMN %2 %3").arg(table, column, decl));
+    }
+}
+
+// Версия 1 — базовая схема. Шаги идемпотентны: файлы, созданные до появления версий
+// (user_version = 0), уже содержат часть объектов.
+void migrateBaseline(QSqlDatabase &db) {
     const QString createNodes = R"SQL(
 CREATE TABLE IF NOT EXISTS nodes (
     id INTEGER PRIMARY KEY,
@@ -33,8 +61,135 @@ CREATE TABLE IF NOT EXISTS nodes (
     execOrThrow(db, createNodes);
     execOrThrow(db, "CREATE UNIQUE INDEX IF NOT EXISTS idx_nodes_parent_name ON nodes(parent_id, name)");
     execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_parent ON nodes(parent_id)");
+
+    // Контентно-адресуемое хранилище payload: одинаковые тексты хранятся один раз,
+    // строка nodes держит только ссылку payload_hash (SHA-256 hex от UTF-8).
+    const QString createPayloads = R"SQL(
+CREATE TABLE IF NOT EXISTS payloads (
+    hash TEXT PRIMARY KEY,
+    data TEXT NOT NULL
+);)SQL";
+    execOrThrow(db, createPayloads);
+    ensureColumn(db, "nodes", "payload_hash", "TEXT NULL");
+    // Частичный индекс для проверки ссылок при сборке мусора
+    execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_payload_hash ON nodes(payload_hash) WHERE payload_hash IS NOT NULL");
+
+    // Сжатые payload: payload_blob + тег формата (0 — текст в payload, 1 — qCompress(UTF-8) в payload_blob).
+    // В payloads для сжатых записей data = '' (колонка исторически NOT NULL), текст лежит в packed.
+    ensureColumn(db, "nodes", "payload_blob", "BLOB NULL");
+    ensureColumn(db, "nodes", "payload_format", "INTEGER NOT NULL DEFAULT 0");
+    ensureColumn(db, "payloads", "packed", "BLOB NULL");
+    ensureColumn(db, "payloads", "format", "INTEGER NOT NULL DEFAULT 0");
+
+    // Вложения узлов: метаданные отдельно от содержимого, содержимое — порциями фиксированного размера
+    const QString createAttachments = R"SQL(
+CREATE TABLE IF NOT EXISTS attachments (
+    id INTEGER PRIMARY KEY,
+    node_id INTEGER NOT NULL REFERENCES nodes(id) ON DELETE CASCADE,
+    name TEXT NOT NULL,
+    size INTEGER NOT NULL DEFAULT 0,
+    sha256 TEXT NULL,
+    chunk_size INTEGER NOT NULL,
+    created_at TEXT NOT NULL
+);)SQL";
+    execOrThrow(db, createAttachments);
+    execOrThrow(db, "CREATE UNIQUE INDEX IF NOT EXISTS idx_attachments_node_name ON attachments(node_id, name)");
+    const QString createChunks = R"SQL(
+CREATE TABLE IF NOT EXISTS attachment_chunks (
+    attachment_id INTEGER NOT NULL REFERENCES attachments(id) ON DELETE CASCADE,
+    seq INTEGER NOT NULL,
+    data BLOB NOT NULL,
+    PRIMARY KEY (attachment_id, seq)
+);)SQL";
+    execOrThrow(db, createChunks);
+
+    // Ручной порядок сиблингов: дробные ключи (см. SortKey). NULL — узел ещё без ключа,
+    // такие идут первыми по имени. Индекс покрывает выборку страницы детей в ручном порядке.
+    ensureColumn(db, "nodes", "sort_key", "TEXT NULL");
+    execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_parent_sort ON nodes(parent_id, sort_key, name)");
+
+    // Производные ключи имени (см. NameKeys): поиск без учёта регистра и натуральная сортировка по индексу.
+    // Старые строки получают ключи фоновой порционной задачей; частичный индекс находит их без полного обхода.
+    ensureColumn(db, "nodes", "name_fold", "TEXT NULL");
+    ensureColumn(db, "nodes", "name_natural", "TEXT NULL");
+    execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_parent_fold ON nodes(parent_id, name_fold, name)");
+    execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_parent_natural ON nodes(parent_id, name_natural, name)");
+    execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_name_keys_missing ON nodes(id) WHERE name_fold IS NULL");
+}
+
+// Версия 2 — метки времени в epoch-ms (INTEGER) рядом с историческими ISO-строками.
+// Схема меняется мгновенно (ADD COLUMN без перезаписи строк); значения у старых строк
+// заполняла фоновая миграция данных с прогрессом в data_migrations. Колонки никто не читал, поэтому
+// запись в них и миграция сняты; сами колонки остаются (шаг уже применён к существующим файлам).
+void migrateEpochMs(QSqlDatabase &db) {
+    ensureColumn(db, "nodes", "created_ms", "INTEGER NULL");
+    ensureColumn(db, "nodes", "updated_ms", "INTEGER NULL");
+    const QString createDataMigrations = R"SQL(
+CREATE TABLE IF NOT EXISTS data_migrations (
+    name TEXT PRIMARY KEY,
+    last_id INTEGER NOT NULL DEFAULT 0,
+    target_id INTEGER NOT NULL DEFAULT 0,
+    processed INTEGER NOT NULL DEFAULT 0,
+    done INTEGER NOT NULL DEFAULT 0,
+    updated_ms INTEGER NOT NULL DEFAULT 0
+);)SQL";
+    execOrThrow(db, createDataMigrations);
+}
+
+// Версия 3 — текст общего хранилища освобождается вместе с последним узлом, который на него ссылался.
+// Триггер срабатывает и на строки, удалённые каскадом (поддерево), поэтому после удаления ветки
+// не остаётся сирот до фоновой сборки мусора. Поиск ссылок — по частичному индексу idx_nodes_payload_hash.
+void migratePayloadRelease(QSqlDatabase &db) {
+    const QString createTrigger = R"SQL(
+CREATE TRIGGER IF NOT EXISTS trg_nodes_payload_release AFTER DELETE ON nodes
+WHEN OLD.payload_hash IS NOT NULL
+BEGIN
+    DELETE FROM payloads WHERE hash = OLD.payload_hash
+        AND NOT EXISTS (SELECT 1 FROM nodes WHERE payload_hash = OLD.payload_hash);
+END;)SQL";
+    execOrThrow(db, createTrigger);
+}
+
+// Версия 4 — частичный индекс строк с inline-payload: фоновый перенос в общее хранилище
+// (dedupInlinePayloads) берёт очередную порцию по нему, а не полным обходом nodes на каждом шаге.
+void migrateInlinePayloadIndex(QSqlDatabase &db) {
+    execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_inline_payload ON nodes(id) "
+                    "WHERE payload IS NOT NULL OR payload_blob IS NOT NULL");
+}
+
+// Версия 5 — индексы ключей имени покрывают колонки выборки детей (SELECT_META: id, parent_id, name,
+// sort_key): страница в порядке CaseInsensitive/Natural читается из индекса без обращения к строкам.
+void migrateCoveringNameKeyIndexes(QSqlDatabase &db) {
+    execOrThrow(db, "DROP INDEX IF EXISTS idx_nodes_parent_fold");
+    execOrThrow(db, "DROP INDEX IF EXISTS idx_nodes_parent_natural");
+    execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_parent_fold ON nodes(parent_id, name_fold, name, sort_key)");
+    execOrThrow(db, "CREATE INDEX IF NOT EXISTS idx_nodes_parent_natural ON nodes(parent_id, name_natural, name, sort_key)");
+}
+
+// Версия 6 — нижняя граница новых id диапазона файла (RepoOptions::idBase/idSpan, шарды). Узел, ушедший
+// в другой файл, поднимает границу в той же транзакции, что удаляет его здесь: MAX(id) + 1 не выдаст его id
+// повторно, сколько бы экземпляров ни писали в файл.
+void migrateIdFloors(QSqlDatabase &db) {
+    execOrThrow(db, "CREATE TABLE IF NOT EXISTS id_floors (base INTEGER PRIMARY KEY, floor INTEGER NOT NULL)");
 }
 
+struct SchemaStep {
+    int version;
+    void (*apply)(QSqlDatabase &);
+};
+
+// Шаги по возрастанию версии; последний совпадает с Db::SCHEMA_VERSION.
+// Новые изменения схемы — только новым шагом в конце, существующие не редактируются.
+const SchemaStep SCHEMA_STEPS[] = {
+    {1, migrateBaseline},
+    {2, migrateEpochMs},
+    {3, migratePayloadRelease},
+    {4, migrateInlinePayloadIndex},
+    {5, migrateCoveringNameKeyIndexes},
+    {6, migrateIdFloors},
+};
+static_assert(std::size(SCHEMA_STEPS) == Db::SCHEMA_VERSION, "SCHEMA_STEPS must end at Db::SCHEMA_VERSION");
+
 void ensureRoot(QSqlDatabase &db) {
     QSqlQuery check(db);
     check.prepare("SELECT id FROM nodes WHERE id = 1");
@@ -42,16 +197,66 @@ void ensureRoot(QSqlDatabase &db) {
         throw Errors::DbError(check.lastError().text().toStdString());
     }
     if (!check.next()) {
-        const QString now = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+        const QDateTime now = QDateTime::currentDateTimeUtc();
         QSqlQuery ins(db);
-        ins.prepare("INSERT INTO nodes (id, parent_id, name, payload, created_at, updated_at) VALUES (1, NULL, '', NULL, ?, ?)");
-        ins.addBindValue(now);
-        ins.addBindValue(now);
+        ins.prepare("INSERT INTO nodes (id, parent_id, name, payload, created_at, updated_at) "
+                    "VALUES (1, NULL, '', NULL, ?, ?)");
+        ins.addBindValue(now.toString(Qt::ISODateWithMs));
+        ins.addBindValue(now.toString(Qt::ISODateWithMs));
         if (!ins.exec()) {
             throw Errors::DbError(ins.lastError().text().toStdString());
         }
     }
 }
+
+// Новый (пустой) файл сразу получает auto_vacuum = INCREMENTAL. Прагма действует только до первой
+// таблицы и до перевода в WAL — вызывается перед journal_mode; у старого файла режим меняет только
+// полный VACUUM (DbMaintenance::enableIncrementalVacuum, в фоновом потоке приложения)
+void initNewFileAutoVacuum(QSqlDatabase &db) {
+    QSqlQuery tables(db);
+    if (!tables.exec("SELECT 1 FROM sqlite_master LIMIT 1")) {
+        throw Errors::DbError(tables.lastError().text().toStdString());
+    }
+    const bool empty = !tables.next();
+    tables.finish();
+    if (empty) execOrThrow(db, QString("PRAGMA auto_vacuum = %1").arg(Db::AUTO_VACUUM_INCREMENTAL));
+}
+
+int schemaVersion(QSqlDatabase &db) {
+    QSqlQuery q(db);
+    if (!q.exec("PRAGMA user_version") || !q.next()) {
+        throw Errors::DbError(q.lastError().text().toStdString());
+    }
+    return q.value(0).toInt();
+}
+
+// Применяет шаги новее версии файла. Каждый шаг — отдельная транзакция вместе с записью
+// user_version: прерванная миграция откатывается целиком и повторяется при следующем открытии.
+// Шаги меняют только схему; перезапись строк — порционные миграции данных в фоне.
+void migrateIfNeeded(QSqlDatabase &db) {
+    const int current = schemaVersion(db);
+    if (current == Db::SCHEMA_VERSION) return;
+    if (current > Db::SCHEMA_VERSION) {
+        throw Errors::DbError(QString("Database schema version %1 is newer than supported %2")
+                                  .arg(current).arg(Db::SCHEMA_VERSION).toStdString());
+    }
+    for (const SchemaStep &step : SCHEMA_STEPS) {
+        if (step.version <= current) continue;
+        if (!db.transaction()) {
+            throw Errors::DbError(db.lastError().text().toStdString());
+        }
+        try {
+            step.apply(db);
+            execOrThrow(db, QString("PRAGMA user_version = %1").arg(step.version));
+        } catch (...) {
+            db.rollback();
+            throw;
+        }
+        if (!db.commit()) {
+            throw Errors::DbError(db.lastError().text().toStdString());
+        }
+    }
+}
 }
 
 QString Db::openAndInit(const QString &connectionName, const QString &filePath) {
@@ -69,7 +274,65 @@ QString Db::openAndInit(const QString &connectionName, const QString &filePath)
         }
     }
     enableForeignKeys(db);
-    applyMigrations(db);
+    setBusyTimeout(db);
+    initNewFileAutoVacuum(db);
+    // WAL: фоновые читатели (предвыборка) не блокируют запись и не блокируются ею. Режим хранится в файле.
+    execOrThrow(db, "PRAGMA journal_mode = WAL");
+    migrateIfNeeded(db);
     ensureRoot(db);
     return connectionName;
 }
+
+void Db::prepareSchema(const QString &filePath) {
+    // Имя соединения — своё для каждого потока: запуск и резервная копия могут готовить схему одновременно
+    const QString conn = QString("schema_prepare_conn_%1").arg(quintptr(QThread::currentThreadId()));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", conn);
+        db.setDatabaseName(filePath);
+        try {
+            if (!db.open()) {
+                throw Errors::DbError("Cannot open SQLite DB: " + db.lastError().text().toStdString());
+            }
+            enableForeignKeys(db);
+            setBusyTimeout(db);
+            initNewFileAutoVacuum(db);
+            execOrThrow(db, "PRAGMA journal_mode = WAL");
+            migrateIfNeeded(db);
+            ensureRoot(db);
+        } catch (...) {
+            db.close();
+            db = QSqlDatabase();
+            QSqlDatabase::removeDatabase(conn);
+            throw;
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(conn);
+}
+
+void Db::snapshotTo(const QString &connectionName, const QString &targetPath) {
+    QSqlDatabase db = QSqlDatabase::database(connectionName, false);
+    if (!db.isOpen()) throw Errors::DbError("Snapshot: connection is not open");
+    // VACUUM INTO не перезаписывает существующий файл
+    for (const char *suffix : {"", "-wal", "-shm"}) QFile::remove(targetPath + suffix);
+    QSqlQuery q(db);
+    q.prepare("VACUUM INTO ?");
+    q.addBindValue(targetPath);
+    if (!q.exec()) {
+        throw Errors::DbError("Snapshot failed: " + q.lastError().text().toStdString());
+    }
+}
+
+QString Db::openConnection(const QString &connectionName, const QString &filePath, bool readOnly) {
+    QSqlDatabase db = QSqlDatabase::contains(connectionName)
+        ? QSqlDatabase::database(connectionName, false)
+        : QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(filePath);
+    if (!db.isOpen() && !db.open()) {
+        throw Errors::DbError("Cannot open SQLite DB: " + db.lastError().text().toStdString());
+    }
+    enableForeignKeys(db);
+    setBusyTimeout(db);
+    if (readOnly) execOrThrow(db, "PRAGMA query_only = ON");
+    return connectionName;
+}
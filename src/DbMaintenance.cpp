@@ -0,0 +1,184 @@
+// DbMaintenance.cpp — шаги обслуживания с замером размеров файла до и после
+#include "DbMaintenance.h"
+#include "Db.h"
+#include "Errors.h"
+#include "SqlTransaction.h"
+
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QThread>
+#include <QVariant>
+#include <QDebug>
+
+namespace {
+
+double kib(qint64 bytes) {
+    return double(bytes) / 1024.0;
+}
+
+}
+
+QString MaintenanceReport::toText() const {
+    QString text = QString("maintenance %1: %2 мс, файл %3 → %4 КиБ, WAL %5 → %6 КиБ, страниц %7 → %8 (свободных %9 → %10)")
+                       .arg(step)
+                       .arg(elapsedMs)
+                       .arg(kib(before.fileBytes), 0, 'f', 0)
+                       .arg(kib(after.fileBytes), 0, 'f', 0)
+                       .arg(kib(before.walBytes), 0, 'f', 0)
+                       .arg(kib(after.walBytes), 0, 'f', 0)
+                       .arg(before.pageCount)
+                       .arg(after.pageCount)
+                       .arg(before.freePages)
+                       .arg(after.freePages);
+    if (!detail.isEmpty()) text += ", " + detail;
+    return text;
+}
+
+void logMaintenance(const MaintenanceReport &report) {
+    if (report.performed) qDebug().noquote() << report.toText();
+}
+
+DbMaintenance::DbMaintenance(QSqlDatabase db, MaintenanceOptions options)
+    : m_db(db), m_options(options) {}
+
+MaintenanceReport DbMaintenance::enableIncrementalVacuum(const QString &filePath) {
+    const QString conn = QString("auto_vacuum_conn_%1").arg(quintptr(QThread::currentThreadId()));
+    MaintenanceReport r;
+    r.step = "auto_vacuum";
+    {
+        QSqlDatabase db = QSqlDatabase::database(Db::openConnection(conn, filePath, false), false);
+        try {
+            DbMaintenance self(db);
+            QElapsedTimer timer;
+            timer.start();
+            r.before = self.stats();
+            r.after = r.before;
+            if (self.pragmaValue("auto_vacuum") != Db::AUTO_VACUUM_INCREMENTAL) {
+                QSqlQuery q(db);
+                if (!q.exec(QString("PRAGMA auto_vacuum = %1").arg(Db::AUTO_VACUUM_INCREMENTAL)) || !q.exec("VACUUM")) {
+                    throw Errors::DbError(q.lastError().text().toStdString());
+                }
+                r.after = self.stats();
+                r.elapsedMs = timer.elapsed();
+                r.performed = true;
+                r.detail = "VACUUM: auto_vacuum = INCREMENTAL";
+            }
+        } catch (...) {
+            db.close();
+            db = QSqlDatabase();
+            QSqlDatabase::removeDatabase(conn);
+            throw;
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(conn);
+    return r;
+}
+
+qint64 DbMaintenance::pragmaValue(const QString &pragma) const {
+    QSqlQuery q(m_db);
+    if (!q.exec("PRAGMA " + pragma) || !q.next()) {
+        throw Errors::DbError(q.lastError().text().toStdString());
+    }
+    return q.value(0).toLongLong();
+}
+
+MaintenanceStats DbMaintenance::stats() const {
+    MaintenanceStats s;
+    const QString path = m_db.databaseName();
+    s.fileBytes = QFileInfo(path).size();
+    s.walBytes = QFileInfo(path + "-wal").size();
+    s.pageSize = pragmaValue("page_size");
+    s.pageCount = pragmaValue("page_count");
+    s.freePages = pragmaValue("freelist_count");
+    return s;
+}
+
+MaintenanceReport DbMaintenance::optimize() {
+    MaintenanceReport r;
+    r.step = "optimize";
+    QElapsedTimer timer;
+    timer.start();
+    r.before = stats();
+    QSqlQuery q(m_db);
+    if (!q.exec(QString("PRAGMA analysis_limit = %1").arg(m_options.analysisLimit)) || !q.exec("PRAGMA optimize")) {
+        throw Errors::DbError(q.lastError().text().toStdString());
+    }
+    r.after = stats();
+    r.elapsedMs = timer.elapsed();
+    r.performed = true;
+    return r;
+}
+
+MaintenanceReport DbMaintenance::incrementalVacuumStep() {
+    MaintenanceReport r;
+    r.step = "incremental_vacuum";
+    QElapsedTimer timer;
+    timer.start();
+    r.before = stats();
+    r.after = r.before;
+    // Начинаем от порога, а начав — освобождаем всё: иначе файл ужимался бы на каждом удалении
+    const qint64 threshold = m_vacuuming ? 1 : m_options.minFreePages;
+    if (r.before.freePages < threshold || pragmaValue("auto_vacuum") != Db::AUTO_VACUUM_INCREMENTAL) {
+        m_vacuuming = false;
+        return r;
+    }
+    // Внутри чужой транзакции (пакет treectl) файл не ужимается — ждём её конца
+    if (SqlTx::depth(m_db) > 0) {
+        r.more = true;
+        return r;
+    }
+
+    if (!SqlTx::begin(m_db)) throw Errors::DbError(m_db.lastError().text().toStdString());
+    qint64 free = r.before.freePages;
+    try {
+        // Сколько страниц освобождает один exec, зависит от драйвера (прагма отдаёт по странице за
+        // sqlite3_step) — поэтому цикл по freelist_count до бюджета шага
+        while (free > 0 && timer.elapsed() < m_options.stepBudgetMs) {
+            QSqlQuery q(m_db);
+            if (!q.exec(QString("PRAGMA incremental_vacuum(%1)").arg(m_options.pagesPerExec))) {
+                throw Errors::DbError(q.lastError().text().toStdString());
+            }
+            const qint64 left = pragmaValue("freelist_count");
+            if (left >= free) break;
+            free = left;
+        }
+    } catch (...) {
+        SqlTx::rollback(m_db);
+        throw;
+    }
+    // Файл укорачивается при фиксации
+    if (!SqlTx::commit(m_db)) throw Errors::DbError(m_db.lastError().text().toStdString());
+
+    r.after = stats();
+    r.elapsedMs = timer.elapsed();
+    r.performed = true;
+    r.detail = QString("освобождено страниц: %1").arg(r.before.freePages - r.after.freePages);
+    m_vacuuming = r.after.freePages > 0 && r.after.freePages < r.before.freePages;
+    r.more = m_vacuuming;
+    return r;
+}
+
+MaintenanceReport DbMaintenance::checkpoint() {
+    MaintenanceReport r;
+    r.step = "checkpoint";
+    QElapsedTimer timer;
+    timer.start();
+    r.before = stats();
+    QSqlQuery q(m_db);
+    if (!q.exec("PRAGMA wal_checkpoint(PASSIVE)") || !q.next()) {
+        throw Errors::DbError(q.lastError().text().toStdString());
+    }
+    // (busy, кадров в WAL, перенесено в файл); -1 — файл не в режиме WAL
+    const bool busy = q.value(0).toInt() != 0;
+    const qint64 frames = q.value(1).toLongLong();
+    const qint64 copied = q.value(2).toLongLong();
+    q.finish();
+    r.after = stats();
+    r.elapsedMs = timer.elapsed();
+    r.performed = frames > 0;
+    r.detail = QString("кадров WAL: %1, перенесено: %2%3").arg(frames).arg(copied).arg(busy ? ", занято" : "");
+    return r;
+}
@@ -0,0 +1,327 @@
+// IntegrityChecker.cpp — этапы проверки: корень, сироты, дубликаты, достижимость от корня, индексы
+#include "IntegrityChecker.h"
+#include "Db.h"
+#include "Errors.h"
+#include "INodeRepository.h"
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVariant>
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+
+namespace {
+
+constexpr qint64 ROOT_ID = 1;
+// Сколько узлов цикла перечисляется в тексте записи
+constexpr int CYCLE_SHOWN_NODES = 8;
+
+// Обход от корня. Корень повторно не входит, даже если его parent_id повреждён (цикл через корень)
+const char *REACH_CTE =
+    "WITH RECURSIVE reach(id, depth) AS ("
+    " SELECT id, 0 FROM nodes WHERE id = 1"
+    " UNION ALL"
+    " SELECT n.id, r.depth + 1 FROM nodes n JOIN reach r ON n.parent_id = r.id"
+    " WHERE r.depth < ? AND n.id <> 1"
+    ") ";
+
+class Pass {
+public:
+    Pass(QSqlDatabase &db, const IntegrityOptions &options, IntegrityReport &report, const std::atomic<bool> *cancel)
+        : m_db(db), m_options(options), m_report(report), m_cancel(cancel) {}
+
+    void run() {
+        exec("BEGIN");
+        checkRoot();
+        if (cancelled()) return;
+        checkOrphans();
+        if (cancelled()) return;
+        checkDuplicates();
+        if (cancelled()) return;
+        checkReachability();
+        if (cancelled()) return;
+        if (m_options.checkIndexes) checkIndexes();
+        exec("COMMIT");
+    }
+
+private:
+    // Группа недостижимых узлов: общий «верх» цепочки родителей
+    struct Group {
+        IntegrityIssueKind kind {IntegrityIssueKind::Detached};
+        qint64 top {0};
+        qint64 parentId {0};
+        qint64 size {0};  // недостижимых узлов в группе (из просмотренных)
+        QString cycle;    // для Cycle: перечень узлов
+    };
+
+    bool cancelled() {
+        if (m_cancel && m_cancel->load(std::memory_order_relaxed)) m_report.cancelled = true;
+        return m_report.cancelled;
+    }
+
+    // LIMIT для выборок проблем: на одну строку больше, чем помещается, — чтобы отметить усечение
+    int issueLimit() const { return m_options.maxIssues + 1; }
+
+    // false — отчёт заполнен
+    bool add(IntegrityIssueKind kind, qint64 nodeId, qint64 parentId, const QString &detail) {
+        if (int(m_report.issues.size()) >= m_options.maxIssues) {
+            m_report.truncated = true;
+            return false;
+        }
+        m_report.issues.push_back(IntegrityIssue{kind, nodeId, parentId, detail});
+        return true;
+    }
+
+    QSqlQuery exec(const QString &sql, const QVariantList &binds = {}) {
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        q.prepare(sql);
+        for (const QVariant &v : binds) q.addBindValue(v);
+        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        return q;
+    }
+
+    // Инварианты ensureRoot: узел id = 1 с parent_id IS NULL и пустым именем — единственный без родителя
+    void checkRoot() {
+        QSqlQuery root = exec("SELECT parent_id, name FROM nodes WHERE id = 1");
+        if (!root.next()) {
+            add(IntegrityIssueKind::MissingRoot, ROOT_ID, 0, "Нет корневого узла");
+        } else if (!root.value(0).isNull()) {
+            add(IntegrityIssueKind::RootInvalid, ROOT_ID, root.value(0).toLongLong(), "У корня есть родитель");
+        } else if (!root.value(1).toString().isEmpty()) {
+            add(IntegrityIssueKind::RootInvalid, ROOT_ID, 0, "У корня непустое имя: " + root.value(1).toString());
+        }
+        QSqlQuery extra = exec("SELECT id FROM nodes WHERE parent_id IS NULL AND id <> 1 LIMIT ?", {issueLimit()});
+        while (extra.next()) {
+            if (!add(IntegrityIssueKind::ExtraRoot, extra.value(0).toLongLong(), 0, "Второй узел без родителя")) break;
+        }
+    }
+
+    // Возможны, если файл писали с выключенными внешними ключами
+    void checkOrphans() {
+        QSqlQuery q = exec("SELECT n.id, n.parent_id FROM nodes n WHERE n.parent_id IS NOT NULL"
+                           " AND NOT EXISTS (SELECT 1 FROM nodes p WHERE p.id = n.parent_id) LIMIT ?",
+                           {issueLimit()});
+        while (q.next()) {
+            const qint64 parentId = q.value(1).toLongLong();
+            if (!add(IntegrityIssueKind::Orphan, q.value(0).toLongLong(), parentId,
+                     QString("Родитель %1 не существует").arg(parentId))) {
+                break;
+            }
+        }
+    }
+
+    void checkDuplicates() {
+        // Чтение мимо индексов: группировка по повреждённому уникальному индексу дубликатов не покажет
+        QSqlQuery q = exec("SELECT parent_id, name, COUNT(*), MIN(id) FROM nodes NOT INDEXED"
+                           " WHERE parent_id IS NOT NULL GROUP BY parent_id, name HAVING COUNT(*) > 1 LIMIT ?",
+                           {issueLimit()});
+        while (q.next()) {
+            const QString detail = QString("Имя «%1» у %2 сиблингов").arg(q.value(1).toString()).arg(q.value(2).toLongLong());
+            if (!add(IntegrityIssueKind::DuplicateName, q.value(3).toLongLong(), q.value(0).toLongLong(), detail)) break;
+        }
+    }
+
+    void checkReachability() {
+        QSqlQuery count = exec("SELECT COUNT(*) FROM nodes");
+        if (!count.next()) throw Errors::DbError(count.lastError().text().toStdString());
+        m_report.nodeCount = count.value(0).toLongLong();
+
+        // У дерева у каждого узла один путь от корня: счётчик строк обхода — число достижимых узлов
+        QSqlQuery reach = exec(QString(REACH_CTE) + "SELECT COUNT(*) FROM reach", {MAX_TREE_DEPTH});
+        if (!reach.next()) throw Errors::DbError(reach.lastError().text().toStdString());
+        m_report.reachableCount = reach.value(0).toLongLong();
+        if (m_report.reachableCount >= m_report.nodeCount) return;
+
+        // Счётчики разошлись (повреждение): разбираем недостижимые строки
+        QSqlQuery rest = exec(QString(REACH_CTE) + "SELECT n.id FROM nodes n WHERE n.id NOT IN (SELECT id FROM reach) LIMIT ?",
+                              {MAX_TREE_DEPTH, m_options.maxUnreachableScan + 1});
+        int scanned = 0;
+        while (rest.next()) {
+            if (++scanned > m_options.maxUnreachableScan) {
+                m_report.truncated = true;
+                break;
+            }
+            if (scanned % 1000 == 0 && cancelled()) return;
+            m_groups[classify(rest.value(0).toLongLong())].size++;
+        }
+        reportGroups();
+    }
+
+    std::optional<std::optional<qint64>> parentOf(qint64 id) {
+        QSqlQuery q = exec("SELECT parent_id FROM nodes WHERE id = ?", {id});
+        if (!q.next()) return std::nullopt;
+        if (q.value(0).isNull()) return std::optional<qint64>();
+        return std::optional<qint64>(q.value(0).toLongLong());
+    }
+
+    // Подъём по родителям до известной группы, корня, узла без родителя, пропавшего родителя или повтора (цикл).
+    // Все узлы пути запоминаются — следующие узлы той же ветки классифицируются за один шаг.
+    qint64 classify(qint64 id) {
+        std::vector<qint64> path;
+        std::unordered_map<qint64, size_t> onPath;
+        qint64 current = id;
+        qint64 key = 0;
+        while (true) {
+            if (const auto known = m_groupOf.find(current); known != m_groupOf.end()) {
+                key = known->second;
+                break;
+            }
+            if (const auto seen = onPath.find(current); seen != onPath.end()) {
+                key = openCycle(path, seen->second);
+                break;
+            }
+            if (current == ROOT_ID) {
+                // Путь дошёл до корня, но обход от корня сюда не добрался — глубже предела
+                key = openGroup(IntegrityIssueKind::TooDeep, ROOT_ID, 0);
+                break;
+            }
+            const auto parent = parentOf(current);
+            if (!parent.has_value()) {
+                // current — пропавший родитель: верх ветки — сирота перед ним
+                key = openGroup(IntegrityIssueKind::Detached, path.back(), current);
+                break;
+            }
+            onPath.emplace(current, path.size());
+            path.push_back(current);
+            if (!parent->has_value()) {
+                key = openGroup(IntegrityIssueKind::Detached, current, 0);
+                break;
+            }
+            current = **parent;
+        }
+        for (const qint64 n : path) m_groupOf.emplace(n, key);
+        return key;
+    }
+
+    qint64 openGroup(IntegrityIssueKind kind, qint64 top, qint64 parentId) {
+        auto [it, inserted] = m_groups.try_emplace(top);
+        if (inserted) {
+            it->second.kind = kind;
+            it->second.top = top;
+            it->second.parentId = parentId;
+            m_order.push_back(top);
+        }
+        return top;
+    }
+
+    qint64 openCycle(const std::vector<qint64> &path, size_t from) {
+        qint64 key = path[from];
+        for (size_t i = from; i < path.size(); ++i) key = std::min(key, path[i]);
+        if (m_groups.count(key)) return key;
+        QStringList ids;
+        for (size_t i = from; i < path.size() && ids.size() < CYCLE_SHOWN_NODES; ++i) ids << QString::number(path[i]);
+        if (path.size() - from > size_t(CYCLE_SHOWN_NODES)) ids << "...";
+        openGroup(IntegrityIssueKind::Cycle, key, 0);
+        m_groups[key].cycle = QString("Цикл из %1 узлов (%2)").arg(qint64(path.size() - from)).arg(ids.join(" → "));
+        return key;
+    }
+
+    void reportGroups() {
+        for (const qint64 key : m_order) {
+            const Group &g = m_groups[key];
+            QString detail;
+            switch (g.kind) {
+            case IntegrityIssueKind::Cycle:
+                detail = QString("%1; недостижимо вместе с потомками: %2").arg(g.cycle).arg(g.size);
+                break;
+            case IntegrityIssueKind::TooDeep:
+                detail = QString("%1 узлов глубже предела %2").arg(g.size).arg(MAX_TREE_DEPTH);
+                break;
+            default:
+                // Сам верх ветки уже в отчёте (Orphan/ExtraRoot) — считаем только узлы под ним
+                if (g.size <= 1) continue;
+                detail = QString("%1 узлов отрезаны от корня под узлом %2").arg(g.size - 1).arg(g.top);
+                break;
+            }
+            if (!add(g.kind, g.top, g.parentId, detail)) break;
+        }
+    }
+
+    // Полная проверка b-деревьев таблицы nodes и всех её индексов (в т.ч. соответствие индексов строкам)
+    void checkIndexes() {
+        QSqlQuery q = exec("PRAGMA integrity_check(nodes)");
+        while (q.next()) {
+            const QString line = q.value(0).toString();
+            if (line == "ok") continue;
+            if (!add(IntegrityIssueKind::IndexCorrupt, 0, 0, line)) break;
+        }
+    }
+
+    QSqlDatabase &m_db;
+    const IntegrityOptions &m_options;
+    IntegrityReport &m_report;
+    const std::atomic<bool> *m_cancel;
+    std::unordered_map<qint64, qint64> m_groupOf; // узел -> ключ группы
+    std::unordered_map<qint64, Group> m_groups;
+    std::vector<qint64> m_order;                   // группы в порядке обнаружения
+};
+
+void closeConnection(const QString &name) {
+    {
+        QSqlDatabase db = QSqlDatabase::database(name, false);
+        if (db.isOpen()) {
+            QSqlQuery q(db);
+            q.exec("ROLLBACK");
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+}
+
+}
+
+const char *integrityIssueKindName(IntegrityIssueKind kind) {
+    switch (kind) {
+    case IntegrityIssueKind::MissingRoot: return "MissingRoot";
+    case IntegrityIssueKind::RootInvalid: return "RootInvalid";
+    case IntegrityIssueKind::ExtraRoot: return "ExtraRoot";
+    case IntegrityIssueKind::Orphan: return "Orphan";
+    case IntegrityIssueKind::Cycle: return "Cycle";
+    case IntegrityIssueKind::Detached: return "Detached";
+    case IntegrityIssueKind::TooDeep: return "TooDeep";
+    case IntegrityIssueKind::DuplicateName: return "DuplicateName";
+    case IntegrityIssueKind::IndexCorrupt: return "IndexCorrupt";
+    }
+    return "Unknown";
+}
+
+QString IntegrityReport::toText() const {
+    QStringList lines;
+    lines << QString("Узлов: %1, достижимо от корня: %2, время: %3 мс").arg(nodeCount).arg(reachableCount).arg(elapsedMs);
+    if (cancelled) lines << "Проверка прервана";
+    if (issues.empty() && !cancelled) lines << "Нарушений не найдено";
+    for (const IntegrityIssue &i : issues) {
+        const QString parent = i.parentId ? QString(" parent=%1").arg(i.parentId) : QString();
+        lines << QString("%1 id=%2%3: %4").arg(QString::fromLatin1(integrityIssueKindName(i.kind)),
+                                                QString::number(i.nodeId), parent, i.detail);
+    }
+    if (truncated) lines << "... отчёт усечён";
+    return lines.join('\n');
+}
+
+IntegrityChecker::IntegrityChecker(const QString &dbPath, IntegrityOptions options)
+    : m_dbPath(dbPath), m_options(options) {}
+
+IntegrityReport IntegrityChecker::run(const std::atomic<bool> *cancel) {
+    static std::atomic<int> counter {0};
+    const QString name = QString("integrity_check_%1").arg(++counter);
+    IntegrityReport report;
+    QElapsedTimer clock;
+    clock.start();
+    try {
+        Db::openConnection(name, m_dbPath, true);
+        QSqlDatabase db = QSqlDatabase::database(name, false);
+        Pass(db, m_options, report, cancel).run();
+    } catch (...) {
+        closeConnection(name);
+        throw;
+    }
+    closeConnection(name);
+    report.elapsedMs = clock.elapsed();
+    return report;
+}
@@ -0,0 +1,38 @@
+// NameKeys.cpp — case folding и кодирование групп цифр для натуральной сортировки
+#include "NameKeys.h"
+
+static bool isAsciiDigit(QChar c) {
+    return c >= QLatin1Char('0') && c <= QLatin1Char('9');
+}
+
+namespace NameKeys {
+
+QString fold(const QString &name) {
+    return name.toCaseFolded();
+}
+
+QString natural(const QString &name) {
+    const QString folded = name.toCaseFolded();
+    QString out;
+    out.reserve(folded.size() + 8);
+    int i = 0;
+    while (i < folded.size()) {
+        if (!isAsciiDigit(folded.at(i))) {
+            out += folded.at(i++);
+            continue;
+        }
+        int end = i;
+        while (end < folded.size() && isAsciiDigit(folded.at(end))) ++end;
+        // Ведущие нули не влияют на значение: "007" и "7" дают один ключ (порядок между ними — по name)
+        int start = i;
+        while (start < end - 1 && folded.at(start) == QLatin1Char('0')) ++start;
+        const int len = end - start;
+        // Двузначная длина впереди: более короткое число всегда меньше более длинного
+        out += QString("%1").arg(len, 2, 10, QLatin1Char('0'));
+        out += folded.mid(start, len);
+        i = end;
+    }
+    return out;
+}
+
+}
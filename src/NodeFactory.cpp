@@ -15,16 +15,16 @@ public:
         return trimmed.trimmed();
     }
 
+    QString nameError(const QString &name) const override {
+        if (name.isEmpty()) return "Empty name";
+        if (name.size() > 255) return "Name too long";
+        if (name.contains('/')) return "Name contains '/'";
+        return QString();
+    }
+
     void validateName(const QString &name) const override {
-        if (name.isEmpty()) {
-            throw Errors::InvalidName("Empty name");
-        }
-        if (name.size() > 255) {
-            throw Errors::InvalidName("Name too long");
-        }
-        if (name.contains('/')) {
-            throw Errors::InvalidName("Name contains '/'");
-        }
+        const QString error = nameError(name);
+        if (!error.isEmpty()) throw Errors::InvalidName(error.toStdString());
     }
 
     std::unique_ptr<Node> create(qint64 id, qint64 parentId, const QString &name) const override {
@@ -0,0 +1,302 @@
+// OnlineBackup.cpp — схема из sqlite_master источника, снимок в транзакции чтения, порции по rowid с подстройкой под бюджет шага
+#include "OnlineBackup.h"
+#include "Db.h"
+#include "Errors.h"
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QVariant>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+constexpr int MIN_ROWS_PER_STEP = 1;
+constexpr int MAX_ROWS_PER_STEP = 65536;
+
+QString quoted(const QString &identifier) {
+    return '"' + QString(identifier).replace('"', "\"\"") + '"';
+}
+
+QStringList columnsOf(QSqlDatabase &db, const QString &schema, const QString &table) {
+    QSqlQuery q(db);
+    if (!q.exec(QString("PRAGMA %1.table_info(%2)").arg(schema, quoted(table)))) {
+        throw Errors::DbError(q.lastError().text().toStdString());
+    }
+    QStringList out;
+    while (q.next()) out << q.value(1).toString();
+    return out;
+}
+
+void removeWithSidecars(const QString &path) {
+    for (const char *suffix : {"", "-wal", "-shm", "-journal"}) QFile::remove(path + suffix);
+}
+
+void execOn(QSqlDatabase &db, const QString &sql) {
+    QSqlQuery q(db);
+    if (!q.exec(sql)) throw Errors::DbError((sql + ": " + q.lastError().text()).toStdString());
+}
+
+qint64 pragmaValue(QSqlDatabase &db, const QString &pragma) {
+    QSqlQuery q(db);
+    if (!q.exec("PRAGMA " + pragma) || !q.next()) throw Errors::DbError(q.lastError().text().toStdString());
+    return q.value(0).toLongLong();
+}
+
+}
+
+OnlineBackup::OnlineBackup(const QString &sourcePath, const QString &targetPath, BackupOptions options)
+    : m_sourcePath(sourcePath), m_targetPath(targetPath), m_tmpPath(targetPath + ".part"), m_options(options) {
+    static std::atomic<int> counter {0};
+    m_connectionName = QString("online_backup_%1").arg(++counter);
+}
+
+OnlineBackup::~OnlineBackup() {
+    if (!m_done) abort();
+}
+
+void OnlineBackup::exec(const QString &sql) {
+    QSqlQuery q(QSqlDatabase::database(m_connectionName, false));
+    if (!q.exec(sql)) throw Errors::DbError(q.lastError().text().toStdString());
+}
+
+void OnlineBackup::begin() {
+    m_clock.start();
+    removeWithSidecars(m_tmpPath);
+
+    Db::openConnection(m_connectionName, m_sourcePath, false);
+    m_open = true;
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+    // Строки идут в порядке rowid, а не ссылок: проверка внешних ключей на этом соединении не нужна
+    exec("PRAGMA foreign_keys = OFF");
+
+    // Схема копии — DDL самого источника (все его таблицы и колонки, включая незнакомые этой сборке).
+    // Таблицы создаются сразу, индексы, триггеры и представления — после данных (finish)
+    std::vector<QString> tableDdl;
+    QStringList names;
+    {
+        QSqlQuery schema(db);
+        if (!schema.exec("SELECT type, name, sql FROM main.sqlite_master "
+                         "WHERE sql IS NOT NULL AND name NOT LIKE 'sqlite_%' ORDER BY rowid")) {
+            throw Errors::DbError(schema.lastError().text().toStdString());
+        }
+        while (schema.next()) {
+            const QString type = schema.value(0).toString();
+            const QString sql = schema.value(2).toString();
+            if (type != "table") {
+                m_deferredDdl.push_back(sql);
+                continue;
+            }
+            // Копирование идёт по rowid: такую таблицу не пропускаем молча, а останавливаем копию
+            if (sql.contains("WITHOUT ROWID", Qt::CaseInsensitive) || sql.startsWith("CREATE VIRTUAL", Qt::CaseInsensitive)) {
+                throw Errors::DbError(("Backup cannot copy table " + schema.value(1).toString()).toStdString());
+            }
+            tableDdl.push_back(sql);
+            names << schema.value(1).toString();
+        }
+    }
+    {
+        const QString schemaConn = m_connectionName + "_schema";
+        {
+            QSqlDatabase target = QSqlDatabase::addDatabase("QSQLITE", schemaConn);
+            target.setDatabaseName(m_tmpPath);
+            try {
+                if (!target.open()) throw Errors::DbError(target.lastError().text().toStdString());
+                // auto_vacuum действует только до первой таблицы; версия схемы — как у источника
+                execOn(target, QString("PRAGMA auto_vacuum = %1").arg(pragmaValue(db, "main.auto_vacuum")));
+                execOn(target, "PRAGMA journal_mode = WAL");
+                for (const QString &sql : tableDdl) execOn(target, sql);
+                execOn(target, QString("PRAGMA user_version = %1").arg(pragmaValue(db, "main.user_version")));
+            } catch (...) {
+                target.close();
+                target = QSqlDatabase();
+                QSqlDatabase::removeDatabase(schemaConn);
+                throw;
+            }
+            target.close();
+        }
+        QSqlDatabase::removeDatabase(schemaConn);
+    }
+    {
+        QSqlQuery attach(db);
+        attach.prepare("ATTACH DATABASE ? AS backup");
+        attach.addBindValue(m_tmpPath);
+        if (!attach.exec()) throw Errors::DbError(attach.lastError().text().toStdString());
+    }
+    // Одна транзакция на всю копию: первое чтение main фиксирует снимок (WAL — писатели не ждут), все
+    // порции и границы rowid — из одного состояния БД
+    exec("BEGIN");
+
+    for (const QString &name : names) {
+        QStringList columns;
+        for (const QString &column : columnsOf(db, "main", name)) columns << quoted(column);
+
+        QSqlQuery max(db);
+        if (!max.exec(QString("SELECT COALESCE(MAX(rowid), 0) FROM main.%1").arg(quoted(name))) || !max.next()) {
+            throw Errors::DbError(max.lastError().text().toStdString());
+        }
+        TableCopy t;
+        t.name = name;
+        t.columns = columns.join(", ");
+        t.maxRowId = max.value(0).toLongLong();
+        m_totalRowIds += t.maxRowId;
+        m_tables.push_back(std::move(t));
+    }
+}
+
+bool OnlineBackup::step() {
+    if (m_done) return false;
+    while (m_current < m_tables.size() && m_tables[m_current].cursor >= m_tables[m_current].maxRowId) {
+        ++m_current;
+        m_rowsPerStep = 64;
+    }
+    if (m_current >= m_tables.size()) {
+        finish();
+        return false;
+    }
+
+    TableCopy &t = m_tables[m_current];
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+    QElapsedTimer timer;
+    timer.start();
+
+    // Верхняя граница порции — rowid N-й строки после курсора (или конец снимка)
+    qint64 upper = t.maxRowId;
+    {
+        QSqlQuery bound(db);
+        bound.prepare(QString("SELECT rowid FROM main.%1 WHERE rowid > ? AND rowid <= ? ORDER BY rowid LIMIT 1 OFFSET ?")
+                          .arg(quoted(t.name)));
+        bound.addBindValue(t.cursor);
+        bound.addBindValue(t.maxRowId);
+        bound.addBindValue(m_rowsPerStep - 1);
+        if (!bound.exec()) throw Errors::DbError(bound.lastError().text().toStdString());
+        if (bound.next()) upper = bound.value(0).toLongLong();
+    }
+    QSqlQuery copy(db);
+    copy.prepare(QString("INSERT OR REPLACE INTO backup.%1(%2) SELECT %2 FROM main.%1 WHERE rowid > ? AND rowid <= ?")
+                     .arg(quoted(t.name), t.columns));
+    copy.addBindValue(t.cursor);
+    copy.addBindValue(upper);
+    if (!copy.exec()) throw Errors::DbError(copy.lastError().text().toStdString());
+    m_rowsCopied += std::max(0, copy.numRowsAffected());
+    t.cursor = upper;
+
+    // Крупные строки (порции вложений) быстро упираются в бюджет — порция уменьшается, мелкие — растёт
+    const qint64 elapsedMs = timer.elapsed();
+    if (elapsedMs > m_options.stepBudgetMs) {
+        m_rowsPerStep = std::max(MIN_ROWS_PER_STEP, m_rowsPerStep / 2);
+    } else if (elapsedMs * 2 < m_options.stepBudgetMs) {
+        m_rowsPerStep = std::min(MAX_ROWS_PER_STEP, m_rowsPerStep * 2);
+    }
+    return true;
+}
+
+BackupProgress OnlineBackup::progress() const {
+    BackupProgress p;
+    p.rowsCopied = m_rowsCopied;
+    p.elapsedMs = m_clock.isValid() ? m_clock.elapsed() : 0;
+    p.done = m_done;
+    if (m_done) {
+        p.bytesWritten = QFileInfo(m_targetPath).size();
+        p.fraction = 1.0;
+        return p;
+    }
+    p.bytesWritten = QFileInfo(m_tmpPath).size() + QFileInfo(m_tmpPath + "-wal").size();
+    if (m_current < m_tables.size()) p.table = m_tables[m_current].name;
+    qint64 covered = 0;
+    for (const TableCopy &t : m_tables) covered += std::min(t.cursor, t.maxRowId);
+    p.fraction = m_totalRowIds > 0 ? double(covered) / double(m_totalRowIds) : 0.0;
+    return p;
+}
+
+void OnlineBackup::finish() {
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+        // Счётчики AUTOINCREMENT — как в источнике (вставки копии уже завели свои)
+        QSqlQuery seq(db);
+        if (!seq.exec("SELECT 1 FROM main.sqlite_master WHERE name = 'sqlite_sequence'")) {
+            throw Errors::DbError(seq.lastError().text().toStdString());
+        }
+        if (seq.next()) {
+            exec("DELETE FROM backup.sqlite_sequence");
+            exec("INSERT INTO backup.sqlite_sequence(name, seq) SELECT name, seq FROM main.sqlite_sequence");
+        }
+    }
+    exec("COMMIT");
+    exec("DETACH DATABASE backup");
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(m_connectionName);
+    m_open = false;
+
+    // Индексы, триггеры и представления — на готовых данных. Снимок согласован, поэтому нарушение внешних
+    // ключей — испорченный источник или ошибка копии: копия не правится, а не принимается
+    const QString targetConn = m_connectionName + "_finish";
+    {
+        QSqlDatabase target = QSqlDatabase::addDatabase("QSQLITE", targetConn);
+        target.setDatabaseName(m_tmpPath);
+        try {
+            if (!target.open()) throw Errors::DbError(target.lastError().text().toStdString());
+            for (const QString &sql : m_deferredDdl) execOn(target, sql);
+            QSqlQuery check(target);
+            if (!check.exec("PRAGMA foreign_key_check")) throw Errors::DbError(check.lastError().text().toStdString());
+            if (check.next()) {
+                throw Errors::DbError(QString("Backup violates foreign keys: table %1, rowid %2")
+                                          .arg(check.value(0).toString())
+                                          .arg(check.value(1).toLongLong())
+                                          .toStdString());
+            }
+        } catch (...) {
+            target.close();
+            target = QSqlDatabase();
+            QSqlDatabase::removeDatabase(targetConn);
+            throw;
+        }
+        target.close();
+    }
+    QSqlDatabase::removeDatabase(targetConn);
+
+    // Прежняя копия заменяется только готовой новой
+    removeWithSidecars(m_targetPath);
+    if (!QFile::rename(m_tmpPath, m_targetPath)) {
+        throw Errors::DbError(("Cannot rename backup to " + m_targetPath).toStdString());
+    }
+    m_done = true;
+}
+
+void OnlineBackup::abort() {
+    if (m_open) {
+        {
+            QSqlDatabase db = QSqlDatabase::database(m_connectionName, false);
+            if (db.isOpen()) {
+                QSqlQuery q(db);
+                q.exec("ROLLBACK");
+                q.exec("DETACH DATABASE backup");
+            }
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(m_connectionName);
+        m_open = false;
+    }
+    removeWithSidecars(m_tmpPath);
+}
+
+QString OnlineBackup::snapshotFileName(const QString &prefix, const QDateTime &at) {
+    return QString("%1-%2.sqlite").arg(prefix, at.toString("yyyyMMdd-HHmmss"));
+}
+
+QStringList OnlineBackup::rotateSnapshots(const QString &dir, const QString &prefix, int keep) {
+    // Метка времени в имени сортируется как строка: по имени — от старых к новым
+    const QFileInfoList files = QDir(dir).entryInfoList({prefix + "-*.sqlite"}, QDir::Files, QDir::Name);
+    QStringList removed;
+    for (qsizetype i = 0; i + qMax(keep, 0) < files.size(); ++i) {
+        if (QFile::remove(files[i].absoluteFilePath())) removed << files[i].absoluteFilePath();
+    }
+    return removed;
+}
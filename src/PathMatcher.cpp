@@ -0,0 +1,242 @@
+// PathMatcher.cpp — компиляция glob-шаблона в план и ленивый обход по индексу (parent_id, name)
+#include "PathMatcher.h"
+#include "INodeFactory.h"
+
+#include <QStringList>
+
+#include <algorithm>
+
+// Наименьшая строка, большая всех строк с данным префиксом, в порядке BINARY (UTF-8) SQLite.
+// Порядок байт UTF-8 совпадает с порядком кодовых точек, поэтому увеличиваем последнюю кодовую точку.
+static QString prefixUpperBound(const QString &prefix) {
+    QList<uint> cps = prefix.toUcs4();
+    while (!cps.isEmpty()) {
+        uint last = cps.takeLast();
+        if (last >= 0x10FFFF) continue;
+        ++last;
+        if (last >= 0xD800 && last <= 0xDFFF) last = 0xE000;
+        cps.append(last);
+        return QString::fromUcs4(reinterpret_cast<const char32_t *>(cps.constData()), cps.size());
+    }
+    return QString();
+}
+
+// Разбор сегмента с экранированием: "\x" — буквальный x. literal — имя без экранирования,
+// prefix — буквальные символы до первого шаблонного, regex — выражение для всего сегмента.
+struct ParsedSegment {
+    QString literal;
+    QString prefix;
+    QString regex;
+    int wildcards{0};
+    bool trailingStar{false}; // единственный шаблонный символ — '*' в конце
+};
+
+static ParsedSegment parseSegment(const QString &seg) {
+    ParsedSegment p;
+    const auto addLiteral = [&p](QChar c) {
+        p.literal += c;
+        if (p.wildcards == 0) p.prefix += c;
+        p.regex += QRegularExpression::escape(QString(c));
+    };
+    for (int i = 0; i < seg.size(); ++i) {
+        const QChar c = seg.at(i);
+        if (c == QLatin1Char('\\') && i + 1 < seg.size()) {
+            addLiteral(seg.at(++i));
+            continue;
+        }
+        if (c == QLatin1Char('*')) {
+            ++p.wildcards;
+            p.trailingStar = p.wildcards == 1 && i == seg.size() - 1;
+            p.regex += QLatin1String(".*");
+            continue;
+        }
+        if (c == QLatin1Char('?')) {
+            ++p.wildcards;
+            p.trailingStar = false;
+            p.regex += QLatin1Char('.');
+            continue;
+        }
+        if (c == QLatin1Char('[')) {
+            // Класс "[...]" / "[!...]"; ']' сразу после открытия — буквальный. Без закрывающей — обычный символ.
+            int k = i + 1;
+            const bool negate = k < seg.size() && (seg.at(k) == QLatin1Char('!') || seg.at(k) == QLatin1Char('^'));
+            if (negate) ++k;
+            const int first = k;
+            if (k < seg.size() && seg.at(k) == QLatin1Char(']')) ++k;
+            while (k < seg.size() && seg.at(k) != QLatin1Char(']')) ++k;
+            if (k < seg.size()) {
+                QString cls = negate ? QStringLiteral("[^") : QStringLiteral("[");
+                for (int m = first; m < k; ++m) {
+                    const QChar ch = seg.at(m);
+                    if (ch == QLatin1Char('\\') || ch == QLatin1Char('[') || ch == QLatin1Char(']') || ch == QLatin1Char('^')) {
+                        cls += QLatin1Char('\\');
+                    }
+                    cls += ch;
+                }
+                p.regex += cls + QLatin1Char(']');
+                ++p.wildcards;
+                p.trailingStar = false;
+                i = k;
+                continue;
+            }
+        }
+        addLiteral(c);
+    }
+    return p;
+}
+
+std::vector<PathSegment> compilePathPattern(const QString &pattern, const INodeFactory &factory) {
+    std::vector<PathSegment> plan;
+    const auto parts = pattern.split('/', Qt::SkipEmptyParts);
+    for (const auto &raw : parts) {
+        const QString seg = factory.normalizeName(raw);
+        factory.validateName(seg);
+
+        PathSegment s;
+        if (seg == QLatin1String("**")) {
+            if (!plan.empty() && plan.back().kind == PathSegment::Kind::AnyDepth) continue;
+            s.kind = PathSegment::Kind::AnyDepth;
+            plan.push_back(std::move(s));
+            continue;
+        }
+
+        const ParsedSegment parsed = parseSegment(seg);
+        if (parsed.wildcards == 0) {
+            s.kind = PathSegment::Kind::Literal;
+            s.text = parsed.literal;
+            plan.push_back(std::move(s));
+            continue;
+        }
+
+        s.kind = PathSegment::Kind::Pattern;
+        s.text = seg;
+        s.rangeFrom = parsed.prefix;
+        s.rangeTo = prefixUpperBound(s.rangeFrom);
+        // "D6*" (и "*"): диапазон по префиксу точно совпадает с множеством подходящих имён
+        s.prefixOnly = parsed.wildcards == 1 && parsed.trailingStar;
+        if (!s.prefixOnly) {
+            s.regex = QRegularExpression(QRegularExpression::anchoredPattern(parsed.regex));
+        }
+        plan.push_back(std::move(s));
+    }
+    return plan;
+}
+
+static bool segmentMatches(const PathSegment &s, const QString &name) {
+    switch (s.kind) {
+    case PathSegment::Kind::Literal: return name == s.text;
+    case PathSegment::Kind::Pattern:
+        return s.prefixOnly ? name.startsWith(s.rangeFrom) : s.regex.match(name).hasMatch();
+    case PathSegment::Kind::AnyDepth: return true;
+    }
+    return false;
+}
+
+PathMatchCursor::PathMatchCursor(INodeRepository &repo, qint64 startId, std::vector<PathSegment> plan, int pageSize)
+    : m_repo(&repo), m_plan(std::move(plan)), m_pageSize(pageSize) {
+    std::vector<size_t> states {0};
+    closeStates(states);
+    m_stack.push_back(makeFrame(startId, std::move(states)));
+}
+
+// "**" может не занимать ни одного уровня: вместе с его позицией узел достигает и следующей
+void PathMatchCursor::closeStates(std::vector<size_t> &states) const {
+    for (size_t i = 0; i < states.size(); ++i) {
+        const size_t st = states[i];
+        if (st < m_plan.size() && m_plan[st].kind == PathSegment::Kind::AnyDepth) states.push_back(st + 1);
+    }
+    std::sort(states.begin(), states.end());
+    states.erase(std::unique(states.begin(), states.end()), states.end());
+}
+
+// Позиции плана, которых достигает ребёнок с именем childName
+std::vector<size_t> PathMatchCursor::advance(const std::vector<size_t> &states, const QString &childName) const {
+    std::vector<size_t> next;
+    for (const size_t st : states) {
+        if (st >= m_plan.size()) continue;
+        const PathSegment &s = m_plan[st];
+        // "**" остаётся на той же позиции для ребёнка — спуск ещё на уровень
+        if (s.kind == PathSegment::Kind::AnyDepth) next.push_back(st);
+        else if (segmentMatches(s, childName)) next.push_back(st + 1);
+    }
+    closeStates(next);
+    return next;
+}
+
+PathMatchCursor::Frame PathMatchCursor::makeFrame(qint64 nodeId, std::vector<size_t> states) const {
+    Frame f{nodeId, std::move(states)};
+    std::vector<size_t> open;
+    for (const size_t st : f.states) {
+        if (st < m_plan.size()) open.push_back(st);
+    }
+    if (open.empty()) {
+        f.scan = Scan::None;
+    } else if (open.size() == 1 && m_plan[open.front()].kind != PathSegment::Kind::AnyDepth) {
+        f.seg = open.front();
+        f.scan = m_plan[f.seg].kind == PathSegment::Kind::Literal ? Scan::Literal : Scan::Range;
+    } else {
+        f.scan = Scan::All;
+    }
+    return f;
+}
+
+void PathMatchCursor::fetchPage(Frame &f) {
+    // Range — только диапазон префикса; All — все дети. Продолжение — строго после последнего имени.
+    const bool ranged = f.scan == Scan::Range;
+    const PathSegment *s = ranged ? &m_plan[f.seg] : nullptr;
+    const QString from = f.scanned ? f.after : (ranged ? s->rangeFrom : QString(""));
+    f.page = m_repo->scanChildrenByName(f.nodeId, from, !f.scanned, ranged ? s->rangeTo : QString(), m_pageSize);
+    f.scanned = true;
+    f.pos = 0;
+    f.exhausted = int(f.page.size()) < m_pageSize;
+    if (!f.page.empty()) f.after = f.page.back().name;
+}
+
+std::optional<qint64> PathMatchCursor::next() {
+    while (!m_stack.empty()) {
+        Frame &f = m_stack.back();
+        if (!f.yielded) {
+            f.yielded = true;
+            if (!f.states.empty() && f.states.back() == m_plan.size()) return f.nodeId;
+        }
+
+        if (f.scan == Scan::None) {
+            m_stack.pop_back();
+            continue;
+        }
+
+        // push_back может инвалидировать f — нужные значения копируются заранее
+        const qint64 nodeId = f.nodeId;
+
+        if (f.scan == Scan::Literal) {
+            if (f.started) {
+                m_stack.pop_back();
+                continue;
+            }
+            f.started = true;
+            const std::vector<size_t> states = f.states;
+            auto child = m_repo->findChildByName(nodeId, m_plan[f.seg].text);
+            if (child.has_value()) m_stack.push_back(makeFrame(child->id, advance(states, child->name)));
+            continue;
+        }
+
+        if (f.pos >= f.page.size()) {
+            if (f.scanned && f.exhausted) {
+                m_stack.pop_back();
+                continue;
+            }
+            fetchPage(f);
+            if (f.page.empty()) {
+                m_stack.pop_back();
+                continue;
+            }
+        }
+
+        const RepoRow &row = f.page[f.pos++];
+        std::vector<size_t> states = advance(f.states, row.name);
+        if (states.empty()) continue;
+        const qint64 childId = row.id;
+        m_stack.push_back(makeFrame(childId, std::move(states)));
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,174 @@
+// QueryStats.cpp — корзины гистограммы, снимок/JSON и RAII-замер операции
+#include "QueryStats.h"
+
+#include <QtSql/QSqlQuery>
+#include <QVariant>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+#include <algorithm>
+#include <bit>
+
+// Длинные параметры (payload) в журнале обрезаются, BLOB — только размер
+static constexpr int MAX_PARAM_CHARS = 120;
+
+// Текстовый параметр отдаётся без копирования и обрезается; BLOB в текст не переводится
+static QString formatParam(const QVariant &v) {
+    if (v.typeId() == QMetaType::QByteArray) return QString("<blob %1 bytes>").arg(v.toByteArray().size());
+    return v.toString().left(MAX_PARAM_CHARS);
+}
+
+int LatencyHistogram::bucketOf(quint64 ns) {
+    if (ns < quint64(SUB_BUCKETS)) return int(ns);
+    // Старший бит задаёт интервал, следующие SUB_BITS бит — корзину внутри него
+    const int shift = int(std::bit_width(ns)) - 1 - SUB_BITS;
+    const int sub = int((ns >> shift) & quint64(SUB_BUCKETS - 1));
+    return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    const int shift = bucket / SUB_BUCKETS - 1;
+    const int sub = bucket % SUB_BUCKETS;
+    return qint64(((quint64(SUB_BUCKETS + sub) + 1) << shift) - 1);
+}
+
+void LatencyHistogram::record(qint64 ns) {
+    if (ns < 0) ns = 0;
+    ++m_counts[size_t(bucketOf(quint64(ns)))];
+    ++m_count;
+    m_totalNs += ns;
+    m_maxNs = std::max(m_maxNs, ns);
+}
+
+qint64 LatencyHistogram::percentileNs(double p) const {
+    if (m_count == 0) return 0;
+    const qint64 rank = std::max<qint64>(1, qint64(p * double(m_count) + 0.5));
+    qint64 seen = 0;
+    for (int b = 0; b < BUCKETS; ++b) {
+        seen += m_counts[size_t(b)];
+        if (seen >= rank) return std::min(bucketUpperBound(b), m_maxNs);
+    }
+    return m_maxNs;
+}
+
+QueryStats::QueryStats(qint64 slowThresholdMs, size_t slowLogCapacity)
+    : m_slowCapacity(slowLogCapacity), m_slowThresholdNs(slowThresholdMs * 1000000) {}
+
+void QueryStats::setSlowThresholdMs(qint64 ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slowThresholdNs = ms * 1000000;
+}
+
+void QueryStats::recordOp(const char *op, qint64 ns, qint64 rows, const QString &sql, const QVariantList &params) {
+    bool slow = false;
+    QStringList text;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        OpData &data = m_ops[op];
+        data.histogram.record(ns);
+        data.rows += rows;
+        if (ns >= m_slowThresholdNs) {
+            slow = true;
+            ++m_slowTotal;
+            for (const QVariant &v : params) text << formatParam(v);
+            m_slow.push_back(SlowQuery{QString::fromLatin1(op), sql, text, ns, QDateTime::currentMSecsSinceEpoch()});
+            while (m_slow.size() > m_slowCapacity) m_slow.pop_front();
+        }
+    }
+    if (slow) {
+        qWarning().noquote() << QString("slow query: %1 %2 ms: %3 [%4]")
+                                    .arg(QString::fromLatin1(op))
+                                    .arg(double(ns) / 1e6, 0, 'f', 1)
+                                    .arg(sql, text.join(", "));
+    }
+}
+
+QueryStatsSnapshot QueryStats::snapshot() const {
+    QueryStatsSnapshot s;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    s.ops.reserve(m_ops.size());
+    for (const auto &[op, data] : m_ops) {
+        OpStats o;
+        o.op = QString::fromLatin1(op);
+        o.calls = data.histogram.count();
+        o.rows = data.rows;
+        o.totalNs = data.histogram.totalNs();
+        o.maxNs = data.histogram.maxNs();
+        o.p50Ns = data.histogram.percentileNs(0.50);
+        o.p90Ns = data.histogram.percentileNs(0.90);
+        o.p99Ns = data.histogram.percentileNs(0.99);
+        s.ops.push_back(std::move(o));
+    }
+    std::sort(s.ops.begin(), s.ops.end(), [](const OpStats &a, const OpStats &b) { return a.totalNs > b.totalNs; });
+    s.slow.assign(m_slow.begin(), m_slow.end());
+    s.slowTotal = m_slowTotal;
+    s.slowThresholdMs = m_slowThresholdNs / 1000000;
+    return s;
+}
+
+void QueryStats::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ops.clear();
+    m_slow.clear();
+    m_slowTotal = 0;
+}
+
+QByteArray QueryStats::toJson() const {
+    const QueryStatsSnapshot s = snapshot();
+    const auto us = [](qint64 ns) { return double(ns) / 1000.0; };
+    QJsonArray ops;
+    for (const OpStats &o : s.ops) {
+        QJsonObject j;
+        j["op"] = o.op;
+        j["calls"] = o.calls;
+        j["rows"] = o.rows;
+        j["total_ms"] = double(o.totalNs) / 1e6;
+        j["mean_us"] = o.calls > 0 ? us(o.totalNs) / double(o.calls) : 0.0;
+        j["p50_us"] = us(o.p50Ns);
+        j["p90_us"] = us(o.p90Ns);
+        j["p99_us"] = us(o.p99Ns);
+        j["max_us"] = us(o.maxNs);
+        ops.append(j);
+    }
+    QJsonArray slow;
+    for (const SlowQuery &q : s.slow) {
+        QJsonObject j;
+        j["op"] = q.op;
+        j["duration_ms"] = double(q.durationNs) / 1e6;
+        j["sql"] = q.sql;
+        j["params"] = QJsonArray::fromStringList(q.params);
+        j["at"] = QDateTime::fromMSecsSinceEpoch(q.atMs, Qt::UTC).toString(Qt::ISODateWithMs);
+        slow.append(j);
+    }
+    QJsonObject root;
+    root["slow_threshold_ms"] = s.slowThresholdMs;
+    root["slow_total"] = s.slowTotal;
+    root["ops"] = ops;
+    root["slow"] = slow;
+    return QJsonDocument(root).toJson(QJsonDocument::Indented);
+}
+
+QueryScope::QueryScope(QueryStats *stats, const char *op, QueryScope **current)
+    : m_stats(stats && stats->enabled() ? stats : nullptr), m_op(op), m_current(current) {
+    if (!m_stats) return;
+    m_previous = *m_current;
+    *m_current = this;
+    m_timer.start();
+}
+
+QueryScope::~QueryScope() {
+    if (!m_stats) return;
+    const qint64 ns = m_timer.nsecsElapsed();
+    *m_current = m_previous;
+    m_stats->recordOp(m_op, ns, m_rows, m_sql, m_params);
+}
+
+void QueryScope::noteStatement(const QSqlQuery &q) {
+    if (!q.isSelect()) m_rows += std::max(0, q.numRowsAffected());
+    // Неявно разделяемые данные: копируются только счётчики ссылок, не сам текст и не BLOB
+    m_sql = q.lastQuery();
+    m_params = q.boundValues();
+}
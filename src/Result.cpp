@@ -0,0 +1,73 @@
+// Result.cpp — коды ошибок из расширенных кодов SQLite и соответствие исключениям Errors::*
+#include "Result.h"
+#include "Errors.h"
+
+#include <QtSql/QSqlError>
+
+namespace {
+// Расширенные коды результата SQLite (драйвер QSQLITE включает их при открытии)
+constexpr int SQLITE_BUSY = 5;
+constexpr int SQLITE_LOCKED = 6;
+constexpr int SQLITE_CONSTRAINT = 19;
+constexpr int SQLITE_CONSTRAINT_PRIMARYKEY = 1555;
+constexpr int SQLITE_CONSTRAINT_UNIQUE = 2067;
+constexpr int SQLITE_CONSTRAINT_FOREIGNKEY = 787;
+}
+
+const char *errorCodeName(ErrorCode code) {
+    switch (code) {
+    case ErrorCode::DuplicateName: return "DuplicateName";
+    case ErrorCode::InvalidName: return "InvalidName";
+    case ErrorCode::NotFound: return "NotFound";
+    case ErrorCode::MoveIntoDescendant: return "MoveIntoDescendant";
+    case ErrorCode::Busy: return "Busy";
+    case ErrorCode::Constraint: return "Constraint";
+    case ErrorCode::Db: return "Db";
+    }
+    return "Unknown";
+}
+
+void throwError(const Error &error) {
+    const std::string message = error.message.toStdString();
+    switch (error.code) {
+    case ErrorCode::DuplicateName: throw Errors::DuplicateName(message);
+    case ErrorCode::InvalidName: throw Errors::InvalidName(message);
+    case ErrorCode::NotFound: throw Errors::NotFound(message);
+    case ErrorCode::MoveIntoDescendant: throw Errors::MoveIntoDescendant(message);
+    case ErrorCode::Busy:
+    case ErrorCode::Constraint:
+    case ErrorCode::Db:
+        break;
+    }
+    throw Errors::DbError(message);
+}
+
+ErrorCode classifySqlError(const QSqlError &error) {
+    bool ok = false;
+    const int code = error.nativeErrorCode().toInt(&ok);
+    if (!ok) return ErrorCode::Db;
+    switch (code) {
+    case SQLITE_CONSTRAINT_UNIQUE:
+        return ErrorCode::DuplicateName;
+    case SQLITE_CONSTRAINT_PRIMARYKEY:
+        return ErrorCode::Constraint;
+    case SQLITE_CONSTRAINT_FOREIGNKEY:
+        return ErrorCode::NotFound;
+    default:
+        break;
+    }
+    // Младший байт — основной код (если расширенные коды выключены, приходит только он)
+    switch (code & 0xff) {
+    case SQLITE_BUSY:
+    case SQLITE_LOCKED:
+        return ErrorCode::Busy;
+    case SQLITE_CONSTRAINT:
+        return ErrorCode::Constraint;
+    default:
+        return ErrorCode::Db;
+    }
+}
+
+Error sqlError(const QSqlError &error) {
+    return Error{classifySqlError(error), error.text()};
+}
@@ -0,0 +1,785 @@
+// ShardedNodeRepository.cpp — маршрутизация по шардам с проверкой в файле, слияние детей корня, перенос поддерева через ATTACH
+#include "ShardedNodeRepository.h"
+#include "Db.h"
+#include "Errors.h"
+#include "NameKeys.h"
+#include "SortKey.h"
+#include "SqlTransaction.h"
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QVariant>
+#include <QDebug>
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+namespace {
+
+constexpr qint64 ROOT_ID = 1;
+// Имя схемы файла-источника на соединении приёмника на время переноса
+constexpr const char *MOVE_SOURCE_SCHEMA = "shard_src";
+
+bool isRoot(qint64 id) {
+    return id == ROOT_ID;
+}
+
+// Ключ сортировки детей так же, как orderClause в SqliteNodeRepository (затем — имя)
+QString orderKey(const RepoRow &row, ChildOrder order) {
+    switch (order) {
+    case ChildOrder::Manual: return row.sortKey;
+    case ChildOrder::CaseInsensitive: return NameKeys::fold(row.name);
+    case ChildOrder::Natural: return NameKeys::natural(row.name);
+    case ChildOrder::ByName: break;
+    }
+    return QString();
+}
+
+bool lessInOrder(const RepoRow &a, const RepoRow &b, ChildOrder order) {
+    const int c = QString::compare(orderKey(a, order), orderKey(b, order));
+    if (c != 0) return c < 0;
+    return a.name < b.name;
+}
+
+QString quoted(const QString &identifier) {
+    return '"' + QString(identifier).replace('"', "\"\"") + '"';
+}
+
+// Ошибка переноса между шардами: текст и код берутся до отката
+struct MoveFailed {
+    Error error;
+};
+
+void execOrFail(QSqlQuery &q) {
+    if (!q.exec()) throw MoveFailed{sqlError(q.lastError())};
+}
+
+void execOrFail(QSqlDatabase &db, const QString &sql) {
+    QSqlQuery q(db);
+    if (!q.exec(sql)) throw MoveFailed{sqlError(q.lastError())};
+}
+
+class ShardedNodeRepository final : public INodeRepository {
+public:
+    explicit ShardedNodeRepository(const ShardedRepoOptions &options) {
+        std::vector<ShardSpec> specs;
+        specs.push_back(ShardSpec{options.homePath, {}});
+        specs.insert(specs.end(), options.shards.begin(), options.shards.end());
+        try {
+            for (size_t k = 0; k < specs.size(); ++k) {
+                // Сначала в список: при ошибке открытия closeAll закроет и это соединение
+                Shard &shard = m_shards.emplace_back();
+                shard.path = specs[k].path;
+                shard.topLevelNames = specs[k].topLevelNames;
+                shard.connection = QString("%1_%2").arg(options.connectionPrefix).arg(k);
+                Db::openAndInit(shard.connection, shard.path);
+                RepoOptions repoOptions = options.repo;
+                repoOptions.idBase = qint64(k) * SHARD_ID_SPAN;
+                repoOptions.idSpan = SHARD_ID_SPAN;
+                shard.repo = makeSqliteNodeRepository(QSqlDatabase::database(shard.connection, false), repoOptions);
+                connect(shard.repo.get(), &INodeRepository::treeMapChanged, this, &INodeRepository::treeMapChanged);
+            }
+            loadRelocations();
+        } catch (...) {
+            closeAll();
+            throw;
+        }
+    }
+
+    ~ShardedNodeRepository() override {
+        closeAll();
+    }
+
+    Result<qint64> tryInsert(qint64 parentId, const QString &name, const std::optional<QString> &payload) override {
+        if (!isRoot(parentId)) return repoOf(shardOf(parentId)).tryInsert(parentId, name, payload);
+        if (rootNameTaken(name, 0)) return Error{ErrorCode::DuplicateName, "Duplicate name among top-level nodes"};
+        const int shard = shardForTopLevel(name);
+        Result<qint64> inserted = repoOf(shard).tryInsert(ROOT_ID, name, payload);
+        if (inserted) alignRootSortKey(shard, inserted.value());
+        return inserted;
+    }
+
+    Result<void> tryUpdateName(qint64 id, const QString &newName) override {
+        const int shard = shardOf(id);
+        const auto parent = repoOf(shard).getParentId(id);
+        if (parent.has_value() && isRoot(*parent) && rootNameTaken(newName, id)) {
+            return Error{ErrorCode::DuplicateName, "Duplicate name among top-level nodes"};
+        }
+        return repoOf(shard).tryUpdateName(id, newName);
+    }
+
+    void updateParent(qint64 id, qint64 newParentId) override {
+        const int src = shardOf(id);
+        const int dst = targetShard(id, src, newParentId);
+        if (src == dst) {
+            if (isRoot(newParentId)) checkRootName(id, src).valueOrThrow();
+            repoOf(src).updateParent(id, newParentId);
+            return;
+        }
+        moveAcross(id, src, dst, newParentId, repoOf(src).sortKeyOf(id)).valueOrThrow();
+    }
+
+    void remove(qint64 id) override {
+        repoOf(shardOf(id)).remove(id);
+        m_relocated.erase(id);
+    }
+
+    void removeMany(const std::vector<qint64> &ids) override {
+        for (const auto &[shard, group] : groupByShard(ids)) repoOf(shard).removeMany(group);
+        for (const qint64 id : ids) m_relocated.erase(id);
+    }
+
+    std::optional<RepoRow> get(qint64 id) override {
+        return repoOf(shardOf(id)).get(id);
+    }
+
+    std::optional<RepoRow> getMeta(qint64 id) override {
+        return repoOf(shardOf(id)).getMeta(id);
+    }
+
+    std::optional<RepoRow> findChildByName(qint64 parentId, const QString &name, NameMatch match) override {
+        if (!isRoot(parentId)) return repoOf(shardOf(parentId)).findChildByName(parentId, name, match);
+        // Без учёта регистра первым идёт точное совпадение — как в одном файле
+        std::optional<RepoRow> first;
+        for (Shard &shard : m_shards) {
+            auto row = shard.repo->findChildByName(ROOT_ID, name, match);
+            if (!row.has_value()) continue;
+            if (row->name == name) return row;
+            if (!first.has_value()) first = std::move(row);
+        }
+        return first;
+    }
+
+    std::vector<RepoRow> getChildren(qint64 parentId) override {
+        if (!isRoot(parentId)) return repoOf(shardOf(parentId)).getChildren(parentId);
+        std::vector<RepoRow> rows;
+        for (Shard &shard : m_shards) append(rows, shard.repo->getChildren(ROOT_ID));
+        sortRows(rows, ChildOrder::ByName);
+        return rows;
+    }
+
+    std::vector<RepoRow> getChildrenPage(qint64 parentId, ChildOrder order, qint64 limit, qint64 offset) override {
+        if (!isRoot(parentId)) return repoOf(shardOf(parentId)).getChildrenPage(parentId, order, limit, offset);
+        // Страница слияния: из каждого файла — первые offset + limit в том же порядке
+        const qint64 head = limit < 0 ? qint64(-1) : offset + limit;
+        std::vector<RepoRow> rows;
+        for (Shard &shard : m_shards) append(rows, shard.repo->getChildrenPage(ROOT_ID, order, head, 0));
+        sortRows(rows, order);
+        return slice(std::move(rows), offset, limit);
+    }
+
+    std::vector<RepoRow> getChildrenFrom(qint64 parentId, ChildOrder order, qint64 anchorId,
+                                         PageDirection direction, qint64 limit) override {
+        if (!isRoot(parentId)) {
+            return repoOf(shardOf(parentId)).getChildrenFrom(parentId, order, anchorId, direction, limit);
+        }
+        // Верхний уровень собирается из всех файлов (и он невелик) — окно по позиции якоря в слиянии
+        const auto parent = getParentId(anchorId);
+        if (!parent.has_value() || !isRoot(*parent)) return {};
+        const qint64 position = childPosition(anchorId, order);
+        if (position < 0) return {};
+        if (direction == PageDirection::After) return getChildrenPage(ROOT_ID, order, limit, position + 1);
+        const qint64 start = limit < 0 ? 0 : std::max<qint64>(0, position - limit);
+        return getChildrenPage(ROOT_ID, order, position - start, start);
+    }
+
+    qint64 childPosition(qint64 id, ChildOrder order) override {
+        const int shard = shardOf(id);
+        const qint64 local = repoOf(shard).childPosition(id, order);
+        if (local < 0 || m_shards.size() == 1) return local;
+        const auto parent = repoOf(shard).getParentId(id);
+        if (!parent.has_value() || !isRoot(*parent)) return local;
+        const auto row = repoOf(shard).get(id);
+        if (!row.has_value()) return -1;
+        qint64 position = local;
+        for (size_t k = 0; k < m_shards.size(); ++k) {
+            if (int(k) == shard) continue;
+            for (const RepoRow &other : m_shards[k].repo->getChildrenPage(ROOT_ID, order, -1, 0)) {
+                if (lessInOrder(other, *row, order)) ++position;
+            }
+        }
+        return position;
+    }
+
+    std::vector<SubtreeRow> getSubtree(qint64 rootId, int maxDepth, qint64 limit) override {
+        if (!isRoot(rootId)) return repoOf(shardOf(rootId)).getSubtree(rootId, maxDepth, limit);
+        std::vector<SubtreeRow> rows;
+        for (Shard &shard : m_shards) append(rows, shard.repo->getSubtree(ROOT_ID, maxDepth, limit));
+        // Порядок одного файла: уровень, родитель, ручной ключ, имя
+        std::stable_sort(rows.begin(), rows.end(), [](const SubtreeRow &a, const SubtreeRow &b) {
+            if (a.depth != b.depth) return a.depth < b.depth;
+            if (a.row.parentId != b.row.parentId) return a.row.parentId < b.row.parentId;
+            return lessInOrder(a.row, b.row, ChildOrder::Manual);
+        });
+        if (limit >= 0 && qint64(rows.size()) > limit) rows.resize(size_t(limit));
+        return rows;
+    }
+
+    qint64 countSubtree(qint64 rootId, int maxDepth, qint64 limit) override {
+        if (!isRoot(rootId)) return repoOf(shardOf(rootId)).countSubtree(rootId, maxDepth, limit);
+        qint64 total = 0;
+        for (Shard &shard : m_shards) {
+            if (limit >= 0 && total >= limit) break;
+            total += shard.repo->countSubtree(ROOT_ID, maxDepth, limit < 0 ? limit : limit - total);
+        }
+        return total;
+    }
+
+    std::vector<SubtreeRow> getChildrenOfMany(const std::vector<qint64> &parentIds, ChildOrder order) override {
+        std::map<int, std::vector<qint64>> groups;
+        bool withRoot = false;
+        for (const qint64 id : parentIds) {
+            if (isRoot(id)) withRoot = true;
+            else groups[shardOf(id)].push_back(id);
+        }
+        if (withRoot) {
+            for (size_t k = 0; k < m_shards.size(); ++k) groups[int(k)].push_back(ROOT_ID);
+        }
+        std::vector<SubtreeRow> rows;
+        for (const auto &[shard, group] : groups) append(rows, repoOf(shard).getChildrenOfMany(group, order));
+        if (groups.size() > 1) {
+            std::stable_sort(rows.begin(), rows.end(), [order](const SubtreeRow &a, const SubtreeRow &b) {
+                if (a.row.parentId != b.row.parentId) return a.row.parentId < b.row.parentId;
+                return lessInOrder(a.row, b.row, order);
+            });
+        }
+        return rows;
+    }
+
+    std::vector<RepoRow> scanChildrenByName(qint64 parentId, const QString &from, bool inclusive,
+                                            const QString &to, int limit) override {
+        if (!isRoot(parentId)) return repoOf(shardOf(parentId)).scanChildrenByName(parentId, from, inclusive, to, limit);
+        std::vector<RepoRow> rows;
+        for (Shard &shard : m_shards) append(rows, shard.repo->scanChildrenByName(ROOT_ID, from, inclusive, to, limit));
+        sortRows(rows, ChildOrder::ByName);
+        return slice(std::move(rows), 0, limit);
+    }
+
+    QString sortKeyOf(qint64 id) override {
+        return repoOf(shardOf(id)).sortKeyOf(id);
+    }
+
+    QString neighborSortKey(qint64 parentId, const QString &key, bool after, qint64 excludeId) override {
+        if (!isRoot(parentId)) return repoOf(shardOf(parentId)).neighborSortKey(parentId, key, after, excludeId);
+        QString nearest;
+        for (Shard &shard : m_shards) {
+            const QString candidate = shard.repo->neighborSortKey(ROOT_ID, key, after, excludeId);
+            if (candidate.isEmpty()) continue;
+            if (nearest.isEmpty() || (after ? candidate < nearest : candidate > nearest)) nearest = candidate;
+        }
+        return nearest;
+    }
+
+    QString lastSortKey(qint64 parentId, qint64 excludeId) override {
+        if (!isRoot(parentId)) return repoOf(shardOf(parentId)).lastSortKey(parentId, excludeId);
+        QString last;
+        for (Shard &shard : m_shards) last = std::max(last, shard.repo->lastSortKey(ROOT_ID, excludeId));
+        return last;
+    }
+
+    Result<void> tryMoveTo(qint64 id, qint64 newParentId, const QString &sortKey) override {
+        const int src = shardOf(id);
+        const int dst = targetShard(id, src, newParentId);
+        if (src != dst) return moveAcross(id, src, dst, newParentId, sortKey);
+        if (isRoot(newParentId)) {
+            if (Result<void> name = checkRootName(id, src); !name) return name;
+        }
+        return repoOf(src).tryMoveTo(id, newParentId, sortKey);
+    }
+
+    Result<void> tryMoveManyTo(const std::vector<std::pair<qint64, QString>> &idKeys, qint64 newParentId) override {
+        if (idKeys.size() == 1) return tryMoveTo(idKeys.front().first, newParentId, idKeys.front().second);
+        if (idKeys.empty()) return {};
+        // Пачка атомарна только внутри одного файла: если она затрагивает несколько файлов (узлы из разных
+        // шардов или перенос между шардами), она отклоняется целиком и ничего не перемещается
+        const int shard = shardOf(idKeys.front().first);
+        for (const auto &idKey : idKeys) {
+            const int src = shardOf(idKey.first);
+            if (src != shard || targetShard(idKey.first, src, newParentId) != shard) {
+                return Error{ErrorCode::Constraint, "Batch move spans several shard files"};
+            }
+        }
+        if (isRoot(newParentId)) {
+            for (const auto &idKey : idKeys) {
+                if (Result<void> name = checkRootName(idKey.first, shard); !name) return name;
+            }
+        }
+        return repoOf(shard).tryMoveManyTo(idKeys, newParentId);
+    }
+
+    void assignSortKeys(const std::vector<std::pair<qint64, QString>> &keys) override {
+        std::map<int, std::vector<std::pair<qint64, QString>>> groups;
+        for (const auto &idKey : keys) groups[shardOf(idKey.first)].push_back(idKey);
+        for (const auto &[shard, group] : groups) repoOf(shard).assignSortKeys(group);
+    }
+
+    std::vector<std::pair<qint64, qint64>> findUnkeyedRows(qint64 afterRowId, int limit) override {
+        // rowid = id, а id уникальны по всем файлам: курсор общий
+        std::vector<std::pair<qint64, qint64>> rows;
+        for (Shard &shard : m_shards) append(rows, shard.repo->findUnkeyedRows(afterRowId, limit));
+        std::sort(rows.begin(), rows.end());
+        if (limit >= 0 && int(rows.size()) > limit) rows.resize(size_t(limit));
+        return rows;
+    }
+
+    int backfillNameKeys(int limit) override {
+        int done = 0;
+        for (Shard &shard : m_shards) {
+            if (done >= limit) break;
+            done += shard.repo->backfillNameKeys(limit - done);
+        }
+        return done;
+    }
+
+    std::optional<qint64> getParentId(qint64 id) override {
+        return repoOf(shardOf(id)).getParentId(id);
+    }
+
+    std::vector<qint64> getAncestorIds(qint64 id) override {
+        // Поддерево целиком в одном файле, цепочка кончается его корнем (id = 1 — общий корень)
+        return repoOf(shardOf(id)).getAncestorIds(id);
+    }
+
+    bool hasChildren(qint64 id) override {
+        if (!isRoot(id)) return repoOf(shardOf(id)).hasChildren(id);
+        for (Shard &shard : m_shards) {
+            if (shard.repo->hasChildren(ROOT_ID)) return true;
+        }
+        return false;
+    }
+
+    void setPayload(qint64 id, const QString &payloadJson) override {
+        repoOf(shardOf(id)).setPayload(id, payloadJson);
+    }
+
+    std::optional<QString> getPayload(qint64 id) override {
+        return repoOf(shardOf(id)).getPayload(id);
+    }
+
+    std::unordered_map<qint64, QString> getPayloads(const std::vector<qint64> &ids) override {
+        std::unordered_map<qint64, QString> out;
+        for (const auto &[shard, group] : groupByShard(ids)) out.merge(repoOf(shard).getPayloads(group));
+        return out;
+    }
+
+    PayloadStats payloadStats() override {
+        PayloadStats total;
+        for (Shard &shard : m_shards) {
+            const PayloadStats s = shard.repo->payloadStats();
+            total.nodesWithPayload += s.nodesWithPayload;
+            total.inlinePayloads += s.inlinePayloads;
+            total.sharedBlobs += s.sharedBlobs;
+            total.logicalBytes += s.logicalBytes;
+            total.storedBytes += s.storedBytes;
+            total.compressedPayloads += s.compressedPayloads;
+        }
+        return total;
+    }
+
+    int collectPayloadGarbage() override {
+        int removed = 0;
+        for (Shard &shard : m_shards) removed += shard.repo->collectPayloadGarbage();
+        return removed;
+    }
+
+    int dedupInlinePayloads(int limit) override {
+        int moved = 0;
+        for (Shard &shard : m_shards) {
+            if (moved >= limit) break;
+            moved += shard.repo->dedupInlinePayloads(limit - moved);
+        }
+        return moved;
+    }
+
+    bool compressPayloadBatch(PayloadCompactCursor &cursor, int limit) override {
+        // Файлы по очереди: cursor.shard — текущий файл, table/lastRowId — позиция в нём
+        if (cursor.shard < int(m_shards.size())) {
+            PayloadCompactCursor local;
+            local.table = cursor.table;
+            local.lastRowId = cursor.lastRowId;
+            if (m_shards[size_t(cursor.shard)].repo->compressPayloadBatch(local, limit)) {
+                cursor.table = local.table;
+                cursor.lastRowId = local.lastRowId;
+                return true;
+            }
+            ++cursor.shard;
+            cursor.table = 0;
+            cursor.lastRowId = 0;
+            if (cursor.shard < int(m_shards.size())) return true;
+        }
+        cursor.table = 2;
+        return false;
+    }
+
+private:
+    struct Shard {
+        QString path;
+        QString connection;
+        QStringList topLevelNames;
+        std::unique_ptr<INodeRepository> repo;
+    };
+
+    INodeRepository &repoOf(int shard) {
+        return *m_shards[size_t(shard)].repo;
+    }
+
+    int rangeShard(qint64 id) const {
+        const qint64 shard = id / SHARD_ID_SPAN;
+        return shard > 0 && shard < qint64(m_shards.size()) ? int(shard) : 0;
+    }
+
+    // Файл узла: маршрут экземпляра (диапазон id или запомненный перенос) проверяется в самом файле.
+    // Промах — узел перенесли другим экземпляром после открытия этого: поиск во всех файлах.
+    // С одним файлом проверки нет
+    int shardOf(qint64 id) {
+        const auto it = m_relocated.find(id);
+        const int routed = it != m_relocated.end() ? it->second : rangeShard(id);
+        if (isRoot(id) || m_shards.size() == 1 || repoOf(routed).getParentId(id).has_value()) return routed;
+        const int found = locate(id);
+        return found < 0 ? routed : found;
+    }
+
+    int shardForTopLevel(const QString &name) const {
+        for (size_t k = 1; k < m_shards.size(); ++k) {
+            if (m_shards[k].topLevelNames.contains(name)) return int(k);
+        }
+        return 0;
+    }
+
+    // Файл, где узел окажется под newParentId: в корне — по имени узла, иначе — файл родителя
+    int targetShard(qint64 id, int src, qint64 newParentId) {
+        if (!isRoot(newParentId)) return shardOf(newParentId);
+        const auto row = repoOf(src).get(id);
+        return row.has_value() ? shardForTopLevel(row->name) : src;
+    }
+
+    int locate(qint64 id) {
+        for (size_t k = 0; k < m_shards.size(); ++k) {
+            if (m_shards[k].repo->getParentId(id).has_value()) {
+                rememberShard(id, int(k));
+                return int(k);
+            }
+        }
+        return -1;
+    }
+
+    void rememberShard(qint64 id, int shard) {
+        if (rangeShard(id) == shard) m_relocated.erase(id);
+        else m_relocated[id] = shard;
+    }
+
+    bool rootNameTaken(const QString &name, qint64 excludeId) {
+        for (Shard &shard : m_shards) {
+            const auto row = shard.repo->findChildByName(ROOT_ID, name, NameMatch::Exact);
+            if (row.has_value() && row->id != excludeId) return true;
+        }
+        return false;
+    }
+
+    Result<void> checkRootName(qint64 id, int shard) {
+        const auto row = repoOf(shard).get(id);
+        if (!row.has_value()) return Error{ErrorCode::NotFound, "Node not found"};
+        if (rootNameTaken(row->name, id)) return Error{ErrorCode::DuplicateName, "Duplicate name among top-level nodes"};
+        return {};
+    }
+
+    // Новый узел верхнего уровня — в конец общего ручного порядка, а не только своего файла
+    void alignRootSortKey(int shard, qint64 id) {
+        QString last;
+        for (Shard &s : m_shards) last = std::max(last, s.repo->lastSortKey(ROOT_ID, id));
+        if (repoOf(shard).sortKeyOf(id) > last) return;
+        repoOf(shard).assignSortKeys({{id, SortKey::between(last, QString())}});
+    }
+
+    std::map<int, std::vector<qint64>> groupByShard(const std::vector<qint64> &ids) {
+        std::map<int, std::vector<qint64>> groups;
+        for (const qint64 id : ids) groups[shardOf(id)].push_back(id);
+        return groups;
+    }
+
+    template <typename T>
+    static void append(std::vector<T> &to, std::vector<T> &&from) {
+        to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+    }
+
+    static void sortRows(std::vector<RepoRow> &rows, ChildOrder order) {
+        std::stable_sort(rows.begin(), rows.end(), [order](const RepoRow &a, const RepoRow &b) {
+            return lessInOrder(a, b, order);
+        });
+    }
+
+    static std::vector<RepoRow> slice(std::vector<RepoRow> rows, qint64 offset, qint64 limit) {
+        const size_t from = size_t(std::min<qint64>(std::max<qint64>(offset, 0), qint64(rows.size())));
+        rows.erase(rows.begin(), rows.begin() + qint64(from));
+        if (limit >= 0 && qint64(rows.size()) > limit) rows.resize(size_t(limit));
+        return rows;
+    }
+
+    // Узлы не из диапазона своего файла — перенесённые между шардами. Тот же id ещё в одном файле (в том
+    // числе в файле-владельце диапазона) — перенос прервался между фиксациями: предупреждение в журнале,
+    // маршрут — на перенесённую копию
+    void loadRelocations() {
+        for (size_t k = 0; k < m_shards.size(); ++k) {
+            std::vector<qint64> ids;
+            {
+                QSqlQuery q(QSqlDatabase::database(m_shards[k].connection, false));
+                q.prepare("SELECT id FROM nodes WHERE (id < ? OR id >= ?) AND id <> 1");
+                q.addBindValue(qint64(k) * SHARD_ID_SPAN);
+                q.addBindValue(qint64(k + 1) * SHARD_ID_SPAN);
+                if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+                while (q.next()) ids.push_back(q.value(0).toLongLong());
+            }
+            for (const qint64 id : ids) {
+                const auto it = m_relocated.find(id);
+                const int other = it != m_relocated.end() ? it->second : rangeShard(id);
+                if (other != int(k) && repoOf(other).getParentId(id).has_value()) {
+                    qWarning() << "Node" << id << "is present in shards" << other << "and" << k
+                               << "(interrupted cross-shard move)";
+                }
+                if (it == m_relocated.end()) rememberShard(id, int(k));
+            }
+        }
+    }
+
+    static QStringList columnsOf(QSqlDatabase &db, const QString &schema, const QString &table) {
+        QSqlQuery q(db);
+        if (!q.exec(QString("PRAGMA %1.table_info(%2)").arg(schema, quoted(table)))) {
+            throw MoveFailed{sqlError(q.lastError())};
+        }
+        QStringList out;
+        while (q.next()) out << q.value(1).toString();
+        return out;
+    }
+
+    // Колонки, которые есть в обоих файлах (версии схемы совпадают, но файлы могли создаваться по-разному)
+    static QStringList commonColumns(QSqlDatabase &db, const QString &table) {
+        const QStringList source = columnsOf(db, MOVE_SOURCE_SCHEMA, table);
+        QStringList out;
+        for (const QString &column : columnsOf(db, "main", table)) {
+            if (source.contains(column)) out << column;
+        }
+        return out;
+    }
+
+    // Порядок фиксаций такой, что сбой не теряет поддерево: запись в источник блокируется (BEGIN IMMEDIATE)
+    // на весь перенос, копия пишется и фиксируется на соединении приёмника (источник — через ATTACH), затем
+    // вторая транзакция источника поднимает границу id (id_floors) и удаляет оригинал. Сбой между
+    // фиксациями оставляет поддерево в двух файлах (loadRelocations предупредит), а не ни в одном
+    Result<void> moveAcross(qint64 id, int src, int dst, qint64 newParentId, const QString &sortKey) {
+        QSqlDatabase source = QSqlDatabase::database(m_shards[size_t(src)].connection, false);
+        QSqlDatabase target = QSqlDatabase::database(m_shards[size_t(dst)].connection, false);
+        // ATTACH/DETACH внутри транзакции невозможны
+        if (SqlTx::depth(source) > 0 || SqlTx::depth(target) > 0) {
+            return Error{ErrorCode::Db, "Cross-shard move inside an open transaction"};
+        }
+        const auto node = repoOf(src).get(id);
+        if (!node.has_value()) return Error{ErrorCode::NotFound, "Node not found"};
+        if (!isRoot(newParentId) && !repoOf(dst).get(newParentId).has_value()) {
+            return Error{ErrorCode::NotFound, "Parent not found"};
+        }
+        const bool taken = isRoot(newParentId) ? rootNameTaken(node->name, id)
+                                               : repoOf(dst).findChildByName(newParentId, node->name).has_value();
+        if (taken) return Error{ErrorCode::DuplicateName, "Duplicate name in target parent"};
+
+        // Пока идёт копия, другие писатели не меняют поддерево в источнике
+        {
+            QSqlQuery lock(source);
+            if (!lock.exec("BEGIN IMMEDIATE")) return sqlError(lock.lastError());
+        }
+        {
+            QSqlQuery attach(target);
+            attach.prepare(QString("ATTACH DATABASE ? AS %1").arg(QString(MOVE_SOURCE_SCHEMA)));
+            attach.addBindValue(m_shards[size_t(src)].path);
+            if (!attach.exec()) {
+                const Error error = sqlError(attach.lastError());
+                QSqlQuery(source).exec("ROLLBACK");
+                return error;
+            }
+        }
+        std::vector<qint64> moved;
+        Result<void> result;
+        try {
+            moved = copySubtree(target, id, newParentId, sortKey);
+        } catch (const MoveFailed &failed) {
+            result = failed.error;
+        } catch (const std::exception &ex) {
+            result = Error{ErrorCode::Db, QString::fromUtf8(ex.what())};
+        }
+        QSqlQuery(target).exec(QString("DETACH DATABASE %1").arg(QString(MOVE_SOURCE_SCHEMA)));
+        if (result) result = dropOriginal(source, src, id, moved);
+        if (!result) {
+            QSqlQuery(source).exec("ROLLBACK");
+            // Оригинал на месте: зафиксированная копия убирается (каскад — поддерево и вложения)
+            if (!moved.empty() && !dropCopy(target, id)) {
+                qWarning() << "Node" << id << "is present in shards" << src << "and" << dst << "(failed cross-shard move)";
+            }
+            return result;
+        }
+
+        for (const qint64 movedId : moved) rememberShard(movedId, dst);
+        emit treeMapChanged();
+        return {};
+    }
+
+    // Транзакция соединения приёмника: payload, узлы (родители раньше детей), вложения с фрагментами
+    // из подключённого источника. Возвращает id перенесённых узлов (после фиксации).
+    std::vector<qint64> copySubtree(QSqlDatabase &db, qint64 id, qint64 newParentId, const QString &sortKey) {
+        if (!SqlTx::begin(db)) throw MoveFailed{sqlError(db.lastError())};
+        try {
+            const QString source = MOVE_SOURCE_SCHEMA;
+            execOrFail(db, "CREATE TEMP TABLE IF NOT EXISTS shard_move(id INTEGER PRIMARY KEY, depth INTEGER NOT NULL)");
+            execOrFail(db, "DELETE FROM temp.shard_move");
+            QSqlQuery sub(db);
+            sub.prepare(QString("INSERT INTO temp.shard_move(id, depth) WITH RECURSIVE s(id, depth) AS ("
+                                " SELECT ?, 0"
+                                " UNION ALL"
+                                " SELECT n.id, s.depth + 1 FROM %1.nodes n JOIN s ON n.parent_id = s.id WHERE s.depth < ?"
+                                ") SELECT id, depth FROM s")
+                            .arg(source));
+            sub.addBindValue(id);
+            sub.addBindValue(MAX_TREE_DEPTH);
+            execOrFail(sub);
+            // Обход упёрся в предел глубины: часть поддерева не скопировалась бы, а удаление унесло бы её
+            QSqlQuery deep(db);
+            deep.prepare(QString("SELECT 1 FROM temp.shard_move m JOIN %1.nodes n ON n.parent_id = m.id"
+                                 " WHERE m.depth >= ? LIMIT 1")
+                             .arg(source));
+            deep.addBindValue(MAX_TREE_DEPTH);
+            execOrFail(deep);
+            if (deep.next()) throw MoveFailed{Error{ErrorCode::Constraint, "Subtree is deeper than MAX_TREE_DEPTH"}};
+
+            const QStringList payloadColumns = commonColumns(db, "payloads");
+            QSqlQuery payloads(db);
+            payloads.prepare(QString("INSERT OR IGNORE INTO main.payloads(%2) SELECT %2 FROM %1.payloads"
+                                     " WHERE hash IN (SELECT n.payload_hash FROM %1.nodes n JOIN temp.shard_move m ON m.id = n.id"
+                                     " WHERE n.payload_hash IS NOT NULL)")
+                                 .arg(source, payloadColumns.join(", ")));
+            execOrFail(payloads);
+
+            const QStringList columns = commonColumns(db, "nodes");
+            QStringList nodeColumns;
+            QStringList nodeValues;
+            for (const QString &column : columns) {
+                nodeColumns << quoted(column);
+                if (column == "parent_id") nodeValues << "CASE WHEN n.id = ? THEN ? ELSE n.parent_id END";
+                else if (column == "sort_key") nodeValues << "CASE WHEN n.id = ? THEN ? ELSE n.sort_key END";
+                else nodeValues << "n." + quoted(column);
+            }
+            QSqlQuery nodes(db);
+            nodes.prepare(QString("INSERT INTO main.nodes(%2) SELECT %3 FROM %1.nodes n"
+                                  " JOIN temp.shard_move m ON m.id = n.id ORDER BY m.depth")
+                              .arg(source, nodeColumns.join(", "), nodeValues.join(", ")));
+            // Плейсхолдеры — в порядке колонок
+            for (const QString &column : columns) {
+                if (column == "parent_id") {
+                    nodes.addBindValue(id);
+                    nodes.addBindValue(newParentId);
+                } else if (column == "sort_key") {
+                    nodes.addBindValue(id);
+                    nodes.addBindValue(sortKey.isEmpty() ? QVariant(QVariant::String) : QVariant(sortKey));
+                }
+            }
+            execOrFail(nodes);
+
+            copyAttachments(db);
+
+            std::vector<qint64> moved;
+            QSqlQuery ids(db);
+            ids.prepare("SELECT id FROM temp.shard_move");
+            execOrFail(ids);
+            while (ids.next()) moved.push_back(ids.value(0).toLongLong());
+            ids.finish();
+            execOrFail(db, "DELETE FROM temp.shard_move");
+
+            if (!SqlTx::commit(db)) throw MoveFailed{sqlError(db.lastError())};
+            return moved;
+        } catch (...) {
+            SqlTx::rollback(db);
+            throw;
+        }
+    }
+
+    // id вложений в файлах независимы: в приёмнике вложение получает новый id, фрагменты идут за ним
+    void copyAttachments(QSqlDatabase &db) {
+        const QString source = MOVE_SOURCE_SCHEMA;
+        QStringList columns = commonColumns(db, "attachments");
+        columns.removeAll("id");
+        const QString list = columns.join(", ");
+        QSqlQuery select(db);
+        select.prepare(QString("SELECT a.id FROM %1.attachments a JOIN temp.shard_move m ON m.id = a.node_id").arg(source));
+        execOrFail(select);
+        std::vector<qint64> attachmentIds;
+        while (select.next()) attachmentIds.push_back(select.value(0).toLongLong());
+
+        for (const qint64 attachmentId : attachmentIds) {
+            QSqlQuery copy(db);
+            copy.prepare(QString("INSERT INTO main.attachments(%2) SELECT %2 FROM %1.attachments WHERE id = ?")
+                             .arg(source, list));
+            copy.addBindValue(attachmentId);
+            execOrFail(copy);
+            const qint64 newId = copy.lastInsertId().toLongLong();
+            QSqlQuery chunks(db);
+            chunks.prepare(QString("INSERT INTO main.attachment_chunks(attachment_id, seq, data)"
+                                   " SELECT ?, seq, data FROM %1.attachment_chunks WHERE attachment_id = ?")
+                               .arg(source));
+            chunks.addBindValue(newId);
+            chunks.addBindValue(attachmentId);
+            execOrFail(chunks);
+        }
+    }
+
+    // Вторая транзакция источника (открыта в moveAcross): граница id диапазона этого файла поднимается до
+    // ушедших id — в той же транзакции, что удаление, поэтому nextIdInRange любого экземпляра их не выдаст
+    Result<void> dropOriginal(QSqlDatabase &db, int shard, qint64 id, const std::vector<qint64> &moved) {
+        const qint64 base = qint64(shard) * SHARD_ID_SPAN;
+        qint64 floor = -1;
+        for (const qint64 movedId : moved) {
+            if (movedId >= base && movedId < base + SHARD_ID_SPAN) floor = std::max(floor, movedId);
+        }
+        if (floor >= 0) {
+            QSqlQuery raise(db);
+            raise.prepare("INSERT INTO id_floors(base, floor) VALUES(?, ?)"
+                          " ON CONFLICT(base) DO UPDATE SET floor = MAX(floor, excluded.floor)");
+            raise.addBindValue(base);
+            raise.addBindValue(floor);
+            if (!raise.exec()) return sqlError(raise.lastError());
+        }
+        QSqlQuery drop(db);
+        drop.prepare("DELETE FROM nodes WHERE id = ?");
+        drop.addBindValue(id);
+        if (!drop.exec()) return sqlError(drop.lastError());
+        QSqlQuery commit(db);
+        if (!commit.exec("COMMIT")) return sqlError(commit.lastError());
+        return {};
+    }
+
+    // Откат зафиксированной копии, если оригинал удалить не удалось; false — поддерево осталось в двух файлах
+    static bool dropCopy(QSqlDatabase &db, qint64 id) {
+        QSqlQuery drop(db);
+        drop.prepare("DELETE FROM nodes WHERE id = ?");
+        drop.addBindValue(id);
+        return drop.exec();
+    }
+
+    void closeAll() {
+        for (Shard &shard : m_shards) shard.repo.reset();
+        for (const Shard &shard : m_shards) {
+            {
+                QSqlDatabase db = QSqlDatabase::database(shard.connection, false);
+                if (db.isValid()) db.close();
+            }
+            QSqlDatabase::removeDatabase(shard.connection);
+        }
+        m_shards.clear();
+    }
+
+    std::vector<Shard> m_shards;               // 0 — основной файл
+    std::unordered_map<qint64, int> m_relocated; // id -> шард, если узел не в файле своего диапазона
+};
+
+}
+
+std::unique_ptr<INodeRepository> makeShardedNodeRepository(const ShardedRepoOptions &options) {
+    return std::make_unique<ShardedNodeRepository>(options);
+}
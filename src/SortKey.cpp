@@ -0,0 +1,59 @@
+// SortKey.cpp — середина между дробными ключами base-62
+#include "SortKey.h"
+
+namespace {
+
+const QString DIGITS = QStringLiteral("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
+constexpr int BASE = 62;
+
+int digitAt(const QString &key, int i) {
+    return i < key.size() ? int(DIGITS.indexOf(key.at(i))) : 0;
+}
+
+// lo < hi (пустой hi — бесконечность), оба без завершающего '0'
+QString midpoint(const QString &lo, const QString &hi) {
+    if (!hi.isEmpty()) {
+        // Общий префикс (недостающие цифры lo считаем нулями) переносим как есть
+        int n = 0;
+        while (n < hi.size() && digitAt(lo, n) == digitAt(hi, n)) ++n;
+        if (n > 0) {
+            return hi.left(n) + midpoint(lo.mid(n), hi.mid(n));
+        }
+    }
+    const int dLo = lo.isEmpty() ? 0 : digitAt(lo, 0);
+    const int dHi = hi.isEmpty() ? BASE : digitAt(hi, 0);
+    if (dHi - dLo > 1) {
+        return QString(DIGITS.at((dLo + dHi) / 2));
+    }
+    // Соседние цифры: либо укорачиваем hi до первой цифры, либо спускаемся на разряд ниже
+    if (hi.size() > 1) {
+        return hi.left(1);
+    }
+    return QString(DIGITS.at(dLo)) + midpoint(lo.mid(1), QString());
+}
+
+void fill(const QString &lo, const QString &hi, int count, QStringList &out) {
+    if (count <= 0) return;
+    const QString mid = midpoint(lo, hi);
+    const int left = (count - 1) / 2;
+    fill(lo, mid, left, out);
+    out << mid;
+    fill(mid, hi, count - 1 - left, out);
+}
+
+}
+
+namespace SortKey {
+
+QString between(const QString &lo, const QString &hi) {
+    return midpoint(lo, hi);
+}
+
+QStringList sequence(const QString &lo, const QString &hi, int count) {
+    QStringList out;
+    out.reserve(count);
+    fill(lo, hi, count, out);
+    return out;
+}
+
+}
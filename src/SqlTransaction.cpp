@@ -0,0 +1,71 @@
+// SqlTransaction.cpp — счётчик вложенности в свойстве драйвера и SAVEPOINT-ы
+#include "SqlTransaction.h"
+
+#include <QtSql/QSqlDriver>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+namespace {
+
+constexpr const char *DEPTH_PROPERTY = "sqlTxDepth";
+
+void setDepth(const QSqlDatabase &db, int depth) {
+    db.driver()->setProperty(DEPTH_PROPERTY, depth);
+}
+
+bool execSavepoint(const QSqlDatabase &db, const QString &sql) {
+    QSqlQuery q(db);
+    if (!q.exec(sql)) {
+        qWarning() << sql << "failed:" << q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+QString savepointName(int level) {
+    return QString("sp_tx_%1").arg(level);
+}
+
+}
+
+namespace SqlTx {
+
+int depth(const QSqlDatabase &db) {
+    return db.driver()->property(DEPTH_PROPERTY).toInt();
+}
+
+bool begin(const QSqlDatabase &db) {
+    const int d = depth(db);
+    const bool ok = d == 0 ? db.driver()->beginTransaction()
+                           : execSavepoint(db, "SAVEPOINT " + savepointName(d));
+    if (ok) setDepth(db, d + 1);
+    return ok;
+}
+
+bool commit(const QSqlDatabase &db) {
+    const int d = depth(db);
+    if (d <= 0) return false;
+    const bool ok = d == 1 ? db.driver()->commitTransaction()
+                           : execSavepoint(db, "RELEASE " + savepointName(d - 1));
+    if (ok) {
+        setDepth(db, d - 1);
+        return true;
+    }
+    // Неудачный COMMIT (например, BUSY) оставляет транзакцию открытой: уровень откатывается, чтобы глубина
+    // совпадала с соединением и следующий begin() не выдал второй BEGIN. Текст ошибки остаётся от COMMIT
+    rollback(db);
+    return false;
+}
+
+bool rollback(const QSqlDatabase &db) {
+    const int d = depth(db);
+    if (d <= 0) return false;
+    setDepth(db, d - 1);
+    if (d == 1) return db.driver()->rollbackTransaction();
+    const QString name = savepointName(d - 1);
+    return execSavepoint(db, "ROLLBACK TO " + name) && execSavepoint(db, "RELEASE " + name);
+}
+
+}
@@ -0,0 +1,287 @@
+// SqliteAttachmentRepository — потоковые вложения узлов поверх QtSql (порции в attachment_chunks)
+//
+// Ключевые моменты реализации:
+//  - QtSql не даёт доступа к incremental blob I/O SQLite, поэтому файл режется на порции
+//    фиксированного размера (chunk_size хранится у вложения). В памяти — не больше одной порции.
+//  - Запись целиком в одной транзакции: при ошибке источника или БД вложение не появляется.
+//  - SHA-256 считается по порциям во время записи; пока запись не завершена, sha256 IS NULL.
+//  - Чтение — QIODevice с произвольным доступом: порция выбирается по позиции (pos / chunk_size).
+#include "IAttachmentRepository.h"
+#include "Errors.h"
+#include "Result.h"
+#include "SqlTransaction.h"
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QVariant>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QIODevice>
+#include <QStringList>
+#include <cstring>
+
+// Размер порции: достаточно крупный для последовательного чтения, но без заметного расхода памяти
+static constexpr int CHUNK_SIZE = 256 * 1024;
+// Сколько id подставлять в один IN (...) — с запасом ниже лимита параметров SQLite
+static constexpr size_t IN_BATCH = 500;
+// Сколько ждать следующих данных последовательного источника (сокет, процесс), прежде чем считать запись сорванной
+static constexpr int SOURCE_READ_TIMEOUT_MS = 30000;
+
+static QString nowIso() {
+    return QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+}
+
+// Порция до size байт из source. Последовательное устройство без готовых данных — ждём их
+// (waitForReadyRead), а не считаем концом; ошибка чтения — DbError (транзакция записи откатится)
+static QByteArray readChunk(QIODevice &source, int size) {
+    QByteArray chunk(size, Qt::Uninitialized);
+    qint64 filled = 0;
+    while (filled < size) {
+        const qint64 n = source.read(chunk.data() + filled, size - filled);
+        if (n < 0) throw Errors::DbError(("Cannot read attachment source: " + source.errorString()).toStdString());
+        if (n > 0) {
+            filled += n;
+            continue;
+        }
+        if (source.isSequential() && !source.atEnd() && source.waitForReadyRead(SOURCE_READ_TIMEOUT_MS)) continue;
+        break;
+    }
+    chunk.resize(filled);
+    return chunk;
+}
+
+// Чтение вложения порциями по требованию
+class AttachmentReader final : public QIODevice {
+public:
+    AttachmentReader(QSqlDatabase db, qint64 attachmentId, qint64 size, int chunkSize)
+        : m_db(std::move(db)), m_attachmentId(attachmentId), m_size(size), m_chunkSize(chunkSize) {}
+
+    bool isSequential() const override { return false; }
+    qint64 size() const override { return m_size; }
+    bool atEnd() const override { return m_pos >= m_size; }
+
+    bool seek(qint64 pos) override {
+        if (pos < 0 || pos > m_size) return false;
+        QIODevice::seek(pos);
+        m_pos = pos;
+        return true;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override {
+        qint64 done = 0;
+        while (done < maxlen && m_pos < m_size) {
+            const qint64 seq = m_pos / m_chunkSize;
+            if (seq != m_chunkSeq && !loadChunk(seq)) {
+                return done > 0 ? done : -1;
+            }
+            const qint64 offset = m_pos - seq * m_chunkSize;
+            const qint64 n = qMin(maxlen - done, qint64(m_chunk.size()) - offset);
+            if (n <= 0) {
+                setErrorString("Attachment chunk is truncated");
+                return done > 0 ? done : -1;
+            }
+            std::memcpy(data + done, m_chunk.constData() + offset, size_t(n));
+            done += n;
+            m_pos += n;
+        }
+        return done;
+    }
+
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    QSqlDatabase m_db;
+    qint64 m_attachmentId;
+    qint64 m_size;
+    int m_chunkSize;
+    qint64 m_pos {0};
+    qint64 m_chunkSeq {-1};
+    QByteArray m_chunk;
+
+    bool loadChunk(qint64 seq) {
+        QSqlQuery q(m_db);
+        q.prepare("SELECT data FROM attachment_chunks WHERE attachment_id = ? AND seq = ?");
+        q.addBindValue(m_attachmentId);
+        q.addBindValue(seq);
+        if (!q.exec() || !q.next()) {
+            setErrorString(q.lastError().isValid() ? q.lastError().text() : QString("Attachment chunk is missing"));
+            return false;
+        }
+        m_chunk = q.value(0).toByteArray();
+        m_chunkSeq = seq;
+        return true;
+    }
+};
+
+class SqliteAttachmentRepository final : public IAttachmentRepository {
+public:
+    explicit SqliteAttachmentRepository(QSqlDatabase db)
+        : m_db(std::move(db)) {}
+
+    AttachmentInfo write(qint64 nodeId, const QString &name, QIODevice &source) override {
+        if (!source.isReadable()) {
+            throw Errors::DbError("Attachment source is not readable");
+        }
+        if (!SqlTx::begin(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        AttachmentInfo info;
+        try {
+            // Заменяем вложение с тем же именем (порции удалятся каскадно)
+            QSqlQuery del(m_db);
+            del.prepare("DELETE FROM attachments WHERE node_id = ? AND name = ?");
+            del.addBindValue(nodeId);
+            del.addBindValue(name);
+            if (!del.exec()) throw Errors::DbError(del.lastError().text().toStdString());
+
+            QSqlQuery ins(m_db);
+            ins.prepare("INSERT INTO attachments(node_id, name, size, sha256, chunk_size, created_at) VALUES(?, ?, 0, NULL, ?, ?)");
+            ins.addBindValue(nodeId);
+            ins.addBindValue(name);
+            ins.addBindValue(CHUNK_SIZE);
+            ins.addBindValue(nowIso());
+            if (!ins.exec()) {
+                if (classifySqlError(ins.lastError()) == ErrorCode::NotFound) throw Errors::NotFound("Node not found");
+                throw Errors::DbError(ins.lastError().text().toStdString());
+            }
+            info.id = ins.lastInsertId().toLongLong();
+            info.nodeId = nodeId;
+            info.name = name;
+
+            QCryptographicHash hash(QCryptographicHash::Sha256);
+            QSqlQuery chunkIns(m_db);
+            chunkIns.prepare("INSERT INTO attachment_chunks(attachment_id, seq, data) VALUES(?, ?, ?)");
+            qint64 seq = 0;
+            while (true) {
+                // Добираем порцию до полного размера: последовательные устройства отдают данные кусками
+                const QByteArray chunk = readChunk(source, CHUNK_SIZE);
+                if (chunk.isEmpty()) break;
+                hash.addData(chunk);
+                chunkIns.addBindValue(info.id);
+                chunkIns.addBindValue(seq++);
+                chunkIns.addBindValue(chunk);
+                if (!chunkIns.exec()) throw Errors::DbError(chunkIns.lastError().text().toStdString());
+                info.size += chunk.size();
+                if (chunk.size() < CHUNK_SIZE) break;
+            }
+            // Короткое чтение не в конце источника — обрыв, а не конец файла: усечённое вложение не сохраняем
+            if (!source.atEnd()) {
+                throw Errors::DbError(("Attachment source ended early: " + source.errorString()).toStdString());
+            }
+            info.sha256 = QString::fromLatin1(hash.result().toHex());
+
+            QSqlQuery fin(m_db);
+            fin.prepare("UPDATE attachments SET size = ?, sha256 = ? WHERE id = ?");
+            fin.addBindValue(info.size);
+            fin.addBindValue(info.sha256);
+            fin.addBindValue(info.id);
+            if (!fin.exec()) throw Errors::DbError(fin.lastError().text().toStdString());
+        } catch (...) {
+            SqlTx::rollback(m_db);
+            throw;
+        }
+        if (!SqlTx::commit(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        return info;
+    }
+
+    std::unique_ptr<QIODevice> openRead(qint64 attachmentId) override {
+        QSqlQuery q(m_db);
+        q.prepare("SELECT size, chunk_size FROM attachments WHERE id = ? AND sha256 IS NOT NULL");
+        q.addBindValue(attachmentId);
+        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!q.next()) throw Errors::NotFound("Attachment not found");
+        // Размер порции делит позицию чтения: 0 или мусор в строке — повреждение, а не падение
+        const qint64 size = q.value(0).toLongLong();
+        const int chunkSize = q.value(1).toInt();
+        if (chunkSize <= 0 || size < 0) {
+            throw Errors::DbError(QString("Attachment %1 has invalid chunk size %2").arg(attachmentId).arg(chunkSize).toStdString());
+        }
+        auto dev = std::make_unique<AttachmentReader>(m_db, attachmentId, size, chunkSize);
+        dev->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        return dev;
+    }
+
+    std::vector<AttachmentInfo> list(qint64 nodeId) override {
+        QSqlQuery q(m_db);
+        q.prepare("SELECT id, node_id, name, size, sha256 FROM attachments WHERE node_id = ? AND sha256 IS NOT NULL ORDER BY name");
+        q.addBindValue(nodeId);
+        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        std::vector<AttachmentInfo> out;
+        while (q.next()) {
+            AttachmentInfo a;
+            a.id = q.value(0).toLongLong();
+            a.nodeId = q.value(1).toLongLong();
+            a.name = q.value(2).toString();
+            a.size = q.value(3).toLongLong();
+            a.sha256 = q.value(4).toString();
+            out.push_back(std::move(a));
+        }
+        return out;
+    }
+
+    std::unordered_map<qint64, AttachmentSummary> summarize(const std::vector<qint64> &nodeIds) override {
+        std::unordered_map<qint64, AttachmentSummary> out;
+        for (size_t from = 0; from < nodeIds.size(); from += IN_BATCH) {
+            const size_t to = qMin(nodeIds.size(), from + IN_BATCH);
+            QStringList marks;
+            for (size_t i = from; i < to; ++i) marks << "?";
+            QSqlQuery q(m_db);
+            q.prepare(QString("SELECT node_id, COUNT(*), SUM(size) FROM attachments "
+                              "WHERE sha256 IS NOT NULL AND node_id IN (%1) GROUP BY node_id").arg(marks.join(',')));
+            for (size_t i = from; i < to; ++i) q.addBindValue(nodeIds[i]);
+            if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+            while (q.next()) {
+                AttachmentSummary s;
+                s.count = q.value(1).toInt();
+                s.totalBytes = q.value(2).toLongLong();
+                out[q.value(0).toLongLong()] = s;
+            }
+        }
+        return out;
+    }
+
+    void remove(qint64 attachmentId) override {
+        if (!SqlTx::begin(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        QSqlQuery q(m_db);
+        q.prepare("DELETE FROM attachments WHERE id = ?");
+        q.addBindValue(attachmentId);
+        if (!q.exec()) {
+            SqlTx::rollback(m_db);
+            throw Errors::DbError(q.lastError().text().toStdString());
+        }
+        if (!SqlTx::commit(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+    }
+
+    bool verify(qint64 attachmentId) override {
+        QSqlQuery q(m_db);
+        q.prepare("SELECT sha256 FROM attachments WHERE id = ?");
+        q.addBindValue(attachmentId);
+        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!q.next()) throw Errors::NotFound("Attachment not found");
+        const QString expected = q.value(0).toString();
+
+        auto dev = openRead(attachmentId);
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        while (!dev->atEnd()) {
+            const QByteArray part = dev->read(CHUNK_SIZE);
+            if (part.isEmpty()) return false;
+            hash.addData(part);
+        }
+        return QString::fromLatin1(hash.result().toHex()) == expected;
+    }
+
+private:
+    QSqlDatabase m_db;
+};
+
+std::unique_ptr<IAttachmentRepository> makeSqliteAttachmentRepository(const QSqlDatabase &db) {
+    return std::make_unique<SqliteAttachmentRepository>(db);
+}
@@ -2,89 +2,250 @@
 //
 // Ключевые моменты реализации:
 //  - Используется QSqlDatabase/QSqlQuery. Все операции изменения данных (insert/update/delete)
-//    обёрнуты в транзакции (transaction/commit, при ошибках — rollback).
+//    обёрнуты в транзакции (SqlTx::begin/commit, при ошибках — rollback). Внутри внешней транзакции
+//    на том же соединении (пакетный сценарий) это SAVEPOINT-ы, см. SqlTransaction.h.
 //  - Ошибки БД маппятся на исключения Errors::DbError, нарушения уникальности — на Errors::DuplicateName.
 //  - Временные метки updated_at/created_at пишутся в формате ISO UTC (см. nowIso()).
 //  - Семантика optional соответствует контракту интерфейса: NULL в БД => пустой optional.
+//  - Payload хранится либо в строке (nodes.payload), либо в общем хранилище payloads
+//    по ссылке nodes.payload_hash. Чтение прозрачно для обоих вариантов.
+//  - Каждый метод замеряется (QueryScope) при RepoOptions::stats: гистограмма задержек, строки,
+//    журнал медленных запросов с SQL и параметрами. Без stats замер — проверка указателя.
+//  - Большие payload (RepoOptions::compressThreshold) пишутся сжатыми в BLOB с тегом формата
+//    и распаковываются только при чтении самого payload (get/getPayload), не в выборках детей.
 #include "INodeRepository.h"
 #include "Errors.h"
+#include "Result.h"
+#include "SqlTransaction.h"
+#include "QueryStats.h"
+#include "Trace.h"
+#include "SortKey.h"
+#include "NameKeys.h"
 
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlError>
 #include <QVariant>
+#include <QStringList>
 #include <QDateTime>
+#include <QCryptographicHash>
+#include <QtEndian>
+
+#include <algorithm>
+
 
 static QString nowIso() {
     return QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
 }
 
+// Форматы хранения payload (тег payload_format / payloads.format)
+static constexpr int PAYLOAD_TEXT = 0;      // текст в payload/data
+static constexpr int PAYLOAD_QCOMPRESS = 1; // qCompress(UTF-8) в payload_blob/packed
+
+// Сколько id подставлять в один IN (...) — с запасом ниже лимита параметров SQLite
+static constexpr size_t IN_BATCH = 500;
+
+// Метаданные узла без payload — для выборок детей и поиска по имени
+static const char *const SELECT_META = "SELECT n.id, n.parent_id, n.name, n.sort_key FROM nodes n ";
+
+// Полная строка: payload в обоих местах хранения (inline и общее хранилище), начиная с колонки 4
+static const char *const SELECT_ROW =
+    "SELECT n.id, n.parent_id, n.name, n.sort_key, "
+    "n.payload, n.payload_blob, n.payload_format, n.payload_hash, p.data, p.packed, p.format "
+    "FROM nodes n LEFT JOIN payloads p ON p.hash = n.payload_hash ";
+
+static const char *const SELECT_PAYLOAD =
+    "SELECT n.payload, n.payload_blob, n.payload_format, n.payload_hash, p.data, p.packed, p.format "
+    "FROM nodes n LEFT JOIN payloads p ON p.hash = n.payload_hash ";
+
+// Закодированный для записи payload: ровно одно из text/packed не NULL
+struct EncodedPayload {
+    QVariant text {QVariant(QVariant::String)};
+    QVariant packed {QVariant(QVariant::ByteArray)};
+    int format {PAYLOAD_TEXT};
+};
+
+static EncodedPayload encodePayload(const QString &payload, int threshold) {
+    EncodedPayload e;
+    if (threshold > 0) {
+        const QByteArray utf8 = payload.toUtf8();
+        if (utf8.size() >= threshold) {
+            const QByteArray packed = qCompress(utf8);
+            // Несжимаемые данные оставляем текстом — распаковка без выигрыша не нужна
+            if (packed.size() < utf8.size()) {
+                e.packed = packed;
+                e.format = PAYLOAD_QCOMPRESS;
+                return e;
+            }
+        }
+    }
+    e.text = payload;
+    return e;
+}
+
+static std::optional<QString> decodePayload(const QVariant &text, const QVariant &packed, int format) {
+    if (format == PAYLOAD_QCOMPRESS) {
+        const QByteArray raw = qUncompress(packed.toByteArray());
+        if (raw.isNull()) throw Errors::DbError("Corrupted compressed payload");
+        return QString::fromUtf8(raw);
+    }
+    if (format != PAYLOAD_TEXT) throw Errors::DbError("Unknown payload format");
+    if (text.isNull()) return std::nullopt;
+    return text.toString();
+}
+
+// Разбирает колонки SELECT_PAYLOAD, начиная с first: NULL => пустой optional
+static std::optional<QString> readPayload(const QSqlQuery &q, int first) {
+    if (!q.value(first + 3).isNull()) { // payload_hash: текст в общем хранилище
+        return decodePayload(q.value(first + 4), q.value(first + 5), q.value(first + 6).toInt());
+    }
+    return decodePayload(q.value(first), q.value(first + 1), q.value(first + 2).toInt());
+}
+
+static RepoRow readMeta(const QSqlQuery &q) {
+    RepoRow r;
+    r.id = q.value(0).toLongLong();
+    if (q.value(1).isNull()) r.parentId.reset(); else r.parentId = q.value(1).toLongLong();
+    r.name = q.value(2).toString();
+    r.sortKey = q.value(3).toString();
+    return r;
+}
+
+static RepoRow readRow(const QSqlQuery &q) {
+    RepoRow r = readMeta(q);
+    r.payload = readPayload(q, 4);
+    return r;
+}
+
+// Колонка ключа порядка (до сравнения по name); пусто — только name
+static QString orderKeyColumn(ChildOrder order) {
+    switch (order) {
+    case ChildOrder::Manual: return "sort_key";
+    case ChildOrder::CaseInsensitive: return "name_fold";
+    case ChildOrder::Natural: return "name_natural";
+    case ChildOrder::ByName: break;
+    }
+    return QString();
+}
+
+static const char *orderClause(ChildOrder order) {
+    switch (order) {
+    case ChildOrder::Manual: return "ORDER BY n.sort_key ASC, n.name ASC";
+    case ChildOrder::CaseInsensitive: return "ORDER BY n.name_fold ASC, n.name ASC";
+    case ChildOrder::Natural: return "ORDER BY n.name_natural ASC, n.name ASC";
+    case ChildOrder::ByName: break;
+    }
+    return "ORDER BY n.name COLLATE BINARY ASC";
+}
+
+// Длина исходного текста сжатого payload: qCompress пишет её первыми 4 байтами (big-endian)
+static qint64 packedOriginalSize(const QByteArray &header) {
+    if (header.size() < 4) return 0;
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(header.constData()));
+}
+
+static QString payloadHash(const QString &payload) {
+    return QString::fromLatin1(QCryptographicHash::hash(payload.toUtf8(), QCryptographicHash::Sha256).toHex());
+}
+
 class SqliteNodeRepository final : public INodeRepository {
 public:
-    explicit SqliteNodeRepository(QSqlDatabase db)
-        : m_db(std::move(db)) {}
+    SqliteNodeRepository(QSqlDatabase db, const RepoOptions &options)
+        : m_db(std::move(db)), m_options(options) {}
 
-    qint64 insert(qint64 parentId, const QString &name, const std::optional<QString> &payload) override {
+    Result<qint64> tryInsert(qint64 parentId, const QString &name, const std::optional<QString> &payload) override {
+        auto op = track("insert");
         // Вставка дочернего узла. Уникальность имени среди детей одного родителя
         // обеспечивается уникальным индексом на (parent_id, name) на стороне БД.
-        if (!m_db.transaction()) {
-            throw Errors::DbError(m_db.lastError().text().toStdString());
-        }
+        if (!SqlTx::begin(m_db)) return sqlError(m_db.lastError());
         const QString ts = nowIso();
+        EncodedPayload inlinePayload;
+        QVariant hash(QVariant::String);
+        try {
+            if (payload.has_value()) {
+                if (m_options.dedupPayloads) hash = storeSharedPayload(payload.value());
+                else inlinePayload = encodePayload(payload.value(), m_options.compressThreshold);
+            }
+        } catch (...) {
+            SqlTx::rollback(m_db);
+            throw;
+        }
+        QString sortKey;
+        try {
+            // Новый узел — в конец ручного порядка сиблингов
+            sortKey = SortKey::between(lastSortKey(parentId, 0), QString());
+        } catch (...) {
+            SqlTx::rollback(m_db);
+            throw;
+        }
+        QVariant newId(QVariant::LongLong); // NULL — rowid назначает SQLite
+        if (m_options.idSpan > 0) {
+            try {
+                newId = nextIdInRange();
+            } catch (...) {
+                SqlTx::rollback(m_db);
+                throw;
+            }
+        }
         QSqlQuery q(m_db);
-        q.prepare("INSERT INTO nodes(parent_id, name, payload, created_at, updated_at) VALUES(?, ?, ?, ?, ?)");
+        q.prepare("INSERT INTO nodes(id, parent_id, name, name_fold, name_natural, sort_key, "
+                  "payload, payload_blob, payload_format, payload_hash, created_at, updated_at) "
+                  "VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+        q.addBindValue(newId);
         q.addBindValue(parentId);
         q.addBindValue(name);
-        if (payload.has_value()) q.addBindValue(payload.value()); else q.addBindValue(QVariant(QVariant::String));
+        q.addBindValue(NameKeys::fold(name));
+        q.addBindValue(NameKeys::natural(name));
+        q.addBindValue(sortKey);
+        q.addBindValue(inlinePayload.text);
+        q.addBindValue(inlinePayload.packed);
+        q.addBindValue(inlinePayload.format);
+        q.addBindValue(hash);
         q.addBindValue(ts);
         q.addBindValue(ts);
-        if (!q.exec()) {
-            m_db.rollback();
-            const auto err = q.lastError().text();
-            if (err.contains("UNIQUE")) {
-                throw Errors::DuplicateName(err.toStdString());
-            }
-            throw Errors::DbError(err.toStdString());
+        if (!execTimed(q)) {
+            // Конфликт имени/нет родителя — по расширенному коду SQLite; ошибку берём до отката
+            const Error error = sqlError(q.lastError());
+            SqlTx::rollback(m_db);
+            return error;
         }
         qint64 id = q.lastInsertId().toLongLong();
-        if (!m_db.commit()) {
-            throw Errors::DbError(m_db.lastError().text().toStdString());
-        }
+        if (!SqlTx::commit(m_db)) return sqlError(m_db.lastError());
         emit treeMapChanged();
         return id;
     }
 
-    void updateName(qint64 id, const QString &newName) override {
-        if (!m_db.transaction()) {
-            throw Errors::DbError(m_db.lastError().text().toStdString());
-        }
+    Result<void> tryUpdateName(qint64 id, const QString &newName) override {
+        auto op = track("updateName");
+        if (!SqlTx::begin(m_db)) return sqlError(m_db.lastError());
 
         // Перед обновлением проверяем существование узла (через получение parent_id).
         // Уникальность среди сиблингов обеспечивает индекс (parent_id, name) в БД.
         auto parentOpt = getParentId(id);
         if (!parentOpt.has_value()) {
-            m_db.rollback();
-            throw Errors::NotFound("Node not found");
+            SqlTx::rollback(m_db);
+            return Error{ErrorCode::NotFound, "Node not found"};
         }
 
         QSqlQuery q(m_db);
-        q.prepare("UPDATE nodes SET name = ?, updated_at = ? WHERE id = ?");
+        q.prepare("UPDATE nodes SET name = ?, name_fold = ?, name_natural = ?, updated_at = ? WHERE id = ?");
         q.addBindValue(newName);
+        q.addBindValue(NameKeys::fold(newName));
+        q.addBindValue(NameKeys::natural(newName));
         q.addBindValue(nowIso());
         q.addBindValue(id);
-        if (!q.exec()) {
-            m_db.rollback();
-            const auto err = q.lastError().text();
-            if (err.contains("UNIQUE")) throw Errors::DuplicateName(err.toStdString());
-            throw Errors::DbError(err.toStdString());
-        }
-        if (!m_db.commit()) {
-            throw Errors::DbError(m_db.lastError().text().toStdString());
+        if (!execTimed(q)) {
+            const Error error = sqlError(q.lastError());
+            SqlTx::rollback(m_db);
+            return error;
         }
+        if (!SqlTx::commit(m_db)) return sqlError(m_db.lastError());
         emit treeMapChanged();
+        return {};
     }
 
     void updateParent(qint64 id, qint64 newParentId) override {
-        if (!m_db.transaction()) {
+        auto op = track("updateParent");
+        if (!SqlTx::begin(m_db)) {
             throw Errors::DbError(m_db.lastError().text().toStdString());
         }
         QSqlQuery q(m_db);
@@ -92,130 +253,806 @@ public:
         q.addBindValue(newParentId);
         q.addBindValue(nowIso());
         q.addBindValue(id);
-        if (!q.exec()) {
-            m_db.rollback();
-            const auto err = q.lastError().text();
-            if (err.contains("UNIQUE")) throw Errors::DuplicateName(err.toStdString());
-            throw Errors::DbError(err.toStdString());
+        if (!execTimed(q)) {
+            const Error error = sqlError(q.lastError());
+            SqlTx::rollback(m_db);
+            throwError(error);
         }
-        if (!m_db.commit()) {
+        if (!SqlTx::commit(m_db)) {
             throw Errors::DbError(m_db.lastError().text().toStdString());
         }
         emit treeMapChanged();
     }
 
     void remove(qint64 id) override {
-        if (!m_db.transaction()) {
+        auto op = track("remove");
+        if (!SqlTx::begin(m_db)) {
             throw Errors::DbError(m_db.lastError().text().toStdString());
         }
         QSqlQuery q(m_db);
         q.prepare("DELETE FROM nodes WHERE id = ?");
         q.addBindValue(id);
-        if (!q.exec()) {
-            m_db.rollback();
+        if (!execTimed(q)) {
+            SqlTx::rollback(m_db);
             throw Errors::DbError(q.lastError().text().toStdString());
         }
-        if (!m_db.commit()) {
+        if (!SqlTx::commit(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        emit treeMapChanged();
+    }
+
+    void removeMany(const std::vector<qint64> &ids) override {
+        auto op = track("removeMany");
+        if (!SqlTx::begin(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        QSqlQuery q(m_db);
+        q.prepare("DELETE FROM nodes WHERE id = ?");
+        for (const qint64 id : ids) {
+            q.addBindValue(id);
+            if (!execTimed(q)) {
+                SqlTx::rollback(m_db);
+                throw Errors::DbError(q.lastError().text().toStdString());
+            }
+        }
+        if (!SqlTx::commit(m_db)) {
             throw Errors::DbError(m_db.lastError().text().toStdString());
         }
         emit treeMapChanged();
     }
 
     std::optional<RepoRow> get(qint64 id) override {
+        auto op = track("get");
         QSqlQuery q(m_db);
-        q.prepare("SELECT id, parent_id, name, payload FROM nodes WHERE id = ?");
+        q.prepare(QString(SELECT_ROW) + "WHERE n.id = ?");
         q.addBindValue(id);
-        if (!q.exec()) {
+        if (!execTimed(q)) {
             throw Errors::DbError(q.lastError().text().toStdString());
         }
         if (!q.next()) return std::nullopt;
-        RepoRow r;
-        r.id = q.value(0).toLongLong();
-        if (q.value(1).isNull()) r.parentId.reset(); else r.parentId = q.value(1).toLongLong();
-        r.name = q.value(2).toString();
-        if (q.value(3).isNull()) r.payload.reset(); else r.payload = q.value(3).toString();
-        return r;
+        return readRow(q);
     }
 
-    std::optional<RepoRow> findChildByName(qint64 parentId, const QString &name) override {
+    std::optional<RepoRow> getMeta(qint64 id) override {
+        auto op = track("getMeta");
         QSqlQuery q(m_db);
-        q.prepare("SELECT id, parent_id, name, payload FROM nodes WHERE parent_id = ? AND name = ?");
+        q.prepare(QString(SELECT_META) + "WHERE n.id = ?");
+        q.addBindValue(id);
+        if (!execTimed(q)) {
+            throw Errors::DbError(q.lastError().text().toStdString());
+        }
+        if (!q.next()) return std::nullopt;
+        return readMeta(q);
+    }
+
+    std::optional<RepoRow> findChildByName(qint64 parentId, const QString &name, NameMatch match) override {
+        auto op = track("findChildByName");
+        if (match == NameMatch::CaseInsensitive) return findChildFolded(parentId, name);
+        QSqlQuery q(m_db);
+        q.prepare(QString(SELECT_META) + "WHERE n.parent_id = ? AND n.name = ?");
         q.addBindValue(parentId);
         q.addBindValue(name);
-        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
         if (!q.next()) return std::nullopt;
-        RepoRow r;
-        r.id = q.value(0).toLongLong();
-        if (q.value(1).isNull()) r.parentId.reset(); else r.parentId = q.value(1).toLongLong();
-        r.name = q.value(2).toString();
-        if (q.value(3).isNull()) r.payload.reset(); else r.payload = q.value(3).toString();
-        return r;
+        return readMeta(q);
     }
 
     std::vector<RepoRow> getChildren(qint64 parentId) override {
+        auto op = track("getChildren");
         QSqlQuery q(m_db);
         // Сортировка по имени в бинарной коллации для детерминированного порядка
-        q.prepare("SELECT id, parent_id, name, payload FROM nodes WHERE parent_id = ? ORDER BY name COLLATE BINARY ASC");
+        q.prepare(QString(SELECT_META) + "WHERE n.parent_id = ? ORDER BY n.name COLLATE BINARY ASC");
+        q.addBindValue(parentId);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        std::vector<RepoRow> rows;
+        while (q.next()) {
+            rows.push_back(readMeta(q));
+        }
+        op.addRows(qint64(rows.size()));
+        return rows;
+    }
+
+    std::vector<RepoRow> getChildrenPage(qint64 parentId, ChildOrder order, qint64 limit, qint64 offset) override {
+        auto op = track("getChildrenPage");
+        QSqlQuery q(m_db);
+        q.prepare(QString(SELECT_META) + "WHERE n.parent_id = ? " + orderClause(order) + " LIMIT ? OFFSET ?");
         q.addBindValue(parentId);
-        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        q.addBindValue(limit < 0 ? qint64(-1) : limit);
+        q.addBindValue(offset);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        std::vector<RepoRow> rows;
+        while (q.next()) {
+            rows.push_back(readMeta(q));
+        }
+        op.addRows(qint64(rows.size()));
+        return rows;
+    }
+
+    std::vector<RepoRow> getChildrenFrom(qint64 parentId, ChildOrder order, qint64 anchorId,
+                                         PageDirection direction, qint64 limit) override {
+        auto op = track("getChildrenFrom");
+        const QString key = orderKeyColumn(order);
+        QSqlQuery a(m_db);
+        a.prepare(QString("SELECT name, %1 FROM nodes WHERE id = ? AND parent_id = ?").arg(key.isEmpty() ? "NULL" : key));
+        a.addBindValue(anchorId);
+        a.addBindValue(parentId);
+        if (!execTimed(a)) throw Errors::DbError(a.lastError().text().toStdString());
+        if (!a.next()) return {};
+        const QString anchorName = a.value(0).toString();
+        const QVariant anchorKey = a.value(1);
+
+        // Порядок "ключ ASC (NULL первыми), name ASC". Каждая часть — один диапазон индекса
+        // (parent_id, ключ, name); части перечислены от ближайшей к якорю
+        struct Part {
+            QString where;
+            QVariantList binds;
+        };
+        const bool after = direction == PageDirection::After;
+        std::vector<Part> parts;
+        if (key.isEmpty()) {
+            parts.push_back({after ? "n.name > ?" : "n.name < ?", {anchorName}});
+        } else if (anchorKey.isNull()) {
+            parts.push_back({QString("n.%1 IS NULL AND n.name %2 ?").arg(key, after ? ">" : "<"), {anchorName}});
+            if (after) parts.push_back({QString("n.%1 IS NOT NULL").arg(key), {}});
+        } else {
+            // Сравнение строк (ключ, name) отбрасывает строки без ключа — они идут отдельной частью
+            parts.push_back({QString("(n.%1, n.name) %2 (?, ?)").arg(key, after ? ">" : "<"), {anchorKey, anchorName}});
+            if (!after) parts.push_back({QString("n.%1 IS NULL").arg(key), {}});
+        }
+        const QString orderBy = after ? QString(orderClause(order))
+                              : key.isEmpty() ? QString("ORDER BY n.name COLLATE BINARY DESC")
+                                              : QString("ORDER BY n.%1 DESC, n.name DESC").arg(key);
+
         std::vector<RepoRow> rows;
+        for (const Part &part : parts) {
+            const qint64 left = limit < 0 ? qint64(-1) : limit - qint64(rows.size());
+            if (left == 0) break;
+            QSqlQuery q(m_db);
+            q.prepare(QString(SELECT_META) + "WHERE n.parent_id = ? AND " + part.where + " " + orderBy + " LIMIT ?");
+            q.addBindValue(parentId);
+            for (const QVariant &v : part.binds) q.addBindValue(v);
+            q.addBindValue(left);
+            if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+            while (q.next()) {
+                rows.push_back(readMeta(q));
+            }
+        }
+        if (!after) std::reverse(rows.begin(), rows.end());
+        op.addRows(qint64(rows.size()));
+        return rows;
+    }
+
+    qint64 childPosition(qint64 id, ChildOrder order) override {
+        auto op = track("childPosition");
+        // Строки перед узлом в порядке "ключ ASC (NULL первыми), name ASC". Вместо одного OR-предиката —
+        // отдельные счётчики, каждый из которых — диапазон индекса порядка
+        const QString key = orderKeyColumn(order);
+        QString before = "(SELECT COUNT(*) FROM nodes n WHERE n.parent_id = t.parent_id AND n.name < t.name)";
+        if (!key.isEmpty()) {
+            before = QString("CASE WHEN t.%1 IS NULL"
+                             " THEN (SELECT COUNT(*) FROM nodes n WHERE n.parent_id = t.parent_id AND n.%1 IS NULL AND n.name < t.name)"
+                             " ELSE (SELECT COUNT(*) FROM nodes n WHERE n.parent_id = t.parent_id AND n.%1 IS NULL)"
+                             " + (SELECT COUNT(*) FROM nodes n WHERE n.parent_id = t.parent_id AND (n.%1, n.name) < (t.%1, t.name))"
+                             " END").arg(key);
+        }
+        QSqlQuery q(m_db);
+        q.prepare("SELECT " + before + " FROM nodes t WHERE t.id = ?");
+        q.addBindValue(id);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!q.next()) return -1;
+        return q.value(0).toLongLong();
+    }
+
+    std::vector<SubtreeRow> getSubtree(qint64 rootId, int maxDepth, qint64 limit) override {
+        auto op = track("getSubtree");
+        QSqlQuery q(m_db);
+        q.prepare("WITH RECURSIVE sub(id, depth) AS ("
+                  " SELECT id, 0 FROM nodes WHERE parent_id = ?"
+                  " UNION ALL"
+                  " SELECT c.id, s.depth + 1 FROM nodes c JOIN sub s ON c.parent_id = s.id WHERE s.depth + 1 < ?"
+                  ") SELECT n.id, n.parent_id, n.name, n.sort_key, s.depth,"
+                  " EXISTS(SELECT 1 FROM nodes k WHERE k.parent_id = n.id)"
+                  " FROM sub s JOIN nodes n ON n.id = s.id"
+                  " ORDER BY s.depth, n.parent_id, n.sort_key, n.name LIMIT ?");
+        q.addBindValue(rootId);
+        // Без явного предела — MAX_TREE_DEPTH: поддерево узла из цикла иначе не кончается
+        q.addBindValue(maxDepth < 0 ? MAX_TREE_DEPTH : maxDepth);
+        q.addBindValue(limit < 0 ? qint64(-1) : limit);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        std::vector<SubtreeRow> rows;
         while (q.next()) {
-            RepoRow r;
-            r.id = q.value(0).toLongLong();
-            if (q.value(1).isNull()) r.parentId.reset(); else r.parentId = q.value(1).toLongLong();
-            r.name = q.value(2).toString();
-            if (q.value(3).isNull()) r.payload.reset(); else r.payload = q.value(3).toString();
+            SubtreeRow r;
+            r.row = readMeta(q);
+            r.depth = q.value(4).toInt();
+            r.hasChildren = q.value(5).toBool();
             rows.push_back(std::move(r));
         }
+        op.addRows(qint64(rows.size()));
         return rows;
     }
 
+    qint64 countSubtree(qint64 rootId, int maxDepth, qint64 limit) override {
+        auto op = track("countSubtree");
+        QSqlQuery q(m_db);
+        // LIMIT внутри рекурсивного CTE прекращает рекурсию — поддерево целиком не строится
+        q.prepare("WITH RECURSIVE sub(id, depth) AS ("
+                  " SELECT id, 0 FROM nodes WHERE parent_id = ?"
+                  " UNION ALL"
+                  " SELECT c.id, s.depth + 1 FROM nodes c JOIN sub s ON c.parent_id = s.id WHERE s.depth + 1 < ?"
+                  " LIMIT ?"
+                  ") SELECT COUNT(*) FROM sub");
+        q.addBindValue(rootId);
+        q.addBindValue(maxDepth < 0 ? MAX_TREE_DEPTH : maxDepth);
+        q.addBindValue(limit < 0 ? qint64(-1) : limit);
+        if (!execTimed(q) || !q.next()) throw Errors::DbError(q.lastError().text().toStdString());
+        return q.value(0).toLongLong();
+    }
+
+    std::vector<SubtreeRow> getChildrenOfMany(const std::vector<qint64> &parentIds, ChildOrder order) override {
+        auto op = track("getChildrenOfMany");
+        // Внутри родителя — тот же порядок, что у getChildrenPage
+        const QString orderBy = QString(orderClause(order)).replace("ORDER BY ", "ORDER BY n.parent_id, ");
+        std::vector<SubtreeRow> rows;
+        for (size_t from = 0; from < parentIds.size(); from += IN_BATCH) {
+            const size_t to = qMin(parentIds.size(), from + IN_BATCH);
+            QStringList marks;
+            for (size_t i = from; i < to; ++i) marks << "?";
+            QSqlQuery q(m_db);
+            q.prepare(QString("SELECT n.id, n.parent_id, n.name, n.sort_key, 0, "
+                              "EXISTS(SELECT 1 FROM nodes k WHERE k.parent_id = n.id) "
+                              "FROM nodes n WHERE n.parent_id IN (%1) ").arg(marks.join(',')) + orderBy);
+            for (size_t i = from; i < to; ++i) q.addBindValue(parentIds[i]);
+            if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+            while (q.next()) {
+                SubtreeRow r;
+                r.row = readMeta(q);
+                r.hasChildren = q.value(5).toBool();
+                rows.push_back(std::move(r));
+            }
+        }
+        op.addRows(qint64(rows.size()));
+        return rows;
+    }
+
+    std::vector<RepoRow> scanChildrenByName(qint64 parentId, const QString &from, bool inclusive,
+                                            const QString &to, int limit) override {
+        auto op = track("scanChildrenByName");
+        QString sql = QString(SELECT_META) + "WHERE n.parent_id = ? AND n.name " + (inclusive ? ">=" : ">") + " ?";
+        if (!to.isEmpty()) sql += " AND n.name < ?";
+        sql += " ORDER BY n.name COLLATE BINARY ASC LIMIT ?";
+        QSqlQuery q(m_db);
+        q.prepare(sql);
+        q.addBindValue(parentId);
+        q.addBindValue(from.isNull() ? QString("") : from);
+        if (!to.isEmpty()) q.addBindValue(to);
+        q.addBindValue(limit);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        std::vector<RepoRow> rows;
+        while (q.next()) {
+            rows.push_back(readMeta(q));
+        }
+        op.addRows(qint64(rows.size()));
+        return rows;
+    }
+
+    QString sortKeyOf(qint64 id) override {
+        auto op = track("sortKeyOf");
+        QSqlQuery q(m_db);
+        q.prepare("SELECT sort_key FROM nodes WHERE id = ?");
+        q.addBindValue(id);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!q.next()) return QString();
+        return q.value(0).toString();
+    }
+
+    QString neighborSortKey(qint64 parentId, const QString &key, bool after, qint64 excludeId) override {
+        auto op = track("neighborSortKey");
+        QSqlQuery q(m_db);
+        q.prepare(after
+            ? "SELECT sort_key FROM nodes WHERE parent_id = ? AND sort_key > ? AND id != ? ORDER BY sort_key ASC LIMIT 1"
+            : "SELECT sort_key FROM nodes WHERE parent_id = ? AND sort_key < ? AND id != ? ORDER BY sort_key DESC LIMIT 1");
+        q.addBindValue(parentId);
+        q.addBindValue(key);
+        q.addBindValue(excludeId);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!q.next()) return QString();
+        return q.value(0).toString();
+    }
+
+    QString lastSortKey(qint64 parentId, qint64 excludeId) override {
+        auto op = track("lastSortKey");
+        QSqlQuery q(m_db);
+        // Обратный обход индекса (parent_id, sort_key, name): читается одна-две строки
+        q.prepare("SELECT sort_key FROM nodes WHERE parent_id = ? AND sort_key IS NOT NULL AND id != ? ORDER BY sort_key DESC LIMIT 1");
+        q.addBindValue(parentId);
+        q.addBindValue(excludeId);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!q.next()) return QString();
+        return q.value(0).toString();
+    }
+
+    Result<void> tryMoveTo(qint64 id, qint64 newParentId, const QString &sortKey) override {
+        auto op = track("moveTo");
+        if (!SqlTx::begin(m_db)) return sqlError(m_db.lastError());
+        QSqlQuery q(m_db);
+        q.prepare("UPDATE nodes SET parent_id = ?, sort_key = ?, updated_at = ? WHERE id = ?");
+        q.addBindValue(newParentId);
+        q.addBindValue(sortKey);
+        q.addBindValue(nowIso());
+        q.addBindValue(id);
+        if (!execTimed(q)) {
+            const Error error = sqlError(q.lastError());
+            SqlTx::rollback(m_db);
+            return error;
+        }
+        if (!SqlTx::commit(m_db)) return sqlError(m_db.lastError());
+        emit treeMapChanged();
+        return {};
+    }
+
+    Result<void> tryMoveManyTo(const std::vector<std::pair<qint64, QString>> &idKeys, qint64 newParentId) override {
+        auto op = track("moveManyTo");
+        if (!SqlTx::begin(m_db)) return sqlError(m_db.lastError());
+        const QString now = nowIso();
+        QSqlQuery q(m_db);
+        q.prepare("UPDATE nodes SET parent_id = ?, sort_key = ?, updated_at = ? WHERE id = ?");
+        for (const auto &[id, key] : idKeys) {
+            q.addBindValue(newParentId);
+            q.addBindValue(key);
+            q.addBindValue(now);
+            q.addBindValue(id);
+            if (!execTimed(q)) {
+                const Error error = sqlError(q.lastError());
+                SqlTx::rollback(m_db);
+                return error;
+            }
+        }
+        if (!SqlTx::commit(m_db)) return sqlError(m_db.lastError());
+        emit treeMapChanged();
+        return {};
+    }
+
+    void assignSortKeys(const std::vector<std::pair<qint64, QString>> &keys) override {
+        auto op = track("assignSortKeys");
+        if (!SqlTx::begin(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        QSqlQuery q(m_db);
+        q.prepare("UPDATE nodes SET sort_key = ? WHERE id = ?");
+        for (const auto &[id, key] : keys) {
+            q.addBindValue(key);
+            q.addBindValue(id);
+            if (!execTimed(q)) {
+                SqlTx::rollback(m_db);
+                throw Errors::DbError(q.lastError().text().toStdString());
+            }
+        }
+        if (!SqlTx::commit(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+    }
+
+    std::vector<std::pair<qint64, qint64>> findUnkeyedRows(qint64 afterRowId, int limit) override {
+        auto op = track("findUnkeyedRows");
+        QSqlQuery q(m_db);
+        q.prepare("SELECT rowid, parent_id FROM nodes WHERE rowid > ? AND sort_key IS NULL AND parent_id IS NOT NULL ORDER BY rowid LIMIT ?");
+        q.addBindValue(afterRowId);
+        q.addBindValue(limit);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        std::vector<std::pair<qint64, qint64>> out;
+        while (q.next()) {
+            out.emplace_back(q.value(0).toLongLong(), q.value(1).toLongLong());
+        }
+        op.addRows(qint64(out.size()));
+        return out;
+    }
+
+    int backfillNameKeys(int limit) override {
+        auto op = track("backfillNameKeys");
+        if (!SqlTx::begin(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        int updated = 0;
+        try {
+            QSqlQuery sel(m_db);
+            sel.prepare("SELECT id, name FROM nodes WHERE name_fold IS NULL LIMIT ?");
+            sel.addBindValue(limit);
+            if (!execTimed(sel)) throw Errors::DbError(sel.lastError().text().toStdString());
+            QSqlQuery upd(m_db);
+            upd.prepare("UPDATE nodes SET name_fold = ?, name_natural = ? WHERE id = ?");
+            while (sel.next()) {
+                const QString name = sel.value(1).toString();
+                upd.addBindValue(NameKeys::fold(name));
+                upd.addBindValue(NameKeys::natural(name));
+                upd.addBindValue(sel.value(0).toLongLong());
+                if (!execTimed(upd)) throw Errors::DbError(upd.lastError().text().toStdString());
+                ++updated;
+            }
+        } catch (...) {
+            SqlTx::rollback(m_db);
+            throw;
+        }
+        if (!SqlTx::commit(m_db)) throw Errors::DbError(m_db.lastError().text().toStdString());
+        return updated;
+    }
+
     std::optional<qint64> getParentId(qint64 id) override {
+        auto op = track("getParentId");
         QSqlQuery q(m_db);
         q.prepare("SELECT parent_id FROM nodes WHERE id = ?");
         q.addBindValue(id);
-        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
         if (!q.next()) return std::nullopt;
         if (q.value(0).isNull()) return std::optional<qint64>{}; // корневой узел (parent_id IS NULL)
         return q.value(0).toLongLong();
     }
 
+    std::vector<qint64> getAncestorIds(qint64 id) override {
+        auto op = track("getAncestorIds");
+        QSqlQuery q(m_db);
+        q.prepare("WITH RECURSIVE chain(id, parent_id, depth) AS ("
+                  " SELECT id, parent_id, 0 FROM nodes WHERE id = ?"
+                  " UNION ALL"
+                  " SELECT n.id, n.parent_id, c.depth + 1 FROM nodes n JOIN chain c ON n.id = c.parent_id"
+                  " WHERE c.depth < ?"
+                  ") SELECT id FROM chain ORDER BY depth");
+        q.addBindValue(id);
+        q.addBindValue(MAX_TREE_DEPTH);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        std::vector<qint64> out;
+        while (q.next()) {
+            out.push_back(q.value(0).toLongLong());
+        }
+        // Рекурсия дошла до предела глубины — цепочка не кончается корнем
+        if (out.size() > size_t(MAX_TREE_DEPTH)) {
+            throw Errors::CorruptTree(QString("Ancestor chain exceeds depth limit at node %1").arg(id).toStdString());
+        }
+        op.addRows(qint64(out.size()));
+        return out;
+    }
+
     bool hasChildren(qint64 id) override {
+        auto op = track("hasChildren");
         QSqlQuery q(m_db);
         q.prepare("SELECT 1 FROM nodes WHERE parent_id = ? LIMIT 1");
         q.addBindValue(id);
-        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
         return q.next();
     }
 
     void setPayload(qint64 id, const QString &payloadJson) override {
-        if (!m_db.transaction()) {
+        auto op = track("setPayload");
+        if (!SqlTx::begin(m_db)) {
             throw Errors::DbError(m_db.lastError().text().toStdString());
         }
-        QSqlQuery q(m_db);
-        q.prepare("UPDATE nodes SET payload = ?, updated_at = ? WHERE id = ?");
-        q.addBindValue(payloadJson);
-        q.addBindValue(nowIso());
-        q.addBindValue(id);
-        if (!q.exec()) { m_db.rollback(); throw Errors::DbError(q.lastError().text().toStdString()); }
-        if (!m_db.commit()) throw Errors::DbError(m_db.lastError().text().toStdString());
+        try {
+            const std::optional<QString> oldHash = currentPayloadHash(id);
+            EncodedPayload inlinePayload;
+            QVariant hash(QVariant::String);
+            if (m_options.dedupPayloads) hash = storeSharedPayload(payloadJson);
+            else inlinePayload = encodePayload(payloadJson, m_options.compressThreshold);
+
+            QSqlQuery q(m_db);
+            q.prepare("UPDATE nodes SET payload = ?, payload_blob = ?, payload_format = ?, payload_hash = ?, updated_at = ? WHERE id = ?");
+            q.addBindValue(inlinePayload.text);
+            q.addBindValue(inlinePayload.packed);
+            q.addBindValue(inlinePayload.format);
+            q.addBindValue(hash);
+            q.addBindValue(nowIso());
+            q.addBindValue(id);
+            if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+
+            // Старый текст больше не нужен этому узлу — удаляем, если на него никто не ссылается
+            if (oldHash.has_value() && (hash.isNull() || hash.toString() != oldHash.value())) {
+                releaseSharedPayload(oldHash.value());
+            }
+        } catch (...) {
+            SqlTx::rollback(m_db);
+            throw;
+        }
+        if (!SqlTx::commit(m_db)) throw Errors::DbError(m_db.lastError().text().toStdString());
         emit treeMapChanged();
     }
 
     std::optional<QString> getPayload(qint64 id) override {
+        auto op = track("getPayload");
         QSqlQuery q(m_db);
-        q.prepare("SELECT payload FROM nodes WHERE id = ?");
+        q.prepare(QString(SELECT_PAYLOAD) + "WHERE n.id = ?");
         q.addBindValue(id);
-        if (!q.exec()) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
         if (!q.next()) return std::nullopt;
-        if (q.value(0).isNull()) return std::optional<QString>{}; // payload IS NULL
-        return q.value(0).toString();
+        return readPayload(q, 0); // пустой optional => payload IS NULL
+    }
+
+    std::unordered_map<qint64, QString> getPayloads(const std::vector<qint64> &ids) override {
+        auto op = track("getPayloads");
+        std::unordered_map<qint64, QString> out;
+        for (size_t from = 0; from < ids.size(); from += IN_BATCH) {
+            const size_t to = qMin(ids.size(), from + IN_BATCH);
+            QStringList marks;
+            for (size_t i = from; i < to; ++i) marks << "?";
+            // Колонки SELECT_PAYLOAD и id последней колонкой
+            QSqlQuery q(m_db);
+            q.prepare(QString("SELECT n.payload, n.payload_blob, n.payload_format, n.payload_hash, p.data, p.packed, p.format, n.id "
+                              "FROM nodes n LEFT JOIN payloads p ON p.hash = n.payload_hash "
+                              "WHERE n.id IN (%1)").arg(marks.join(',')));
+            for (size_t i = from; i < to; ++i) q.addBindValue(ids[i]);
+            if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+            while (q.next()) {
+                auto payload = readPayload(q, 0);
+                if (payload.has_value()) out[q.value(7).toLongLong()] = std::move(*payload);
+            }
+        }
+        op.addRows(qint64(out.size()));
+        return out;
+    }
+
+    PayloadStats payloadStats() override {
+        auto op = track("payloadStats");
+        PayloadStats st;
+        QSqlQuery q(m_db);
+        // Размеры считаем в байтах UTF-8 (CAST AS BLOB), а не в символах
+        if (!execTimed(q, "SELECT COUNT(*), COALESCE(SUM(LENGTH(CAST(payload AS BLOB))), 0) FROM nodes "
+                    "WHERE payload_hash IS NULL AND payload IS NOT NULL")
+            || !q.next()) {
+            throw Errors::DbError(q.lastError().text().toStdString());
+        }
+        st.inlinePayloads = q.value(0).toLongLong();
+        qint64 inlineStored = q.value(1).toLongLong();
+        qint64 inlineLogical = inlineStored;
+
+        // Сжатые inline: исходный размер берём из заголовка qCompress, не распаковывая
+        if (!execTimed(q, "SELECT substr(payload_blob, 1, 4), LENGTH(payload_blob) FROM nodes "
+                    "WHERE payload_hash IS NULL AND payload_format != 0")) {
+            throw Errors::DbError(q.lastError().text().toStdString());
+        }
+        while (q.next()) {
+            ++st.inlinePayloads;
+            ++st.compressedPayloads;
+            inlineLogical += packedOriginalSize(q.value(0).toByteArray());
+            inlineStored += q.value(1).toLongLong();
+        }
+
+        if (!execTimed(q, "SELECT COUNT(*), COALESCE(SUM(LENGTH(CAST(p.data AS BLOB))), 0) "
+                    "FROM nodes n JOIN payloads p ON p.hash = n.payload_hash WHERE p.format = 0")
+            || !q.next()) {
+            throw Errors::DbError(q.lastError().text().toStdString());
+        }
+        qint64 sharedRefs = q.value(0).toLongLong();
+        qint64 sharedLogical = q.value(1).toLongLong();
+
+        if (!execTimed(q, "SELECT substr(p.packed, 1, 4), COUNT(*) "
+                    "FROM nodes n JOIN payloads p ON p.hash = n.payload_hash WHERE p.format != 0 GROUP BY p.hash")) {
+            throw Errors::DbError(q.lastError().text().toStdString());
+        }
+        while (q.next()) {
+            const qint64 refs = q.value(1).toLongLong();
+            sharedRefs += refs;
+            st.compressedPayloads += refs;
+            sharedLogical += refs * packedOriginalSize(q.value(0).toByteArray());
+        }
+
+        if (!execTimed(q, "SELECT COUNT(*), COALESCE(SUM(LENGTH(CAST(data AS BLOB)) + COALESCE(LENGTH(packed), 0)), 0) FROM payloads")
+            || !q.next()) {
+            throw Errors::DbError(q.lastError().text().toStdString());
+        }
+        st.sharedBlobs = q.value(0).toLongLong();
+        const qint64 sharedStored = q.value(1).toLongLong();
+
+        st.nodesWithPayload = st.inlinePayloads + sharedRefs;
+        st.logicalBytes = inlineLogical + sharedLogical;
+        st.storedBytes = inlineStored + sharedStored;
+        return st;
+    }
+
+    int collectPayloadGarbage() override {
+        auto op = track("collectPayloadGarbage");
+        if (!SqlTx::begin(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        QSqlQuery q(m_db);
+        if (!execTimed(q, "DELETE FROM payloads WHERE NOT EXISTS (SELECT 1 FROM nodes WHERE payload_hash = payloads.hash)")) {
+            SqlTx::rollback(m_db);
+            throw Errors::DbError(q.lastError().text().toStdString());
+        }
+        const int removed = q.numRowsAffected();
+        if (!SqlTx::commit(m_db)) throw Errors::DbError(m_db.lastError().text().toStdString());
+        return removed;
+    }
+
+    int dedupInlinePayloads(int limit) override {
+        auto op = track("dedupInlinePayloads");
+        if (!SqlTx::begin(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        int moved = 0;
+        try {
+            QSqlQuery sel(m_db);
+            // Условие совпадает с частичным индексом idx_nodes_inline_payload
+            sel.prepare("SELECT id, payload, payload_blob, payload_format FROM nodes "
+                        "WHERE payload IS NOT NULL OR payload_blob IS NOT NULL LIMIT ?");
+            sel.addBindValue(limit);
+            if (!execTimed(sel)) throw Errors::DbError(sel.lastError().text().toStdString());
+            QSqlQuery upd(m_db);
+            upd.prepare("UPDATE nodes SET payload = NULL, payload_blob = NULL, payload_format = 0, payload_hash = ? WHERE id = ?");
+            while (sel.next()) {
+                const auto text = decodePayload(sel.value(1), sel.value(2), sel.value(3).toInt());
+                const QString hash = storeSharedPayload(text.value_or(QString()));
+                upd.addBindValue(hash);
+                upd.addBindValue(sel.value(0).toLongLong());
+                if (!execTimed(upd)) throw Errors::DbError(upd.lastError().text().toStdString());
+                ++moved;
+            }
+        } catch (...) {
+            SqlTx::rollback(m_db);
+            throw;
+        }
+        if (!SqlTx::commit(m_db)) throw Errors::DbError(m_db.lastError().text().toStdString());
+        return moved;
+    }
+
+    bool compressPayloadBatch(PayloadCompactCursor &cursor, int limit) override {
+        auto op = track("compressPayloadBatch");
+        if (m_options.compressThreshold <= 0 || cursor.done()) return false;
+        // Обе таблицы обходим по rowid порциями: уже просмотренные (в т.ч. несжимаемые) строки не читаются повторно
+        const bool nodesTable = cursor.table == 0;
+        const QString select = nodesTable
+            ? "SELECT rowid, payload FROM nodes WHERE rowid > ? AND payload_format = 0 ORDER BY rowid LIMIT ?"
+            : "SELECT rowid, data FROM payloads WHERE rowid > ? AND format = 0 ORDER BY rowid LIMIT ?";
+        const QString update = nodesTable
+            ? "UPDATE nodes SET payload = NULL, payload_blob = ?, payload_format = ? WHERE rowid = ?"
+            : "UPDATE payloads SET data = '', packed = ?, format = ? WHERE rowid = ?";
+
+        if (!SqlTx::begin(m_db)) {
+            throw Errors::DbError(m_db.lastError().text().toStdString());
+        }
+        int seen = 0;
+        try {
+            QSqlQuery sel(m_db);
+            sel.prepare(select);
+            sel.addBindValue(cursor.lastRowId);
+            sel.addBindValue(limit);
+            if (!execTimed(sel)) throw Errors::DbError(sel.lastError().text().toStdString());
+            QSqlQuery upd(m_db);
+            upd.prepare(update);
+            while (sel.next()) {
+                ++seen;
+                cursor.lastRowId = sel.value(0).toLongLong();
+                if (sel.value(1).isNull()) continue;
+                const EncodedPayload e = encodePayload(sel.value(1).toString(), m_options.compressThreshold);
+                if (e.format == PAYLOAD_TEXT) continue;
+                upd.addBindValue(e.packed);
+                upd.addBindValue(e.format);
+                upd.addBindValue(cursor.lastRowId);
+                if (!execTimed(upd)) throw Errors::DbError(upd.lastError().text().toStdString());
+            }
+        } catch (...) {
+            SqlTx::rollback(m_db);
+            throw;
+        }
+        if (!SqlTx::commit(m_db)) throw Errors::DbError(m_db.lastError().text().toStdString());
+        if (seen < limit) {
+            ++cursor.table;
+            cursor.lastRowId = 0;
+        }
+        return !cursor.done();
     }
 
 private:
     QSqlDatabase m_db;
+    RepoOptions m_options;
+    // Замер, внутри которого сейчас выполняются запросы (nullptr — статистика выключена)
+    QueryScope *m_currentOp {nullptr};
+
+    // Span трассы вокруг замера: в трассе видна вся операция, включая запись статистики
+    struct OpScope {
+        Trace::Span span;
+        QueryScope stats;
+        void addRows(qint64 n) { stats.addRows(n); }
+    };
+
+    // Замер метода целиком: время, строки (прочитанные — addRows, изменённые — по exec) и последний SQL
+    OpScope track(const char *op) {
+        return OpScope{Trace::Span("repo", op), QueryScope(m_options.stats.get(), op, &m_currentOp)};
+    }
+
+    // exec с учётом в текущем замере; без статистики — обычный exec
+    bool execTimed(QSqlQuery &q, const QString &sql = QString()) {
+        const bool ok = sql.isNull() ? q.exec() : q.exec(sql);
+        if (m_currentOp) m_currentOp->noteStatement(q);
+        return ok;
+    }
+
+    // Кладёт текст в общее хранилище (если такого ещё нет) и возвращает его хеш.
+    // Вызывается внутри транзакции вызывающего метода.
+    QString storeSharedPayload(const QString &payload) {
+        const QString hash = payloadHash(payload);
+        const EncodedPayload e = encodePayload(payload, m_options.compressThreshold);
+        QSqlQuery q(m_db);
+        q.prepare("INSERT OR IGNORE INTO payloads(hash, data, packed, format) VALUES(?, ?, ?, ?)");
+        q.addBindValue(hash);
+        q.addBindValue(e.format == PAYLOAD_TEXT ? e.text : QVariant(QString(""))); // data NOT NULL
+        q.addBindValue(e.packed);
+        q.addBindValue(e.format);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        return hash;
+    }
+
+    // Удаляет текст из общего хранилища, если на него не ссылается ни один узел
+    void releaseSharedPayload(const QString &hash) {
+        QSqlQuery q(m_db);
+        q.prepare("DELETE FROM payloads WHERE hash = ? AND NOT EXISTS (SELECT 1 FROM nodes WHERE payload_hash = ?)");
+        q.addBindValue(hash);
+        q.addBindValue(hash);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+    }
+
+    // Следующий id в диапазоне RepoOptions::idBase/idSpan не ниже границы из id_floors (внутри транзакции
+    // вставки: граница и MAX по ключу читаются одним снимком с удалением ушедших узлов)
+    qint64 nextIdInRange() {
+        QSqlQuery q(m_db);
+        q.prepare("SELECT MAX(COALESCE((SELECT MAX(id) FROM nodes WHERE id >= ? AND id < ?), ?),"
+                  " COALESCE((SELECT floor FROM id_floors WHERE base = ?), ?)) + 1");
+        q.addBindValue(m_options.idBase);
+        q.addBindValue(m_options.idBase + m_options.idSpan);
+        q.addBindValue(m_options.idBase);
+        q.addBindValue(m_options.idBase);
+        q.addBindValue(m_options.idBase);
+        if (!execTimed(q) || !q.next()) throw Errors::DbError(q.lastError().text().toStdString());
+        const qint64 id = q.value(0).toLongLong();
+        if (id >= m_options.idBase + m_options.idSpan) {
+            throw Errors::DbError(QString("Node id range exhausted at %1").arg(m_options.idBase).toStdString());
+        }
+        return id;
+    }
+
+    // Поиск без учёта регистра: индекс (parent_id, name_fold, name); при нескольких вариантах регистра
+    // точное совпадение — первым. Строки, которым фоновая задача ещё не выдала name_fold, сравниваются
+    // здесь же через NameKeys::fold (их выборка — тот же индекс с name_fold IS NULL, после заполнения пустая).
+    std::optional<RepoRow> findChildFolded(qint64 parentId, const QString &name) {
+        const QString folded = NameKeys::fold(name);
+        std::optional<RepoRow> best;
+        const auto consider = [&](RepoRow row) {
+            if (!best.has_value() || (row.name == name && best->name != name)
+                || ((row.name == name) == (best->name == name) && row.name < best->name)) {
+                best = std::move(row);
+            }
+        };
+
+        QSqlQuery q(m_db);
+        q.prepare(QString(SELECT_META) + "WHERE n.parent_id = ? AND n.name_fold = ? ORDER BY (n.name = ?) DESC, n.name LIMIT 1");
+        q.addBindValue(parentId);
+        q.addBindValue(folded);
+        q.addBindValue(name);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        if (q.next()) {
+            RepoRow row = readMeta(q);
+            if (row.name == name) return row;
+            consider(std::move(row));
+        }
+
+        QSqlQuery legacy(m_db);
+        legacy.prepare(QString(SELECT_META) + "WHERE n.parent_id = ? AND n.name_fold IS NULL");
+        legacy.addBindValue(parentId);
+        if (!execTimed(legacy)) throw Errors::DbError(legacy.lastError().text().toStdString());
+        while (legacy.next()) {
+            RepoRow row = readMeta(legacy);
+            if (NameKeys::fold(row.name) == folded) consider(std::move(row));
+        }
+        return best;
+    }
+
+    std::optional<QString> currentPayloadHash(qint64 id) {
+        QSqlQuery q(m_db);
+        q.prepare("SELECT payload_hash FROM nodes WHERE id = ?");
+        q.addBindValue(id);
+        if (!execTimed(q)) throw Errors::DbError(q.lastError().text().toStdString());
+        if (!q.next() || q.value(0).isNull()) return std::nullopt;
+        return q.value(0).toString();
+    }
 };
 
-std::unique_ptr<INodeRepository> makeSqliteNodeRepository(const QSqlDatabase &db) {
-    return std::make_unique<SqliteNodeRepository>(db);
+std::unique_ptr<INodeRepository> makeSqliteNodeRepository(const QSqlDatabase &db, const RepoOptions &options) {
+    return std::make_unique<SqliteNodeRepository>(db, options);
 }
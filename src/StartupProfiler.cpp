@@ -0,0 +1,94 @@
+// StartupProfiler.cpp — часы запуска, список фаз под мьютексом, перехват первой отрисовки
+#include "StartupProfiler.h"
+
+#include <QElapsedTimer>
+#include <QEvent>
+#include <QWidget>
+#include <QDebug>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct State {
+    std::mutex mutex;
+    QElapsedTimer clock;
+    std::vector<std::pair<QString, qint64>> phases;
+};
+
+State &state() {
+    static State s;
+    return s;
+}
+
+// Первый Paint окна — кадр уже рисуется; фильтр снимает себя после срабатывания
+class FirstFrameWatcher : public QObject {
+public:
+    using QObject::QObject;
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override {
+        if (event->type() == QEvent::Paint) {
+            StartupProfiler::mark("first-frame");
+            watched->removeEventFilter(this);
+            deleteLater();
+        }
+        return false;
+    }
+};
+
+}
+
+namespace StartupProfiler {
+
+void start() {
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.clock.start();
+    s.phases.clear();
+    s.phases.emplace_back("process-start", 0);
+}
+
+void mark(const QString &phase) {
+    State &s = state();
+    qint64 ms = 0;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.clock.isValid()) return;
+        for (const auto &p : s.phases) {
+            if (p.first == phase) return;
+        }
+        ms = s.clock.elapsed();
+        s.phases.emplace_back(phase, ms);
+    }
+    qInfo().noquote() << QString("startup: %1 at %2 ms").arg(phase).arg(ms);
+}
+
+void watchFirstFrame(QWidget *window) {
+    if (!window) return;
+    window->installEventFilter(new FirstFrameWatcher(window));
+}
+
+qint64 elapsedAt(const QString &phase) {
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (const auto &p : s.phases) {
+        if (p.first == phase) return p.second;
+    }
+    return -1;
+}
+
+QString report() {
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    QString out;
+    qint64 prev = 0;
+    for (const auto &[phase, ms] : s.phases) {
+        out += QString("%1: %2 мс (+%3)\n").arg(phase).arg(ms).arg(ms - prev);
+        prev = ms;
+    }
+    return out;
+}
+
+}
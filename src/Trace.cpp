@@ -0,0 +1,173 @@
+// Trace.cpp — кольцевые буферы потоков (seqlock на слот) и экспорт в Chrome trace_event JSON
+#include "Trace.h"
+
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Событий на поток; при переполнении затираются самые старые
+constexpr quint64 RING_CAPACITY = 16384;
+
+std::atomic<bool> g_enabled {false};
+
+const std::chrono::steady_clock::time_point g_origin = std::chrono::steady_clock::now();
+
+qint64 nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_origin).count();
+}
+
+// Слот пишет только поток-владелец. seq = 2*i+1 во время записи события i и 2*i+2 после неё:
+// читатель берёт слот, только если seq до и после чтения полей равен 2*i+2.
+struct Slot {
+    std::atomic<quint64> seq {0};
+    std::atomic<const char*> category {nullptr};
+    std::atomic<const char*> name {nullptr};
+    std::atomic<qint64> startNs {0};
+    std::atomic<qint64> durNs {0};
+};
+
+struct ThreadBuffer {
+    int tid {0};
+    QString threadName; // под g_registryMutex
+    std::atomic<quint64> next {0};  // индекс следующего события
+    std::atomic<quint64> floor {0}; // события с меньшим индексом удалены clear()
+    std::array<Slot, RING_CAPACITY> slots;
+
+    void push(const char *category, const char *eventName, qint64 startNs, qint64 durNs) {
+        const quint64 i = next.load(std::memory_order_relaxed);
+        Slot &s = slots[i % RING_CAPACITY];
+        s.seq.store(2 * i + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.category.store(category, std::memory_order_relaxed);
+        s.name.store(eventName, std::memory_order_relaxed);
+        s.startNs.store(startNs, std::memory_order_relaxed);
+        s.durNs.store(durNs, std::memory_order_relaxed);
+        s.seq.store(2 * i + 2, std::memory_order_release);
+        next.store(i + 1, std::memory_order_release);
+    }
+};
+
+std::mutex g_registryMutex;
+// Буферы живут до конца процесса: события завершившихся потоков остаются доступны экспорту
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+int g_nextTid = 1;
+
+QString defaultThreadName(int tid) {
+    QThread *t = QThread::currentThread();
+    if (!t->objectName().isEmpty()) return t->objectName();
+    if (QCoreApplication *app = QCoreApplication::instance(); app && app->thread() == t) return "main";
+    return QString("thread-%1").arg(tid);
+}
+
+ThreadBuffer &localBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+        auto b = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        b->tid = g_nextTid++;
+        b->threadName = defaultThreadName(b->tid);
+        g_buffers.push_back(b);
+        return b;
+    }();
+    return *buffer;
+}
+
+}
+
+namespace Trace {
+
+void setEnabled(bool enabled) {
+    g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void setThreadName(const QString &name) {
+    ThreadBuffer &b = localBuffer();
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    b.threadName = name;
+}
+
+void clear() {
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    for (const auto &b : g_buffers) {
+        b->floor.store(b->next.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+QByteArray exportChromeJson() {
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::vector<QString> names;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        buffers = g_buffers;
+        for (const auto &b : buffers) names.push_back(b->threadName);
+    }
+    const qint64 pid = QCoreApplication::applicationPid();
+    const auto us = [](qint64 ns) { return double(ns) / 1000.0; };
+
+    QJsonArray events;
+    for (size_t k = 0; k < buffers.size(); ++k) {
+        ThreadBuffer &b = *buffers[k];
+        QJsonObject meta;
+        meta["ph"] = "M";
+        meta["name"] = "thread_name";
+        meta["pid"] = pid;
+        meta["tid"] = b.tid;
+        meta["args"] = QJsonObject{{"name", names[k]}};
+        events.append(meta);
+
+        const quint64 end = b.next.load(std::memory_order_acquire);
+        quint64 begin = b.floor.load(std::memory_order_relaxed);
+        if (end > RING_CAPACITY) begin = std::max(begin, end - RING_CAPACITY);
+        for (quint64 i = begin; i < end; ++i) {
+            const Slot &s = b.slots[i % RING_CAPACITY];
+            const quint64 done = 2 * i + 2;
+            if (s.seq.load(std::memory_order_acquire) != done) continue;
+            const char *category = s.category.load(std::memory_order_relaxed);
+            const char *eventName = s.name.load(std::memory_order_relaxed);
+            const qint64 startNs = s.startNs.load(std::memory_order_relaxed);
+            const qint64 durNs = s.durNs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // Владелец уже перезаписывает слот следующим кругом — событие потеряно
+            if (s.seq.load(std::memory_order_relaxed) != done) continue;
+
+            QJsonObject e;
+            e["ph"] = "X";
+            e["cat"] = QString::fromLatin1(category);
+            e["name"] = QString::fromLatin1(eventName);
+            e["ts"] = us(startNs);
+            e["dur"] = us(durNs);
+            e["pid"] = pid;
+            e["tid"] = b.tid;
+            events.append(e);
+        }
+    }
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+Span::Span(const char *category, const char *name)
+    : m_category(category), m_name(name), m_startNs(g_enabled.load(std::memory_order_relaxed) ? nowNs() : -1) {}
+
+Span::~Span() {
+    if (m_startNs < 0) return;
+    // Выключение посреди интервала не теряет его: иначе в трассе остались бы «висящие» родители
+    localBuffer().push(m_category, m_name, m_startNs, nowNs() - m_startNs);
+}
+
+}
@@ -3,8 +3,16 @@
 #include "Errors.h"
 #include "INodeRepository.h"
 #include "INodeFactory.h"
+#include "SortKey.h"
+#include "Trace.h"
 
 #include <QStringList>
+#include <QIODevice>
+
+#include <algorithm>
+
+// Длина ключа ручного порядка, после которой группа сиблингов ставится в очередь на перебалансировку
+static constexpr int MAX_SORT_KEY_LENGTH = 24;
 
 // Внедряем зависимости: репозиторий (доступ к БД) и фабрика (нормализация/валидация имен)
 TreeService::TreeService(std::unique_ptr<INodeRepository> repo,
@@ -17,48 +25,182 @@ void TreeService::ensureValidName(const QString &name) const {
     m_factory->validateName(normalized);
 }
 
-// Создание дочернего узла: имя нормализуется/валидируется, затем сохраняется в БД
+// Нормализованное имя или InvalidName (без исключений)
+Result<QString> TreeService::checkedName(const QString &raw) const {
+    const QString normalized = m_factory->normalizeName(raw);
+    const QString error = m_factory->nameError(normalized);
+    if (!error.isEmpty()) return Error{ErrorCode::InvalidName, error};
+    return normalized;
+}
+
 qint64 TreeService::createNode(qint64 parentId, const QString &name, std::optional<QString> payload) {
-    ensureValidName(name);
+    return tryCreateNode(parentId, name, std::move(payload)).valueOrThrow();
+}
+
+// Создание дочернего узла: имя нормализуется/валидируется, затем сохраняется в БД
+Result<qint64> TreeService::tryCreateNode(qint64 parentId, const QString &name, std::optional<QString> payload) {
+    TRACE_SPAN("service", "createNode");
+    noteWrite();
+    auto call = record(WorkloadOp::CreateNode, [&] {
+        QVariantList args {parentId, name};
+        appendPayloadArgs(args, payload);
+        return args;
+    });
+    const Result<QString> normalized = checkedName(name);
+    if (!normalized) {
+        call.setFailed(true);
+        return normalized.error();
+    }
     // Уникальность среди сиблингов обеспечит уникальный индекс
-    const QString normalized = m_factory->normalizeName(name);
-    return m_repo->insert(parentId, normalized, payload);
+    Result<qint64> id = m_repo->tryInsert(parentId, normalized.value(), payload);
+    call.setFailed(!id.ok());
+    if (id) call.setResult(id.value());
+    return id;
 }
 
-// Переименование узла и инвалидация кеша метаданных этого узла
 void TreeService::renameNode(qint64 id, const QString &newName) {
-    ensureValidName(newName);
-    const QString normalized = m_factory->normalizeName(newName);
-    m_repo->updateName(id, normalized);
-    invalidateCache(id);
+    tryRenameNode(id, newName).valueOrThrow();
+}
+
+// Переименование узла и инвалидация кеша метаданных этого узла
+Result<void> TreeService::tryRenameNode(qint64 id, const QString &newName) {
+    noteWrite();
+    auto call = record(WorkloadOp::RenameNode, [&] { return QVariantList {id, newName}; });
+    const Result<QString> normalized = checkedName(newName);
+    if (!normalized) {
+        call.setFailed(true);
+        return normalized.error();
+    }
+    Result<void> result = m_repo->tryUpdateName(id, normalized.value());
+    call.setFailed(!result.ok());
+    if (result) invalidateCache(id);
+    return result;
 }
 
 // Небольшой враппер для явного сравнения qint64
 static bool safeEq(qint64 a, qint64 b) { return a == b; }
 
-// Проверяет, находится ли nodeId в поддереве potentialAncestorId (или совпадает)
-bool TreeService::isDescendant(qint64 nodeId, qint64 potentialAncestorId) {
-    if (safeEq(nodeId, potentialAncestorId)) return true;
-    auto parentOpt = m_repo->getParentId(nodeId);
-    while (parentOpt.has_value()) {
-        const qint64 p = parentOpt.value();
-        if (safeEq(p, potentialAncestorId)) return true;
-        parentOpt = m_repo->getParentId(p);
+// Перемещает узел к новому родителю; запрещено переносить в собственного потомка
+void TreeService::moveNode(qint64 id, qint64 newParentId) {
+    TRACE_SPAN("service", "moveNode");
+    moveNodeBetween(id, newParentId, 0, 0);
+}
+
+Result<void> TreeService::tryMoveNode(qint64 id, qint64 newParentId) {
+    return tryMoveNodes({ id }, newParentId, 0, 0);
+}
+
+// Перемещение с позицией в ручном порядке: вычисляется ключ между соседями, пишется одна строка
+void TreeService::moveNodeBetween(qint64 id, qint64 newParentId, qint64 prevSiblingId, qint64 nextSiblingId) {
+    moveNodes({ id }, newParentId, prevSiblingId, nextSiblingId);
+}
+
+void TreeService::moveNodes(const std::vector<qint64> &ids, qint64 newParentId,
+                            qint64 prevSiblingId, qint64 nextSiblingId) {
+    tryMoveNodes(ids, newParentId, prevSiblingId, nextSiblingId).valueOrThrow();
+}
+
+Result<void> TreeService::tryMoveNodes(const std::vector<qint64> &ids, qint64 newParentId,
+                                       qint64 prevSiblingId, qint64 nextSiblingId) {
+    TRACE_SPAN("service", "moveNodes");
+    noteWrite();
+    auto call = record(WorkloadOp::MoveNodes, [&] {
+        return QVariantList {workloadIdList(ids), newParentId, prevSiblingId, nextSiblingId};
+    });
+    Result<void> result = moveNodesImpl(ids, newParentId, prevSiblingId, nextSiblingId);
+    call.setFailed(!result.ok());
+    return result;
+}
+
+// Пакетное перемещение: одна проверка циклов, ключи подряд между соседями, одна транзакция
+Result<void> TreeService::moveNodesImpl(const std::vector<qint64> &ids, qint64 newParentId,
+                                        qint64 prevSiblingId, qint64 nextSiblingId) {
+    std::vector<qint64> unique;
+    std::unordered_set<qint64> moving;
+    for (const qint64 id : ids) {
+        if (moving.insert(id).second) unique.push_back(id);
     }
-    return false;
+    if (unique.empty()) return {};
+
+    // Узел нельзя перенести в себя или потомка: значит, ни один из них не должен быть предком нового родителя
+    const auto ancestors = m_repo->getAncestorIds(newParentId);
+    if (ancestors.empty()) return Error{ErrorCode::NotFound, "Parent not found"};
+    for (const qint64 a : ancestors) {
+        if (moving.count(a)) return Error{ErrorCode::MoveIntoDescendant, "Cannot move into own descendant"};
+    }
+
+    const auto [lo, hi] = sortKeyBounds(newParentId, unique.front(), prevSiblingId, nextSiblingId);
+    const QStringList keys = SortKey::sequence(lo, hi, int(unique.size()));
+    std::vector<std::pair<qint64, QString>> idKeys;
+    idKeys.reserve(unique.size());
+    bool longKeys = false;
+    for (size_t i = 0; i < unique.size(); ++i) {
+        idKeys.emplace_back(unique[i], keys.at(int(i)));
+        longKeys = longKeys || keys.at(int(i)).size() > MAX_SORT_KEY_LENGTH;
+    }
+    Result<void> moved = idKeys.size() == 1
+        ? m_repo->tryMoveTo(idKeys.front().first, newParentId, idKeys.front().second)
+        : m_repo->tryMoveManyTo(idKeys, newParentId);
+    if (!moved) return moved;
+
+    for (const qint64 id : unique) invalidateCache(id);
+    if (longKeys) m_rebalanceQueue.insert(newParentId);
+    return {};
 }
 
-// Перемещает узел к новому родителю; запрещено переносить в собственного потомка
-void TreeService::moveNode(qint64 id, qint64 newParentId) {
-    if (isDescendant(newParentId, id)) {
-        throw Errors::MoveIntoDescendant("Cannot move into own descendant");
+std::pair<QString, QString> TreeService::sortKeyBounds(qint64 parentId, qint64 id, qint64 prevSiblingId, qint64 nextSiblingId) {
+    // Сосед без ключа (старый файл) — один раз выдаём ключи всей группе, дальше перемещения O(1)
+    const qint64 anchor = prevSiblingId != 0 ? prevSiblingId : nextSiblingId;
+    if (anchor != 0 && m_repo->sortKeyOf(anchor).isEmpty()) {
+        rebalanceSortKeys(parentId);
     }
-    m_repo->updateParent(id, newParentId);
-    invalidateCache(id);
+    // Второго соседа берём из БД, а не из UI: в виджете может быть загружена не вся группа
+    if (prevSiblingId != 0) {
+        const QString lo = m_repo->sortKeyOf(prevSiblingId);
+        return { lo, m_repo->neighborSortKey(parentId, lo, true, id) };
+    }
+    if (nextSiblingId != 0) {
+        const QString hi = m_repo->sortKeyOf(nextSiblingId);
+        return { m_repo->neighborSortKey(parentId, hi, false, id), hi };
+    }
+    return { m_repo->lastSortKey(parentId, id), QString() };
+}
+
+void TreeService::rebalanceSortKeys(qint64 parentId) {
+    const auto rows = m_repo->getChildrenPage(parentId, ChildOrder::Manual, -1, 0);
+    const QStringList keys = SortKey::sequence(QString(), QString(), int(rows.size()));
+    std::vector<std::pair<qint64, QString>> assignment;
+    assignment.reserve(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        assignment.emplace_back(rows[i].id, keys.at(int(i)));
+    }
+    m_repo->assignSortKeys(assignment);
+}
+
+bool TreeService::rebalancePendingSortKeys() {
+    if (m_rebalanceQueue.empty()) return false;
+    const qint64 parentId = *m_rebalanceQueue.begin();
+    m_rebalanceQueue.erase(m_rebalanceQueue.begin());
+    rebalanceSortKeys(parentId);
+    return !m_rebalanceQueue.empty();
+}
+
+bool TreeService::backfillSortKeysBatch(qint64 &cursor, int limit) {
+    const auto rows = m_repo->findUnkeyedRows(cursor, limit);
+    std::unordered_set<qint64> parents;
+    for (const auto &[rowId, parentId] : rows) {
+        cursor = rowId;
+        // Группа целиком получает ключи за раз; её остальные строки дальше уже не попадутся
+        if (parents.insert(parentId).second) rebalanceSortKeys(parentId);
+    }
+    return int(rows.size()) == limit;
 }
 
 // Удаляет узел (кроме корня). Кеш очищается для затронутых узлов.
 void TreeService::deleteNode(qint64 id) {
+    TRACE_SPAN("service", "deleteNode");
+    noteWrite();
+    auto call = record(WorkloadOp::DeleteNode, [&] { return QVariantList {id}; });
     if (safeEq(id, ROOT_ID)) {
         throw Errors::InvalidName("Cannot delete root");
     }
@@ -66,10 +208,21 @@ void TreeService::deleteNode(qint64 id) {
     invalidateCache(id);
 }
 
-// Подкачивает метаданные узла в кеш, если их еще нет
+void TreeService::deleteNodes(const std::vector<qint64> &ids) {
+    TRACE_SPAN("service", "deleteNodes");
+    noteWrite();
+    auto call = record(WorkloadOp::DeleteNodes, [&] { return QVariantList {workloadIdList(ids)}; });
+    for (const qint64 id : ids) {
+        if (safeEq(id, ROOT_ID)) throw Errors::InvalidName("Cannot delete root");
+    }
+    m_repo->removeMany(ids);
+    for (const qint64 id : ids) invalidateCache(id);
+}
+
+// Подкачивает метаданные узла в кеш, если их еще нет (без payload — распаковывать его здесь незачем)
 void TreeService::warmCache(qint64 id) {
     if (m_metaCache.find(id) != m_metaCache.end()) return;
-    auto r = m_repo->get(id);
+    auto r = m_repo->getMeta(id);
     if (!r.has_value()) throw Errors::NotFound("Node not found");
     CacheEntry ce { r->parentId.value_or(0), r->name };
     m_metaCache[id] = std::move(ce);
@@ -82,10 +235,16 @@ void TreeService::invalidateCache(qint64 id) {
 
 // Собирает путь от корня до узла вида "a/b/c". Корню соответствует пустая строка
 QString TreeService::buildPath(qint64 id) {
+    TRACE_SPAN("service", "buildPath");
+    auto call = record(WorkloadOp::BuildPath, [&] { return QVariantList {id}; });
     if (safeEq(id, ROOT_ID)) return QString();
     QStringList segments;
     auto current = id;
     while (true) {
+        // Цикл по parent_id в повреждённом файле иначе повесил бы поток GUI
+        if (segments.size() >= MAX_TREE_DEPTH) {
+            throw Errors::CorruptTree(QString("Path exceeds depth limit at node %1").arg(id).toStdString());
+        }
         warmCache(current);
         const auto it = m_metaCache.find(current);
         if (it == m_metaCache.end()) break;
@@ -100,32 +259,92 @@ QString TreeService::buildPath(qint64 id) {
     return segments.join('/');
 }
 
+qint64 TreeService::resolvePath(const QString &path, NameMatch match) {
+    return tryResolvePath(path, match).valueOrThrow();
+}
+
 // Ищет узел по строковому пути. Пустой путь => корень. Каждый сегмент нормализуется/валидируется
-qint64 TreeService::resolvePath(const QString &path) {
+Result<qint64> TreeService::tryResolvePath(const QString &path, NameMatch match) {
+    TRACE_SPAN("service", "resolvePath");
+    auto call = record(WorkloadOp::ResolvePath, [&] { return QVariantList {path, int(match)}; });
     if (path.isEmpty()) return ROOT_ID;
     const auto segments = path.split('/', Qt::SkipEmptyParts);
     qint64 current = ROOT_ID;
     for (const auto &segRaw : segments) {
-        const QString seg = m_factory->normalizeName(segRaw);
-        m_factory->validateName(seg);
-        auto child = m_repo->findChildByName(current, seg);
+        const Result<QString> seg = checkedName(segRaw);
+        if (!seg) {
+            call.setFailed(true);
+            return seg.error();
+        }
+        auto child = m_repo->findChildByName(current, seg.value(), match);
         if (!child.has_value()) {
-            throw Errors::NotFound("Path segment not found");
+            call.setFailed(true);
+            return Error{ErrorCode::NotFound, "Path segment not found"};
         }
         current = child->id;
     }
     return current;
 }
 
+// Шаблон компилируется в план: литералы — точный поиск, префиксы — диапазон индекса, прочее — перебор детей
+PathMatchCursor TreeService::match(const QString &pattern) {
+    return PathMatchCursor(*m_repo, ROOT_ID, compilePathPattern(pattern, *m_factory));
+}
+
+std::vector<qint64> TreeService::ancestorChain(qint64 id) {
+    auto chain = m_repo->getAncestorIds(id);
+    std::reverse(chain.begin(), chain.end());
+    return chain;
+}
+
+qint64 TreeService::childPosition(qint64 id, ChildOrder order) {
+    return m_repo->childPosition(id, order);
+}
+
+// Поиск ребёнка по имени (имя предварительно нормализуется, как при создании)
+std::optional<NodeDTO> TreeService::findChild(qint64 parentId, const QString &name, NameMatch match) {
+    auto call = record(WorkloadOp::FindChild, [&] { return QVariantList {parentId, name, int(match)}; });
+    const QString normalized = m_factory->normalizeName(name);
+    auto row = m_repo->findChildByName(parentId, normalized, match);
+    if (!row.has_value()) return std::nullopt;
+    NodeDTO dto;
+    dto.id = row->id;
+    dto.parentId = row->parentId.value_or(0);
+    dto.name = row->name;
+    dto.hasChildren = m_repo->hasChildren(row->id);
+    return dto;
+}
+
+bool TreeService::backfillNameKeysBatch(int limit) {
+    return m_repo->backfillNameKeys(limit) == limit;
+}
+
 // Возвращает детей с пагинацией и признаком наличия потомков (для ленивой подгрузки UI)
-std::vector<NodeDTO> TreeService::listChildren(qint64 parentId, size_t limit, size_t offset) {
-    auto rows = m_repo->getChildren(parentId);
+std::vector<NodeDTO> TreeService::listChildren(qint64 parentId, size_t limit, size_t offset, ChildOrder order) {
+    TRACE_SPAN("service", "listChildren");
+    auto call = record(WorkloadOp::ListChildren, [&] {
+        return QVariantList {parentId, limit == SIZE_MAX ? qint64(-1) : qint64(limit), qint64(offset), int(order)};
+    });
+    // Пагинация на стороне БД: читаются только строки запрошенной страницы
+    const qint64 sqlLimit = limit == SIZE_MAX ? -1 : qint64(limit);
+    return childDtos(m_repo->getChildrenPage(parentId, order, sqlLimit, qint64(offset)));
+}
+
+// Страница по ключу порядка от соседнего узла: цена не зависит от того, насколько далеко окно от начала
+std::vector<NodeDTO> TreeService::listChildrenFrom(qint64 parentId, qint64 anchorId, PageDirection direction,
+                                                   size_t limit, ChildOrder order) {
+    TRACE_SPAN("service", "listChildrenFrom");
+    auto call = record(WorkloadOp::ListChildrenFrom, [&] {
+        return QVariantList {parentId, anchorId, int(direction), limit == SIZE_MAX ? qint64(-1) : qint64(limit), int(order)};
+    });
+    const qint64 sqlLimit = limit == SIZE_MAX ? -1 : qint64(limit);
+    return childDtos(m_repo->getChildrenFrom(parentId, order, anchorId, direction, sqlLimit));
+}
+
+std::vector<NodeDTO> TreeService::childDtos(const std::vector<RepoRow> &rows) {
     std::vector<NodeDTO> out;
     out.reserve(rows.size());
-    size_t i = 0;
     for (const auto &r : rows) {
-        if (i++ < offset) continue;
-        if (out.size() >= limit) break;
         NodeDTO dto;
         dto.id = r.id;
         dto.parentId = r.parentId.value_or(0);
@@ -133,18 +352,139 @@ std::vector<NodeDTO> TreeService::listChildren(qint64 parentId, size_t limit, si
         dto.hasChildren = m_repo->hasChildren(r.id);
         out.push_back(std::move(dto));
     }
+    fillAttachmentSummary(out);
+    return out;
+}
+
+static std::vector<NodeDTO> toDtos(const std::vector<SubtreeRow> &rows) {
+    std::vector<NodeDTO> out;
+    out.reserve(rows.size());
+    for (const auto &r : rows) {
+        NodeDTO dto;
+        dto.id = r.row.id;
+        dto.parentId = r.row.parentId.value_or(0);
+        dto.name = r.row.name;
+        dto.hasChildren = r.hasChildren;
+        out.push_back(std::move(dto));
+    }
+    return out;
+}
+
+// Поддерево одним рекурсивным запросом: признак детей считается в том же запросе, без N вызовов hasChildren
+std::vector<NodeDTO> TreeService::listSubtree(qint64 rootId, int maxDepth, size_t limit) {
+    auto call = record(WorkloadOp::ListSubtree, [&] {
+        return QVariantList {rootId, maxDepth, limit == SIZE_MAX ? qint64(-1) : qint64(limit)};
+    });
+    const qint64 sqlLimit = limit == SIZE_MAX ? -1 : qint64(limit);
+    const auto rows = m_repo->getSubtree(rootId, maxDepth, sqlLimit);
+    std::vector<NodeDTO> out = toDtos(rows);
+    fillAttachmentSummary(out);
+    return out;
+}
+
+// Только подсчёт: без сортировки, колонок и сводки по вложениям
+size_t TreeService::countSubtree(qint64 rootId, int maxDepth, size_t limit) {
+    const qint64 sqlLimit = limit == SIZE_MAX ? -1 : qint64(limit);
+    return size_t(m_repo->countSubtree(rootId, maxDepth, sqlLimit));
+}
+
+std::vector<NodeDTO> TreeService::listChildrenOfMany(const std::vector<qint64> &parentIds, ChildOrder order) {
+    auto call = record(WorkloadOp::ListChildrenOfMany, [&] { return QVariantList {workloadIdList(parentIds), int(order)}; });
+    const auto rows = m_repo->getChildrenOfMany(parentIds, order);
+    std::vector<NodeDTO> out = toDtos(rows);
+    fillAttachmentSummary(out);
     return out;
 }
 
+void TreeService::fillAttachmentSummary(std::vector<NodeDTO> &nodes) {
+    if (!m_attachments || nodes.empty()) return;
+    // Сводка по вложениям для всей выборки одним запросом, содержимое не читается
+    std::vector<qint64> ids;
+    ids.reserve(nodes.size());
+    for (const auto &dto : nodes) ids.push_back(dto.id);
+    const auto summary = m_attachments->summarize(ids);
+    for (auto &dto : nodes) {
+        const auto it = summary.find(dto.id);
+        if (it == summary.end()) continue;
+        dto.attachmentCount = it->second.count;
+        dto.attachmentBytes = it->second.totalBytes;
+    }
+}
+
 // Сохраняет произвольный JSON payload узла
 void TreeService::setPayload(qint64 id, const QString &payloadJson) {
+    noteWrite();
+    auto call = record(WorkloadOp::SetPayload, [&] {
+        QVariantList args {id};
+        appendPayloadArgs(args, payloadJson);
+        return args;
+    });
     m_repo->setPayload(id, payloadJson);
 }
 
 // Возвращает JSON payload узла; при отсутствии — пустую строку
 QString TreeService::getPayload(qint64 id) {
+    auto call = record(WorkloadOp::GetPayload, [&] { return QVariantList {id}; });
     auto p = m_repo->getPayload(id);
     if (!p.has_value()) return QString();
     return p.value();
 
 }
+
+void TreeService::appendPayloadArgs(QVariantList &args, const std::optional<QString> &payload) const {
+    args << (payload.has_value() ? qint64(payload->size()) : qint64(-1));
+    if (payload.has_value() && m_recorder->keepPayloads()) args << *payload;
+}
+
+std::unordered_map<qint64, QString> TreeService::getPayloads(const std::vector<qint64> &ids) {
+    return m_repo->getPayloads(ids);
+}
+
+// Объём payload логический/фактический и коэффициент дедупликации для текущего файла
+PayloadStats TreeService::payloadStats() {
+    return m_repo->payloadStats();
+}
+
+// Удаляет из общего хранилища тексты, на которые больше никто не ссылается
+int TreeService::collectPayloadGarbage() {
+    return m_repo->collectPayloadGarbage();
+}
+
+// Переносит порцию inline-payload в общее хранилище (для уже существующих файлов)
+int TreeService::dedupInlinePayloads(int limit) {
+    return m_repo->dedupInlinePayloads(limit);
+}
+
+// Сжимает порцию старых payload выше порога (фоновый мигратор)
+bool TreeService::compressPayloadBatch(PayloadCompactCursor &cursor, int limit) {
+    return m_repo->compressPayloadBatch(cursor, limit);
+}
+
+void TreeService::setAttachmentRepository(std::unique_ptr<IAttachmentRepository> attachments) {
+    m_attachments = std::move(attachments);
+}
+
+IAttachmentRepository &TreeService::attachments() {
+    if (!m_attachments) throw Errors::DbError("Attachment storage is not configured");
+    return *m_attachments;
+}
+
+// Имя вложения проходит те же правила, что и имя узла (без '/', не пустое, ≤ 255)
+AttachmentInfo TreeService::attachFile(qint64 nodeId, const QString &name, QIODevice &source) {
+    noteWrite();
+    ensureValidName(name);
+    return attachments().write(nodeId, m_factory->normalizeName(name), source);
+}
+
+std::vector<AttachmentInfo> TreeService::listAttachments(qint64 nodeId) {
+    return attachments().list(nodeId);
+}
+
+std::unique_ptr<QIODevice> TreeService::openAttachment(qint64 attachmentId) {
+    return attachments().openRead(attachmentId);
+}
+
+void TreeService::removeAttachment(qint64 attachmentId) {
+    noteWrite();
+    attachments().remove(attachmentId);
+}
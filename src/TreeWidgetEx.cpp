@@ -1,7 +1,9 @@
 // TreeWidgetEx.cpp — подтверждение drag&drop перемещений через сервис
 #include "TreeWidgetEx.h"
+#include "Trace.h"
 #include <QDropEvent>
 #include <QMimeData>
+#include <QTreeWidgetItemIterator>
 
 // В Qt InternalMove по умолчанию перемещает элементы. Мы перехватим и подтвердим у сервиса.
 
@@ -14,29 +16,67 @@ static QTreeWidgetItem* itemAtPos(QTreeWidget *tw, const QPoint &pos) {
     return tw->itemAt(pos);
 }
 
-void TreeWidgetEx::dropEvent(QDropEvent *event) {
-    // Определим целевого родителя
-    QTreeWidgetItem *targetItem = itemAtPos(this, event->position().toPoint());
-    if (!targetItem) {
-        // Перемещение в корень (дети системного root id=1)
+QList<QTreeWidgetItem*> TreeWidgetEx::selectedTopMostItems() const {
+    QList<QTreeWidgetItem*> out;
+    // Обход в порядке отображения: порядок selectedItems() зависит от порядка кликов
+    for (QTreeWidgetItemIterator it(const_cast<TreeWidgetEx*>(this), QTreeWidgetItemIterator::Selected); *it; ++it) {
+        QTreeWidgetItem *item = *it;
+        if (item->data(0, Qt::UserRole).toLongLong() == 0) continue; // плейсхолдер
+        bool underSelected = false;
+        for (QTreeWidgetItem *p = item->parent(); p && !underSelected; p = p->parent()) {
+            underSelected = p->isSelected();
+        }
+        if (!underSelected) out.append(item);
     }
+    return out;
+}
 
-    // Источник — выделенный элемент
-    auto selected = currentItem();
-    if (!selected) { event->ignore(); return; }
+void TreeWidgetEx::dropEvent(QDropEvent *event) {
+    TRACE_SPAN("ui", "dropEvent");
+    // Источник — выделенные элементы (без вложенных в другие выделенные)
+    QList<QTreeWidgetItem*> selected = selectedTopMostItems();
+    if (selected.isEmpty() && currentItem()) selected.append(currentItem());
+    if (selected.isEmpty()) { event->ignore(); return; }
 
-    const qint64 sourceId = selected->data(0, Qt::UserRole).toLongLong();
-    qint64 newParentId = 1; // root
+    // Определим целевого родителя и позицию по индикатору: на элемент — в конец его детей,
+    // над/под элементом — рядом с ним среди его сиблингов, в пустую область — в конец верхнего уровня
+    QTreeWidgetItem *targetItem = itemAtPos(this, event->position().toPoint());
+    QTreeWidgetItem *newParentItem = nullptr;
+    int row = -1;
     if (targetItem) {
-        newParentId = targetItem->data(0, Qt::UserRole).toLongLong();
+        switch (dropIndicatorPosition()) {
+        case QAbstractItemView::OnItem:
+            newParentItem = targetItem;
+            break;
+        case QAbstractItemView::AboveItem:
+        case QAbstractItemView::BelowItem: {
+            newParentItem = targetItem->parent();
+            const int index = newParentItem ? newParentItem->indexOfChild(targetItem) : indexOfTopLevelItem(targetItem);
+            row = dropIndicatorPosition() == QAbstractItemView::AboveItem ? index : index + 1;
+            break;
+        }
+        case QAbstractItemView::OnViewport:
+            break;
+        }
     }
 
     bool accepted = false;
-    emit requestMove(sourceId, newParentId, accepted);
+    emit requestMove(selected, newParentItem, row, accepted);
+
+    // То, что базовая реализация делает в конце drop: остановить автопрокрутку и сбросить состояние
+    stopAutoScroll();
+    setState(QAbstractItemView::NoState);
+    viewport()->update();
     if (!accepted) {
         event->ignore();
         return;
     }
-    // Если сервис одобрил — позволяем базовой реализации выполнить перемещение
-    QTreeWidget::dropEvent(event);
+    // Элементы уже перенесены обработчиком. IgnoreAction — чтобы startDrag не удалил «источник» повторно.
+    event->setDropAction(Qt::IgnoreAction);
+    event->accept();
+}
+
+void TreeWidgetEx::paintEvent(QPaintEvent *event) {
+    TRACE_SPAN("ui", "paintEvent");
+    QTreeWidget::paintEvent(event);
 }
@@ -0,0 +1,117 @@
+// WorkloadRecorder.cpp — формат журнала нагрузки (QDataStream) и RAII-запись вызовов сервиса
+#include "WorkloadRecorder.h"
+#include "Errors.h"
+
+#include <exception>
+
+const char *workloadOpName(WorkloadOp op) {
+    switch (op) {
+    case WorkloadOp::CreateNode: return "createNode";
+    case WorkloadOp::RenameNode: return "renameNode";
+    case WorkloadOp::MoveNodes: return "moveNodes";
+    case WorkloadOp::DeleteNodes: return "deleteNodes";
+    case WorkloadOp::SetPayload: return "setPayload";
+    case WorkloadOp::GetPayload: return "getPayload";
+    case WorkloadOp::ListChildren: return "listChildren";
+    case WorkloadOp::ListChildrenOfMany: return "listChildrenOfMany";
+    case WorkloadOp::ListSubtree: return "listSubtree";
+    case WorkloadOp::BuildPath: return "buildPath";
+    case WorkloadOp::ResolvePath: return "resolvePath";
+    case WorkloadOp::FindChild: return "findChild";
+    case WorkloadOp::DeleteNode: return "deleteNode";
+    case WorkloadOp::ListChildrenFrom: return "listChildrenFrom";
+    }
+    return "unknown";
+}
+
+static void writeRecord(QDataStream &out, const WorkloadRecord &r) {
+    out << quint8(r.op) << r.atUs << r.durationNs << r.ok << r.result << r.args;
+}
+
+WorkloadRecorder::WorkloadRecorder(const QString &filePath, const RepoOptions &storage, bool keepPayloads)
+    : m_file(filePath), m_keepPayloads(keepPayloads) {
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        throw Errors::DbError(("Cannot write workload log: " + filePath).toStdString());
+    }
+    m_out.setDevice(&m_file);
+    m_out.setVersion(QDataStream::Qt_6_0);
+    m_out << MAGIC << VERSION << storage.dedupPayloads << qint32(storage.compressThreshold);
+    m_clock.start();
+}
+
+WorkloadRecorder::~WorkloadRecorder() {
+    flush();
+}
+
+qint64 WorkloadRecorder::recordCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+void WorkloadRecorder::append(const WorkloadRecord &record) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_out.status() != QDataStream::Ok) return;
+    writeRecord(m_out, record);
+    ++m_count;
+}
+
+void WorkloadRecorder::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file.flush();
+}
+
+WorkloadReader::WorkloadReader(const QString &filePath) : m_file(filePath) {
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        throw Errors::DbError(("Cannot read workload log: " + filePath).toStdString());
+    }
+    m_in.setDevice(&m_file);
+    m_in.setVersion(QDataStream::Qt_6_0);
+    quint32 magic = 0;
+    quint16 version = 0;
+    m_in >> magic >> version;
+    if (magic != WorkloadRecorder::MAGIC || version == 0 || version > WorkloadRecorder::VERSION) {
+        throw Errors::DbError(("Not a workload log (or newer format): " + filePath).toStdString());
+    }
+    if (version >= 2) {
+        RepoOptions storage;
+        qint32 threshold = 0;
+        m_in >> storage.dedupPayloads >> threshold;
+        storage.compressThreshold = threshold;
+        m_storage = storage;
+    }
+}
+
+bool WorkloadReader::next(WorkloadRecord &record) {
+    if (m_in.atEnd()) return false;
+    quint8 op = 0;
+    m_in >> op >> record.atUs >> record.durationNs >> record.ok >> record.result >> record.args;
+    // Приложение могло завершиться посреди записи — хвост отбрасывается
+    if (m_in.status() != QDataStream::Ok) return false;
+    record.op = WorkloadOp(op);
+    return true;
+}
+
+WorkloadCall::WorkloadCall(WorkloadRecorder *recorder, int *depth, WorkloadOp op, QVariantList args)
+    : m_recorder(recorder), m_depth(depth), m_exceptions(std::uncaught_exceptions()) {
+    ++*m_depth;
+    m_record.op = op;
+    m_record.args = std::move(args);
+    m_record.atUs = recorder->elapsedUs();
+    m_timer.start();
+}
+
+WorkloadCall::~WorkloadCall() {
+    if (!m_recorder) return;
+    m_record.durationNs = m_timer.nsecsElapsed();
+    --*m_depth;
+    // Ошибка или выход по исключению: вызов тоже воспроизводится (ошибки — часть нагрузки), но помечается
+    m_record.ok = !m_failed && std::uncaught_exceptions() <= m_exceptions;
+    m_recorder->append(m_record);
+}
+
+QVariantList workloadIdList(const std::vector<qint64> &ids) {
+    QVariantList out;
+    out.reserve(qsizetype(ids.size()));
+    for (const qint64 id : ids) out << id;
+    return out;
+}
@@ -1,11 +1,15 @@
 #include <QApplication>
 //#include <QTableView>
 #include "mainwindow.h"
+#include "StartupProfiler.h"
 
 // Точка входа в программу
 // argc - количество аргументов командной строки
 // argv - массив строк с аргументами командной строки
 int main(int argc, char* argv[]) {
+    // Часы фаз запуска — как можно раньше
+    StartupProfiler::start();
+
     // QApplication - основной класс любого Qt-приложения с GUI
     // Он управляет:
     // - Главным циклом событий (event loop)
@@ -35,6 +39,8 @@ int main(int argc, char* argv[]) {
     // - showMaximized(): показать развёрнутым
     // - showMinimized(): показать свёрнутым
     // - showFullScreen(): полноэкранный режим
+    // time-to-first-frame: отметка при первой отрисовке главного окна
+    StartupProfiler::watchFirstFrame(&window);
     window.show();
 
     // Запускаем главный цикл обработки событий (event loop)
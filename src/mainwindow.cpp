@@ -4,6 +4,13 @@
 #include "ui_mainwindow.h"
 // Подключаем класс второго окна (полное определение)
 #include "secondwindow.h"
+#include "Db.h"
+#include "DbMaintenance.h"
+#include "StartupProfiler.h"
+#include <QThread>
+#include <QApplication>
+#include <QMessageBox>
+#include <QDebug>
 
 // Конструктор главного окна
 MainWindow::MainWindow(QWidget* parent)
@@ -15,10 +22,28 @@ MainWindow::MainWindow(QWidget* parent)
     ui->setupUi(this);
 
 
-    // ВАЖНО: Создаём второе окно сразу при инициализации главного окна
-    // this передаём как parent - это обеспечивает автоматическое удаление
-    // второго окна при удалении главного (управление памятью Qt)
-    secondWindow = new SecondWindow(this);
+    // Второе окно НЕ создаётся здесь: открытие БД, миграции и загрузка корня дерева
+    // задерживали бы первую отрисовку этого окна. Схему готовим в рабочем потоке
+    // (у него своё соединение), а само окно — при первом переходе (ensureSecondWindow).
+    m_schemaError = std::make_shared<QString>();
+    m_schemaThread = QThread::create([path = SecondWindow::databaseFile(), error = m_schemaError]() {
+        try {
+            Db::prepareSchema(path);
+            StartupProfiler::mark("db-schema-ready");
+        } catch (const std::exception &ex) {
+            *error = QString::fromUtf8(ex.what());
+            return;
+        }
+        // Старый файл один раз перестраивается под auto_vacuum = INCREMENTAL — здесь, а не при открытии
+        // (openAndInit и prepareSchema зовут и утилиты, и шарды, и резервная копия)
+        try {
+            logMaintenance(DbMaintenance::enableIncrementalVacuum(path));
+        } catch (const std::exception &ex) {
+            qWarning() << "auto_vacuum = INCREMENTAL postponed:" << ex.what();
+        }
+    });
+    m_schemaThread->setParent(this);
+    m_schemaThread->start();
 
     // Устанавливаем соединения сигналов и слотов
 
@@ -31,11 +56,9 @@ MainWindow::MainWindow(QWidget* parent)
         this, &MainWindow::onSwitchToSecondWindowGuest);
 
 
-    // 2. Соединение: сигнал из второго окна -> слот показа первого окна
-    // Когда второе окно испускает backToFirstWindow, мы показываем первое окно
-    connect(secondWindow, &SecondWindow::backToFirstWindow,
-            this, &MainWindow::onShowFirstWindow);
+    // 2. Соединение второго окна с onShowFirstWindow — в ensureSecondWindow()
 
+    StartupProfiler::mark("main-window-constructed");
 
     // Примечание: используем новый синтаксис connect (Qt5+)
     // Преимущества:
@@ -49,6 +72,11 @@ MainWindow::MainWindow(QWidget* parent)
 
 // Деструктор главного окна
 MainWindow::~MainWindow() {
+    // Поток подготовки схемы — наш ребёнок; удалять работающий QThread нельзя
+    if (m_schemaThread) {
+        m_schemaThread->wait();
+    }
+
     // Удаляем UI-объект
     delete ui;
 
@@ -57,10 +85,36 @@ MainWindow::~MainWindow() {
     // родитель автоматически удаляет всех своих детей
 }
 
+bool MainWindow::ensureSecondWindow() {
+    if (secondWindow) return true;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    // Обычно поток давно завершён; иначе ждём — второе окно без схемы не откроется
+    m_schemaThread->wait();
+    if (!m_schemaError->isEmpty()) {
+        // openAndInit повторит миграции синхронно и сообщит ошибку, если она устойчивая
+        qWarning() << "Background schema preparation failed:" << *m_schemaError;
+    }
+    try {
+        // this передаём как parent - второе окно удалится вместе с главным
+        secondWindow = new SecondWindow(this);
+    } catch (const std::exception &ex) {
+        QApplication::restoreOverrideCursor();
+        QMessageBox::critical(this, "Ошибка", QString::fromUtf8(ex.what()));
+        return false;
+    }
+    QApplication::restoreOverrideCursor();
+
+    // Сигнал из второго окна -> слот показа первого окна
+    connect(secondWindow, &SecondWindow::backToFirstWindow,
+            this, &MainWindow::onShowFirstWindow);
+    return true;
+}
+
 // Слот для перехода ко второму окну
 void MainWindow::onSwitchToSecondWindow() {
-    // Проверяем, что второе окно существует
-    if (secondWindow) {
+    // Создаём второе окно при первом переходе
+    if (ensureSecondWindow()) {
         // hide() - скрывает текущее окно (не удаляет из памяти!)
         // Окно остаётся в памяти со всеми данными
         this->hide();
@@ -80,7 +134,7 @@ void MainWindow::onSwitchToSecondWindow() {
 }
 
 void MainWindow::onSwitchToSecondWindowGuest(){
-    if (secondWindow) {
+    if (ensureSecondWindow()) {
         // hide() - скрывает текущее окно (не удаляет из памяти!)
         // Окно остаётся в памяти со всеми данными
         this->hide();
@@ -7,12 +7,75 @@
 #include <QtSql/QSqlDatabase>
 
 #include "Db.h"
+#include "AppRepoOptions.h"
 #include "INodeFactory.h"
 #include "TreeService.h"
 #include "widgetsTreeFeeler.h"
 #include "TreeWidgetEx.h"
+#include "BackgroundBatchRunner.h"
+#include "Errors.h"
+#include "ChildPageCache.h"
+#include "ChildPrefetcher.h"
+#include "StartupProfiler.h"
+#include "DataMigrations.h"
+#include "QueryStats.h"
+#include "Trace.h"
+#include "WorkloadRecorder.h"
+#include "BackupJob.h"
+#include "IntegrityChecker.h"
+#include "DbMaintenance.h"
 #include <QThread>
+#include <QGuiApplication>
+#include <QMenuBar>
+#include <QMessageBox>
+#include <QToolBar>
+#include <QLineEdit>
+#include <QStatusBar>
+#include <QSettings>
+#include <QLabel>
+#include <QTimer>
+#include <QFileInfo>
+#include <QFileDialog>
+#include <QFile>
+#include <QSignalBlocker>
+#include <QInputDialog>
+#include <QDir>
+#include <QCryptographicHash>
+#include <QDebug>
 #include <cstddef>
+#include <memory>
+
+// Порция фоновой обработки payload (перенос/сжатие) за один шаг
+static constexpr int PAYLOAD_BATCH = 500;
+// Сборка мусора в общем хранилище payload
+static constexpr int PAYLOAD_GC_INTERVAL_MS = 5 * 60 * 1000;
+// Выдача ключей ручного порядка старым строкам — порция за шаг
+static constexpr int SORT_KEY_BACKFILL_BATCH = 1000;
+// Проверка очереди перебалансировки ключей ручного порядка
+static constexpr int SORT_KEY_REBALANCE_INTERVAL_MS = 10 * 1000;
+// Заполнение name_fold/name_natural у старых строк — порция за шаг
+static constexpr int NAME_KEY_BACKFILL_BATCH = 1000;
+// Миграции данных (перезапись старых строк) — строк за шаг; шаг — одна короткая транзакция
+static constexpr int DATA_MIGRATION_BATCH = 2000;
+// Операция репозитория дольше порога попадает в журнал медленных запросов
+static constexpr qint64 SLOW_QUERY_THRESHOLD_MS = 20;
+// Период обновления метрик в строке состояния
+static constexpr int STATUS_METRICS_INTERVAL_MS = 1000;
+// Резервная копия уступает UI: шаги копии ждут столько тишины после последнего обращения переднего плана
+static constexpr qint64 BACKUP_FOREGROUND_QUIET_MS = 150;
+// Снимков по расписанию хранится по умолчанию (настройка backup/keep)
+static constexpr int BACKUP_KEEP_DEFAULT = 7;
+// Проверка, не пора ли делать снимок по расписанию
+static constexpr int BACKUP_SCHEDULE_CHECK_MS = 10 * 60 * 1000;
+// Облегчённая проверка целостности после открытия — когда первичная загрузка дерева уже прошла
+static constexpr int INTEGRITY_STARTUP_DELAY_MS = 60 * 1000;
+// Обслуживание файла БД идёт только в простое: столько без обращений переднего плана к БД
+static constexpr qint64 MAINTENANCE_QUIET_MS = 2000;
+// Периоды шагов обслуживания: optimize, проверка свободных страниц, PASSIVE checkpoint
+static constexpr int MAINTENANCE_OPTIMIZE_INTERVAL_MS = 60 * 60 * 1000;
+static constexpr int MAINTENANCE_VACUUM_INTERVAL_MS = 5 * 60 * 1000;
+static constexpr int MAINTENANCE_CHECKPOINT_INTERVAL_MS = 30 * 1000;
+
 
 
 
@@ -31,14 +94,26 @@ SecondWindow::SecondWindow(QWidget* parent)
     ui->backButton->setDisabled(true);
 
     // Инициализация БД и сервисов
-    const QString conn = Db::openAndInit("app_conn", "tree.sqlite");
+    // Схема обычно уже подготовлена в фоне (Db::prepareSchema) — здесь версия совпадёт и миграции пропустятся
+    const QString conn = Db::openAndInit("app_conn", databaseFile());
     QSqlDatabase db = QSqlDatabase::database(conn);
     m_db = new QSqlDatabase(db);
     m_factory = makeNodeFactory();
-    m_repo = makeSqliteNodeRepository(*m_db);
+    // Общее хранилище и сжатие payload — те же настройки, что у treectl и tree_replay
+    RepoOptions repoOptions = appRepoOptions();
+    m_storageOptions = repoOptions;
+    m_queryStats = std::make_shared<QueryStats>(SLOW_QUERY_THRESHOLD_MS);
+    repoOptions.stats = m_queryStats;
+    m_repo = makeSqliteNodeRepository(*m_db, repoOptions);
+    // Любая запись в дерево сбрасывает кеш предвыборки (объект репозитория переживает перенос в сервис)
+    m_pageCache = std::make_shared<ChildPageCache>();
+    connect(m_repo.get(), &INodeRepository::treeMapChanged, this, [cache = m_pageCache]() { cache->clear(); });
+    INodeRepository *repo = m_repo.get();
     m_service = std::make_unique<TreeService>(std::move(m_repo), std::move(m_factory));
+    m_service->setAttachmentRepository(makeSqliteAttachmentRepository(*m_db));
+    // Запись UI (переименование, перемещение, payload, вложения, удаление) — тоже активность переднего плана
+    m_service->setWriteObserver([cache = m_pageCache]() { cache->noteForegroundActivity(); });
 
-    resetTreeMap();
     // Подмена QTreeWidget на расширенный класс в рантайме не требуется — он уже QTreeWidget.
     // Для простоты обернём существующий в feeler (он принимает TreeWidgetEx*, кастуем безопасно)
     auto *treeEx = qobject_cast<TreeWidgetEx*>(ui->treeWidget);
@@ -58,6 +133,14 @@ SecondWindow::SecondWindow(QWidget* parent)
 
     m_feeler = std::make_unique<WidgetsTreeFeeler>(treeEx, m_service.get(), this);
     m_feeler->initialize();
+    // Колонки payload: запись в дерево этим процессом или возврат в окно после правок извне
+    connect(repo, &INodeRepository::treeMapChanged, m_feeler.get(), &WidgetsTreeFeeler::clearPayloadColumns);
+    connect(qGuiApp, &QGuiApplication::applicationStateChanged, m_feeler.get(), [feeler = m_feeler.get()](Qt::ApplicationState state) {
+        if (state == Qt::ApplicationActive) feeler->clearPayloadColumns();
+    });
+    StartupProfiler::mark("tree-loaded");
+    setupPrefetch();
+    restoreTreeState();
 
     //ui->treeWidget->setColumnCount(2);
     // Подключаем сигнал clicked() от кнопки backButton к нашему слоту
@@ -73,48 +156,50 @@ SecondWindow::SecondWindow(QWidget* parent)
     connect(ui->backButton, &QPushButton::clicked,
             this, &SecondWindow::onBackButtonClicked);
 
-   // Возвращает всех детей родителя, отсортированных по имени.
-  // virtual std::vector<RepoRow> getChildren(qint64 parentId) = 0;
-
-   // Быстрая проверка наличия хотя бы одного ребёнка.
-    //  virtual bool hasChildren(qint64 id) = 0;
-/*
-    std::map<qint64, RepoRow> tree;
-    fillTreeMapRecursive(1, tree);
-    size_t size = tree.size();
-*/
-    //QThread::sleep(10);
-}
+    QMenu *toolsMenu = ui->menubar->addMenu("Сервис");
+    QAction *payloadReportAct = toolsMenu->addAction("Отчёт о payload");
+    connect(payloadReportAct, &QAction::triggered, this, &SecondWindow::onPayloadReport);
+    QAction *startupReportAct = toolsMenu->addAction("Профиль запуска");
+    connect(startupReportAct, &QAction::triggered, this, &SecondWindow::onStartupReport);
+    QAction *queryStatsAct = toolsMenu->addAction("Замер запросов");
+    queryStatsAct->setCheckable(true);
+    queryStatsAct->setChecked(m_queryStats->enabled());
+    connect(queryStatsAct, &QAction::toggled, this, [this](bool on) { m_queryStats->setEnabled(on); });
+    QAction *dumpStatsAct = toolsMenu->addAction("Статистика запросов в JSON...");
+    connect(dumpStatsAct, &QAction::triggered, this, &SecondWindow::onDumpQueryStats);
+    QAction *traceAct = toolsMenu->addAction("Трассировка");
+    traceAct->setCheckable(true);
+    traceAct->setChecked(Trace::enabled());
+    connect(traceAct, &QAction::toggled, this, [](bool on) {
+        // Каждое включение начинает трассу заново
+        if (on) Trace::clear();
+        Trace::setEnabled(on);
+    });
+    QAction *saveTraceAct = toolsMenu->addAction("Сохранить трассировку...");
+    connect(saveTraceAct, &QAction::triggered, this, &SecondWindow::onSaveTrace);
+    m_recordWorkloadAct = toolsMenu->addAction("Запись нагрузки...");
+    m_recordWorkloadAct->setCheckable(true);
+    connect(m_recordWorkloadAct, &QAction::toggled, this, &SecondWindow::onToggleWorkloadRecording);
+    toolsMenu->addSeparator();
+    m_backupAct = toolsMenu->addAction("Резервная копия...");
+    connect(m_backupAct, &QAction::triggered, this, &SecondWindow::onBackupNow);
+    QAction *backupScheduleAct = toolsMenu->addAction("Снимки по расписанию...");
+    connect(backupScheduleAct, &QAction::triggered, this, &SecondWindow::onBackupSchedule);
+    m_integrityAct = toolsMenu->addAction("Проверка целостности");
+    connect(m_integrityAct, &QAction::triggered, this, &SecondWindow::onIntegrityCheck);
 
-void SecondWindow::resetTreeMap() {
-    m_treeMap.clear();
-    fillTreeMapRecursive(1, m_treeMap);
+    setupNavigationBar();
+    setupStatusMetrics();
+    setupBackgroundTasks();
+    setupBackupSchedule();
+    QTimer::singleShot(INTEGRITY_STARTUP_DELAY_MS, this, [this]() { startIntegrityCheck(false); });
+    StartupProfiler::mark("second-window-constructed");
 }
 
-void SecondWindow::fillTreeMapRecursive(qint64 nodeId, std::map<qint64, RepoRow>& tree) {
-    if (!m_repo) return;
-
-    // Получаем данные узла по id
-    auto nodeOpt = m_repo->get(nodeId);
-    if (!nodeOpt.has_value()) {
-        return; // Узел не найден
-    }
-
-    RepoRow node = nodeOpt.value();
-
-    // Добавляем узел в map
-    tree[nodeId] = node;
-
-    // Получаем всех детей этого узла
-    std::vector<RepoRow> children = m_repo->getChildren(nodeId);
-
-    // Рекурсивно обрабатываем каждого ребёнка
-    for (const auto& child : children) {
-        fillTreeMapRecursive(child.id, tree);
-    }
+QString SecondWindow::databaseFile() {
+    return "tree.sqlite";
 }
 
-
 bool SecondWindow::fillTreeWidget() {
     if (m_feeler) { m_feeler->initialize(); return true; }
     return false;
@@ -150,6 +235,21 @@ bool SecondWindow::removeItemFromTreeWidget(QTreeWidgetItem *item) {
 
 // Деструктор SecondWindow
 SecondWindow::~SecondWindow() {
+    saveTreeState();
+    stopIntegrityCheck();
+    stopBackup();
+    stopPrefetch();
+    // Задачи раннера держат указатели на объекты ниже — останавливаем до их удаления
+    if (m_batchRunner) m_batchRunner->stop();
+    m_dataMigrations.reset();
+    // SQLite советует optimize перед закрытием: статистика по запросам этой сессии
+    if (m_db) {
+        try {
+            logMaintenance(DbMaintenance(*m_db).optimize());
+        } catch (const std::exception &ex) {
+            qWarning() << "PRAGMA optimize failed:" << ex.what();
+        }
+    }
     // Удаляем UI-объект из памяти
     // Важно: виджеты, созданные через setupUi(), удаляются автоматически
     // как дочерние объекты окна, но сам ui-объект нужно удалить явно
@@ -162,6 +262,453 @@ SecondWindow::~SecondWindow() {
     }
 }
 
+// Группа QSettings для файла БД: хеш абсолютного пути (сам путь с '/' стал бы вложенными группами)
+static QString treeStateGroup(const QSqlDatabase &db) {
+    const QString path = QFileInfo(db.databaseName()).absoluteFilePath();
+    return "treeState/" + QString::fromLatin1(QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Md5).toHex());
+}
+
+static QVariantList toVariantList(const QList<qint64> &ids) {
+    QVariantList out;
+    out.reserve(ids.size());
+    for (const qint64 id : ids) out.append(QVariant::fromValue<qlonglong>(id));
+    return out;
+}
+
+static QList<qint64> toIdList(const QVariant &value) {
+    QList<qint64> out;
+    for (const QVariant &v : value.toList()) {
+        bool ok = false;
+        const qint64 id = v.toLongLong(&ok);
+        if (ok) out.append(id);
+    }
+    return out;
+}
+
+void SecondWindow::saveTreeState() {
+    if (!m_feeler || !m_db) return;
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "qt_mill", "tree");
+    settings.beginGroup(treeStateGroup(*m_db));
+    settings.setValue("dbPath", QFileInfo(m_db->databaseName()).absoluteFilePath());
+    settings.setValue("expanded", toVariantList(m_feeler->expandedIds()));
+    settings.setValue("selected", toVariantList(m_feeler->selectedIds()));
+    settings.setValue("history", toVariantList(m_feeler->expandHistory()));
+    settings.endGroup();
+}
+
+void SecondWindow::restoreTreeState() {
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "qt_mill", "tree");
+    settings.beginGroup(treeStateGroup(*m_db));
+    const QList<qint64> expanded = toIdList(settings.value("expanded"));
+    const QList<qint64> selected = toIdList(settings.value("selected"));
+    const QList<qint64> history = toIdList(settings.value("history"));
+    settings.endGroup();
+    // Без сохранённого состояния дерево уже загружено initialize()
+    if (!expanded.isEmpty() || !selected.isEmpty()) m_feeler->restoreState(expanded, selected);
+    m_feeler->setExpandHistory(history);
+}
+
+void SecondWindow::setupPrefetch() {
+    m_prefetchThread = new QThread(this);
+    m_prefetcher = new ChildPrefetcher(QFileInfo(m_db->databaseName()).absoluteFilePath(), m_pageCache);
+    m_prefetcher->moveToThread(m_prefetchThread);
+    connect(m_prefetchThread, &QThread::started, m_prefetcher, &ChildPrefetcher::start);
+    m_prefetchThread->start(QThread::LowestPriority);
+    m_feeler->setPrefetch(m_pageCache, m_prefetcher);
+}
+
+void SecondWindow::stopPrefetch() {
+    if (!m_prefetchThread) return;
+    // Соединение закрывается в том же потоке, где открывалось
+    QMetaObject::invokeMethod(m_prefetcher, &ChildPrefetcher::stop, Qt::BlockingQueuedConnection);
+    m_prefetchThread->quit();
+    m_prefetchThread->wait();
+    delete m_prefetcher;
+    m_prefetcher = nullptr;
+    m_prefetchThread = nullptr;
+}
+
+void SecondWindow::startBackup(const QString &targetPath, bool scheduled) {
+    if (m_backupThread) return;
+    m_backupScheduled = scheduled;
+    m_backupAct->setEnabled(false);
+    m_backupStatus = "Резервная копия: начало";
+    std::shared_ptr<ChildPageCache> cache = m_pageCache;
+    m_backupThread = new QThread(this);
+    m_backupJob = new BackupJob(QFileInfo(m_db->databaseName()).absoluteFilePath(), targetPath, [cache]() {
+        // Как у предвыборки: пока UI читает или пишет в БД, копия ждёт
+        return cache->msSinceForegroundActivity() < BACKUP_FOREGROUND_QUIET_MS;
+    });
+    m_backupJob->moveToThread(m_backupThread);
+    connect(m_backupThread, &QThread::started, m_backupJob, &BackupJob::start);
+    connect(m_backupJob, &BackupJob::progress, this, [this](const BackupProgress &p) {
+        m_backupStatus = QString("Резервная копия: %1% (%2, %3 МБ/с)")
+                             .arg(qRound(p.fraction * 100))
+                             .arg(p.table)
+                             .arg(p.bytesPerSec() / (1024.0 * 1024.0), 0, 'f', 1);
+    });
+    connect(m_backupJob, &BackupJob::finished, this, &SecondWindow::onBackupFinished);
+    m_backupThread->start(QThread::LowestPriority);
+}
+
+void SecondWindow::stopBackup() {
+    if (!m_backupThread) return;
+    QMetaObject::invokeMethod(m_backupJob, &BackupJob::cancel, Qt::BlockingQueuedConnection);
+    m_backupThread->quit();
+    m_backupThread->wait();
+    delete m_backupJob;
+    m_backupJob = nullptr;
+    m_backupThread = nullptr;
+}
+
+void SecondWindow::onBackupFinished(bool ok, const QString &targetPath, const QString &error) {
+    stopBackup();
+    m_backupAct->setEnabled(true);
+    m_backupStatus.clear();
+    if (!ok) {
+        qWarning() << "Backup failed:" << error;
+        if (!m_backupScheduled) QMessageBox::warning(this, "Резервная копия", "Не удалось создать копию: " + error);
+        return;
+    }
+    if (m_backupScheduled) {
+        QSettings settings(QSettings::IniFormat, QSettings::UserScope, "qt_mill", "tree");
+        settings.beginGroup("backup");
+        settings.setValue("lastMs", QDateTime::currentMSecsSinceEpoch());
+        const int keep = settings.value("keep", BACKUP_KEEP_DEFAULT).toInt();
+        settings.endGroup();
+        const QFileInfo target(targetPath);
+        OnlineBackup::rotateSnapshots(target.absolutePath(), QFileInfo(m_db->databaseName()).completeBaseName(), keep);
+    }
+    statusBar()->showMessage("Резервная копия сохранена: " + targetPath, 5000);
+}
+
+void SecondWindow::onBackupNow() {
+    const QString path = QFileDialog::getSaveFileName(this, "Резервная копия", "tree-backup.sqlite", "SQLite (*.sqlite)");
+    if (path.isEmpty()) return;
+    if (QFileInfo(path).absoluteFilePath() == QFileInfo(m_db->databaseName()).absoluteFilePath()) {
+        QMessageBox::warning(this, "Резервная копия", "Копию нельзя записать поверх рабочего файла");
+        return;
+    }
+    startBackup(path, false);
+}
+
+void SecondWindow::onBackupSchedule() {
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "qt_mill", "tree");
+    settings.beginGroup("backup");
+    bool ok = false;
+    const int hours = QInputDialog::getInt(this, "Снимки по расписанию",
+                                           QString("Интервал в часах (0 — выключено); хранится снимков: %1")
+                                               .arg(settings.value("keep", BACKUP_KEEP_DEFAULT).toInt()),
+                                           settings.value("intervalHours", 0).toInt(), 0, 24 * 30, 1, &ok);
+    if (!ok) return;
+    settings.setValue("intervalHours", hours);
+    settings.endGroup();
+    checkBackupSchedule();
+}
+
+void SecondWindow::setupBackupSchedule() {
+    auto *timer = new QTimer(this);
+    connect(timer, &QTimer::timeout, this, &SecondWindow::checkBackupSchedule);
+    timer->start(BACKUP_SCHEDULE_CHECK_MS);
+}
+
+void SecondWindow::checkBackupSchedule() {
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, "qt_mill", "tree");
+    settings.beginGroup("backup");
+    const int hours = settings.value("intervalHours", 0).toInt();
+    const qint64 lastMs = settings.value("lastMs", 0).toLongLong();
+    settings.endGroup();
+    if (hours <= 0 || m_backupThread) return;
+    const QDateTime now = QDateTime::currentDateTime();
+    if (now.toMSecsSinceEpoch() - lastMs < qint64(hours) * 3600 * 1000) return;
+
+    const QFileInfo db(m_db->databaseName());
+    const QString dir = db.absolutePath() + "/backups";
+    if (!QDir().mkpath(dir)) {
+        qWarning() << "Cannot create backup directory" << dir;
+        return;
+    }
+    startBackup(dir + "/" + OnlineBackup::snapshotFileName(db.completeBaseName(), now), true);
+}
+
+void SecondWindow::startIntegrityCheck(bool interactive) {
+    if (m_integrityThread) return;
+    m_integrityAct->setEnabled(false);
+    IntegrityOptions options;
+    // Полный проход по страницам индексов — только по запросу пользователя
+    options.checkIndexes = interactive;
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    auto report = std::make_shared<IntegrityReport>();
+    auto error = std::make_shared<QString>();
+    m_integrityCancel = cancel;
+    m_integrityThread = QThread::create([path = QFileInfo(m_db->databaseName()).absoluteFilePath(), options, cancel, report, error]() {
+        try {
+            *report = IntegrityChecker(path, options).run(cancel.get());
+        } catch (const std::exception &ex) {
+            *error = QString::fromUtf8(ex.what());
+        }
+    });
+    m_integrityThread->setParent(this);
+    connect(m_integrityThread, &QThread::finished, this, [this, interactive, report, error]() {
+        stopIntegrityCheck();
+        onIntegrityFinished(*report, *error, interactive);
+    });
+    m_integrityThread->start(QThread::LowestPriority);
+}
+
+void SecondWindow::stopIntegrityCheck() {
+    if (!m_integrityThread) return;
+    // Флаг проверяется между этапами: уже начатый запрос дорабатывает
+    m_integrityCancel->store(true);
+    m_integrityThread->wait();
+    delete m_integrityThread;
+    m_integrityThread = nullptr;
+    m_integrityCancel.reset();
+    m_integrityAct->setEnabled(true);
+}
+
+void SecondWindow::onIntegrityFinished(const IntegrityReport &report, const QString &error, bool interactive) {
+    if (!error.isEmpty()) {
+        qWarning() << "Integrity check failed:" << error;
+        if (interactive) QMessageBox::warning(this, "Проверка целостности", "Не удалось проверить файл: " + error);
+        return;
+    }
+    const QString text = report.toText();
+    if (report.ok()) {
+        qDebug().noquote() << "Integrity check:" << text;
+        if (interactive) QMessageBox::information(this, "Проверка целостности", text);
+        return;
+    }
+    qWarning().noquote() << "Integrity check:\n" + text;
+    if (!interactive) {
+        statusBar()->showMessage(QString("Найдены нарушения структуры дерева: %1 — подробности: Сервис → Проверка целостности")
+                                     .arg(report.issues.size()), 30000);
+        return;
+    }
+    QMessageBox box(QMessageBox::Warning, "Проверка целостности",
+                    QString("Найдены нарушения структуры дерева: %1").arg(report.issues.size()), QMessageBox::Ok, this);
+    box.setDetailedText(text);
+    box.exec();
+}
+
+void SecondWindow::onIntegrityCheck() {
+    startIntegrityCheck(true);
+}
+
+void SecondWindow::setupStatusMetrics() {
+    auto *itemsLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(itemsLabel);
+    auto *timer = new QTimer(this);
+    connect(timer, &QTimer::timeout, this, [this, itemsLabel]() {
+        const ChildPageCache::Stats st = m_pageCache->stats();
+        QString text = QString("Элементов в дереве: %1 | Предвыборка: %2% (%3 из %4)")
+                           .arg(m_feeler->liveItemCount())
+                           .arg(qRound(st.hitRate() * 100))
+                           .arg(st.hits)
+                           .arg(st.lookups);
+        if (m_queryStats->enabled()) {
+            const QueryStatsSnapshot qs = m_queryStats->snapshot();
+            qint64 calls = 0;
+            for (const OpStats &o : qs.ops) calls += o.calls;
+            text += QString(" | Запросов: %1, медленных: %2").arg(calls).arg(qs.slowTotal);
+            // Самая дорогая операция по суммарному времени
+            if (!qs.ops.empty()) {
+                text += QString(" (%1: p99 %2 мс)").arg(qs.ops.front().op).arg(double(qs.ops.front().p99Ns) / 1e6, 0, 'f', 1);
+            }
+        }
+        if (m_dataMigrations) {
+            try {
+                for (const DataMigrationProgress &p : m_dataMigrations->progress()) {
+                    if (p.done) continue;
+                    text += QString(" | Миграция %1: %2% (%3 строк)")
+                                .arg(p.name)
+                                .arg(qRound(p.fraction() * 100))
+                                .arg(p.processed);
+                }
+            } catch (const std::exception &ex) {
+                qDebug() << "Data migration progress unavailable:" << ex.what();
+            }
+        }
+        if (!m_backupStatus.isEmpty()) text += " | " + m_backupStatus;
+        itemsLabel->setText(text);
+    });
+    timer->start(STATUS_METRICS_INTERVAL_MS);
+}
+
+void SecondWindow::setupNavigationBar() {
+    QToolBar *navBar = addToolBar("Навигация");
+    navBar->setMovable(false);
+    m_pathEdit = new QLineEdit(navBar);
+    m_pathEdit->setPlaceholderText("Путь (a/b/c) или #id — Enter для перехода");
+    m_pathEdit->setClearButtonEnabled(true);
+    navBar->addWidget(m_pathEdit);
+    connect(m_pathEdit, &QLineEdit::returnPressed, this, &SecondWindow::onJumpToPath);
+    // Выбор узла в дереве показывает его путь
+    connect(m_feeler.get(), &WidgetsTreeFeeler::itemClicked, this, [this](qint64 id) {
+        try {
+            m_pathEdit->setText(m_service->buildPath(id));
+        } catch (const std::exception &ex) {
+            qDebug() << "buildPath failed:" << ex.what();
+        }
+    });
+}
+
+void SecondWindow::onJumpToPath() {
+    const QString text = m_pathEdit->text().trimmed();
+    if (text.isEmpty()) return;
+    try {
+        qint64 id = 0;
+        if (text.startsWith('#')) {
+            bool ok = false;
+            id = text.mid(1).toLongLong(&ok);
+            if (!ok) throw Errors::InvalidName("Invalid node id");
+        } else {
+            try {
+                id = m_service->resolvePath(text);
+            } catch (const Errors::NotFound &) {
+                // Точного совпадения нет — пробуем без учёта регистра
+                id = m_service->resolvePath(text, NameMatch::CaseInsensitive);
+            }
+        }
+        if (!m_feeler->revealNode(id)) {
+            statusBar()->showMessage("Узел не найден", 3000);
+            return;
+        }
+        m_pathEdit->setText(m_service->buildPath(id));
+    } catch (const std::exception &ex) {
+        QMessageBox::warning(this, "Переход", QString::fromUtf8(ex.what()));
+    }
+}
+
+void SecondWindow::onPayloadReport() {
+    if (!m_service) return;
+    try {
+        const PayloadStats st = m_service->payloadStats();
+        const QString text = QString(
+            "Узлов с payload: %1\n"
+            "  из них inline: %2\n"
+            "Уникальных текстов в хранилище: %3\n"
+            "Логический объём: %4 байт\n"
+            "Фактический объём: %5 байт\n"
+            "Коэффициент дедупликации: %6")
+            .arg(st.nodesWithPayload)
+            .arg(st.inlinePayloads)
+            .arg(st.sharedBlobs)
+            .arg(st.logicalBytes)
+            .arg(st.storedBytes)
+            .arg(st.dedupRatio(), 0, 'f', 2);
+        QMessageBox::information(this, "Payload", text);
+    } catch (const std::exception &ex) {
+        QMessageBox::warning(this, "Ошибка", QString::fromUtf8(ex.what()));
+    }
+}
+
+void SecondWindow::onStartupReport() {
+    QMessageBox::information(this, "Профиль запуска", StartupProfiler::report());
+}
+
+void SecondWindow::onDumpQueryStats() {
+    const QString path = QFileDialog::getSaveFileName(this, "Статистика запросов", "query_stats.json", "JSON (*.json)");
+    if (path.isEmpty()) return;
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось записать " + path);
+        return;
+    }
+    f.write(m_queryStats->toJson());
+}
+
+void SecondWindow::onSaveTrace() {
+    const QString path = QFileDialog::getSaveFileName(this, "Трассировка", "trace.json", "Chrome trace (*.json)");
+    if (path.isEmpty()) return;
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось записать " + path);
+        return;
+    }
+    f.write(Trace::exportChromeJson());
+}
+
+void SecondWindow::onToggleWorkloadRecording(bool on) {
+    if (!on) {
+        m_service->setRecorder(nullptr);
+        const qint64 count = m_workloadRecorder ? m_workloadRecorder->recordCount() : 0;
+        m_workloadRecorder.reset();
+        statusBar()->showMessage(QString("Запись нагрузки остановлена: %1 вызовов").arg(count), 5000);
+        return;
+    }
+    const QString path = QFileDialog::getSaveFileName(this, "Запись нагрузки", "workload.trw", "Журнал нагрузки (*.trw)");
+    if (path.isEmpty()) {
+        QSignalBlocker block(m_recordWorkloadAct);
+        m_recordWorkloadAct->setChecked(false);
+        return;
+    }
+    try {
+        // Снимок — состояние, с которого tree_replay начнёт воспроизведение
+        Db::snapshotTo(m_db->connectionName(), path + ".base.sqlite");
+        m_workloadRecorder = std::make_shared<WorkloadRecorder>(path, m_storageOptions);
+        m_service->setRecorder(m_workloadRecorder);
+    } catch (const std::exception &ex) {
+        QSignalBlocker block(m_recordWorkloadAct);
+        m_recordWorkloadAct->setChecked(false);
+        QMessageBox::warning(this, "Ошибка", QString("Не удалось начать запись: ") + ex.what());
+    }
+}
+
+void SecondWindow::setupBackgroundTasks() {
+    m_batchRunner = new BackgroundBatchRunner(this);
+    TreeService *service = m_service.get();
+    // Перенос старых inline-payload в общее хранилище — только когда оно включено
+    if (m_storageOptions.dedupPayloads) {
+        m_batchRunner->addTask("payload-dedup", [service]() {
+            return service->dedupInlinePayloads(PAYLOAD_BATCH) > 0;
+        });
+    }
+    auto compactCursor = std::make_shared<PayloadCompactCursor>();
+    m_batchRunner->addTask("payload-compress", [service, compactCursor]() {
+        return service->compressPayloadBatch(*compactCursor, PAYLOAD_BATCH);
+    });
+    m_batchRunner->addTask("payload-gc", [service]() {
+        const int removed = service->collectPayloadGarbage();
+        if (removed > 0) qDebug() << "payload GC: removed" << removed;
+        return false;
+    }, PAYLOAD_GC_INTERVAL_MS);
+    auto sortKeyCursor = std::make_shared<qint64>(0);
+    m_batchRunner->addTask("sortkey-backfill", [service, sortKeyCursor]() {
+        return service->backfillSortKeysBatch(*sortKeyCursor, SORT_KEY_BACKFILL_BATCH);
+    });
+    m_batchRunner->addTask("sortkey-rebalance", [service]() {
+        return service->rebalancePendingSortKeys();
+    }, SORT_KEY_REBALANCE_INTERVAL_MS);
+    m_batchRunner->addTask("namekey-backfill", [service]() {
+        return service->backfillNameKeysBatch(NAME_KEY_BACKFILL_BATCH);
+    });
+    m_dataMigrations = std::make_unique<DataMigrationRunner>(*m_db);
+    m_batchRunner->addTask("data-migrations", [runner = m_dataMigrations.get()]() {
+        return runner->step(DATA_MIGRATION_BATCH);
+    });
+    // Обслуживание файла: пока UI обращается к БД, шаг пропускается до следующего периода (false — repeatMs)
+    auto maintenance = std::make_shared<DbMaintenance>(*m_db);
+    auto idle = [cache = m_pageCache]() { return cache->msSinceForegroundActivity() >= MAINTENANCE_QUIET_MS; };
+    m_batchRunner->addTask("db-optimize", [maintenance, idle]() {
+        if (!idle()) return false;
+        logMaintenance(maintenance->optimize());
+        return false;
+    }, MAINTENANCE_OPTIMIZE_INTERVAL_MS);
+    m_batchRunner->addTask("db-incremental-vacuum", [maintenance, idle]() {
+        if (!idle()) return false;
+        const MaintenanceReport report = maintenance->incrementalVacuumStep();
+        logMaintenance(report);
+        return report.more;
+    }, MAINTENANCE_VACUUM_INTERVAL_MS);
+    m_batchRunner->addTask("db-checkpoint", [maintenance, idle]() {
+        if (!idle()) return false;
+        logMaintenance(maintenance->checkpoint());
+        return false;
+    }, MAINTENANCE_CHECKPOINT_INTERVAL_MS);
+    m_batchRunner->start();
+}
+
 void SecondWindow::guestSeterT() {
     guest = true;
     ui->backButton->setDisabled(false);
@@ -2,42 +2,138 @@
 #include "widgetsTreeFeeler.h"
 #include "TreeWidgetEx.h"
 #include "TreeService.h"
+#include "ChildPageCache.h"
+#include "ChildPrefetcher.h"
+#include "Trace.h"
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QTimer>
+#include <QApplication>
+#include <QStyle>
+#include <QLocale>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QFile>
+#include <QScrollBar>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
 //#include <QThread>
 //#include <windows.h>
 
 
 static constexpr int COLUMN_NAME = 0;
+static constexpr int COLUMN_DIAMETER = 1;
+static constexpr int COLUMN_LENGTH = 2;
+static constexpr int COLUMN_HOLDER = 3;
+
+// Сколько узлов держит LRU-кеш разобранных колонок payload
+static constexpr int PAYLOAD_COLUMN_CACHE_SIZE = 4096;
+
+// Сколько узлов «Раскрыть всё ниже» загружает без подтверждения
+static constexpr int EXPAND_SUBTREE_CONFIRM_LIMIT = 5000;
+
+// Окно детей промежуточного родителя при переходе к узлу (и порция подгрузки по «… ещё»)
+static constexpr int REVEAL_WINDOW = 200;
+
+// Элемент «… ещё»: UserRole = 0, как у плейсхолдера; сторона окна — ниже или выше загруженных.
+// Подгрузка идёт от соседнего загруженного элемента по ключу порядка, позиции не хранятся
+static constexpr int ROLE_STUB_BELOW = Qt::UserRole + 1;
+
+// Предвыборка: сколько соседей раскрытого узла подсказывать и длина истории раскрытий
+static constexpr int PREFETCH_SIBLINGS = 4;
+static constexpr int EXPAND_HISTORY_SIZE = 32;
+
+// Выгрузка свёрнутых веток: через сколько после сворачивания, бюджет элементов и период проверки
+static constexpr qint64 UNLOAD_COLLAPSED_AFTER_MS = 2 * 60 * 1000;
+static constexpr int LIVE_ITEM_BUDGET = 100000;
+static constexpr int UNLOAD_CHECK_INTERVAL_MS = 15 * 1000;
+
+// Порция копирования вложения в файл при сохранении
+static constexpr qint64 ATTACHMENT_COPY_CHUNK = 1024 * 1024;
+
+namespace {
+// Курсор ожидания на время блока: снимается ровно один раз при любом выходе, в том числе по исключению
+class WaitCursor {
+public:
+    WaitCursor() { QApplication::setOverrideCursor(Qt::WaitCursor); }
+    ~WaitCursor() { release(); }
+    WaitCursor(const WaitCursor &) = delete;
+    WaitCursor &operator=(const WaitCursor &) = delete;
+
+    // Снять раньше конца блока (перед диалогом)
+    void release() {
+        if (!m_active) return;
+        m_active = false;
+        QApplication::restoreOverrideCursor();
+    }
+
+private:
+    bool m_active {true};
+};
+}
+
+// Значок и подсказка о вложениях: только по сводке, содержимое не читается
+static void decorateAttachments(QTreeWidgetItem *item, int count, qint64 bytes) {
+    if (count > 0) {
+        item->setIcon(COLUMN_NAME, QApplication::style()->standardIcon(QStyle::SP_FileIcon));
+        item->setToolTip(COLUMN_NAME, QString("Вложений: %1, %2").arg(count).arg(QLocale().formattedDataSize(bytes)));
+    } else {
+        item->setIcon(COLUMN_NAME, QIcon());
+        item->setToolTip(COLUMN_NAME, QString());
+    }
+}
 
 static QTreeWidgetItem* makeItem(const NodeDTO &dto) {
     auto *item = new QTreeWidgetItem();
     item->setText(COLUMN_NAME, dto.name);
     item->setData(COLUMN_NAME, Qt::UserRole, QVariant::fromValue<qlonglong>(dto.id));
+    decorateAttachments(item, dto.attachmentCount, dto.attachmentBytes);
 
     //item->setFlags(item->flags() | Qt::ItemIsEditable);
 
     return item;
 }
 
+static QTreeWidgetItem* makeStub(bool below) {
+    auto *stub = new QTreeWidgetItem();
+    stub->setText(COLUMN_NAME, below ? QString("… ещё ниже") : QString("… ещё выше"));
+    stub->setData(COLUMN_NAME, Qt::UserRole, QVariant::fromValue<qlonglong>(0));
+    stub->setData(COLUMN_NAME, ROLE_STUB_BELOW, below);
+    stub->setFlags(Qt::ItemIsEnabled);
+    return stub;
+}
+
+static bool isStub(QTreeWidgetItem *item) {
+    return item && item->data(COLUMN_NAME, ROLE_STUB_BELOW).isValid();
+}
+
 static bool hasOnlyPlaceholder(QTreeWidgetItem *item) {
     return item->childCount() == 1 && item->child(0)->data(COLUMN_NAME, Qt::UserRole).toLongLong() == 0;
 }
 
 WidgetsTreeFeeler::WidgetsTreeFeeler(TreeWidgetEx *tree, TreeService *service, QObject *parent)
-    : QObject(parent), m_tree(tree), m_service(service) {}
+    : QObject(parent), m_tree(tree), m_service(service),
+      m_unloadAfterMs(UNLOAD_COLLAPSED_AFTER_MS), m_itemBudget(LIVE_ITEM_BUDGET),
+      m_columnCache(PAYLOAD_COLUMN_CACHE_SIZE) {
+    m_clock.start();
+}
 
 void WidgetsTreeFeeler::initialize() {
+    TRACE_SPAN("ui", "initialize");
     if (!m_tree) return;
-    m_tree->setColumnCount(1);
-    m_tree->setHeaderHidden(true);
+    m_tree->setColumnCount(4);
+    m_tree->setHeaderLabels({ "Имя", "Диаметр", "Длина", "Держатель" });
+    m_tree->setHeaderHidden(false);
     m_tree->setEditTriggers(QAbstractItemView::EditKeyPressed | QAbstractItemView::SelectedClicked);
     m_tree->setContextMenuPolicy(Qt::CustomContextMenu);
 
-    m_tree->setSelectionMode(QAbstractItemView::SingleSelection);
+    // Ctrl/Shift-выделение: перемещение и удаление выполняются пачкой
+    m_tree->setSelectionMode(QAbstractItemView::ExtendedSelection);
 
     connect(m_tree, &QTreeWidget::itemExpanded, this, &WidgetsTreeFeeler::onItemExpanded);
+    connect(m_tree, &QTreeWidget::itemCollapsed, this, &WidgetsTreeFeeler::onItemCollapsed);
     connect(m_tree, &QTreeWidget::itemChanged, this, &WidgetsTreeFeeler::onItemChanged);
     connect(m_tree, &QTreeWidget::itemClicked, this, &WidgetsTreeFeeler::onItemClicked);
     connect(m_tree, &QWidget::customContextMenuRequested, this, &WidgetsTreeFeeler::onCustomContextMenuRequested);
@@ -45,20 +141,171 @@ void WidgetsTreeFeeler::initialize() {
 
     // Начальная загрузка: дети корня (id=1) — это топ-уровень
     m_tree->clear();
+    m_idToItem.clear();
+    m_collapsedAt.clear();
     loadChildrenInto(nullptr, TreeService::ROOT_ID);
+
+    // Колонки payload: пересчёт видимых строк после прокрутки/изменения содержимого, схлопнутый в один проход
+    m_columnsTimer = new QTimer(this);
+    m_columnsTimer->setSingleShot(true);
+    m_columnsTimer->setInterval(0);
+    connect(m_columnsTimer, &QTimer::timeout, this, &WidgetsTreeFeeler::refreshVisibleColumns);
+    connect(m_tree->verticalScrollBar(), &QScrollBar::valueChanged, this, &WidgetsTreeFeeler::scheduleColumnsRefresh);
+    connect(m_tree->verticalScrollBar(), &QScrollBar::rangeChanged, this, &WidgetsTreeFeeler::scheduleColumnsRefresh);
+    scheduleColumnsRefresh();
+
+    m_unloadTimer = new QTimer(this);
+    m_unloadTimer->setInterval(UNLOAD_CHECK_INTERVAL_MS);
+    connect(m_unloadTimer, &QTimer::timeout, this, &WidgetsTreeFeeler::unloadCollapsed);
+    m_unloadTimer->start();
+}
+
+void WidgetsTreeFeeler::scheduleColumnsRefresh() {
+    if (m_columnsTimer) m_columnsTimer->start();
+}
+
+void WidgetsTreeFeeler::clearPayloadColumns() {
+    m_columnCache.clear();
+    scheduleColumnsRefresh();
+}
+
+static void setColumnTexts(QTreeWidgetItem *item, const QString &diameter, const QString &length, const QString &holder) {
+    item->setText(COLUMN_DIAMETER, diameter);
+    item->setText(COLUMN_LENGTH, length);
+    item->setText(COLUMN_HOLDER, holder);
+}
+
+void WidgetsTreeFeeler::refreshVisibleColumns() {
+    if (!m_tree) return;
+    // Видимые строки — от верхней строки области просмотра вниз, пока не выйдем за её нижний край
+    std::vector<QTreeWidgetItem*> visible;
+    const int bottom = m_tree->viewport()->height();
+    for (QTreeWidgetItem *it = m_tree->itemAt(QPoint(0, 0)); it; it = m_tree->itemBelow(it)) {
+        if (m_tree->visualItemRect(it).top() > bottom) break;
+        visible.push_back(it);
+    }
+    if (visible.empty()) return;
+
+    // Недостающие в кеше: видимые и ещё столько же строк ниже (предвыборка экрана вперёд)
+    std::vector<qint64> missing;
+    auto collect = [this, &missing](QTreeWidgetItem *it) {
+        const qint64 id = it->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+        if (id != 0 && !m_columnCache.contains(id)) missing.push_back(id);
+    };
+    for (QTreeWidgetItem *it : visible) collect(it);
+    QTreeWidgetItem *ahead = m_tree->itemBelow(visible.back());
+    for (size_t n = 0; ahead && n < visible.size(); ++n, ahead = m_tree->itemBelow(ahead)) collect(ahead);
+
+    if (!missing.empty()) {
+        std::unordered_map<qint64, QString> payloads;
+        try {
+            payloads = m_service->getPayloads(missing);
+        } catch (const std::exception &) {
+            return; // колонки останутся прежними до следующего обновления
+        }
+        for (const qint64 id : missing) {
+            auto *cols = new PayloadColumns();
+            const auto it = payloads.find(id);
+            if (it != payloads.end()) {
+                const QJsonObject obj = QJsonDocument::fromJson(it->second.toUtf8()).object();
+                cols->diameter = obj.value("diameter").toVariant().toString();
+                cols->length = obj.value("length").toVariant().toString();
+                cols->holder = obj.value("holder").toVariant().toString();
+            }
+            m_columnCache.insert(id, cols); // узел без payload тоже кешируется — пустыми значениями
+        }
+    }
+
+    // setText вызывает itemChanged — rename на это реагировать не должен
+    QSignalBlocker blocker(m_tree);
+    for (QTreeWidgetItem *it : visible) {
+        const qint64 id = it->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+        if (id == 0) continue;
+        if (const PayloadColumns *cols = m_columnCache.object(id)) {
+            setColumnTexts(it, cols->diameter, cols->length, cols->holder);
+        }
+    }
+    m_tree->viewport()->update();
+}
+
+void WidgetsTreeFeeler::setUnloadPolicy(qint64 collapsedMs, int itemBudget) {
+    m_unloadAfterMs = collapsedMs;
+    m_itemBudget = itemBudget;
+}
+
+void WidgetsTreeFeeler::onItemCollapsed(QTreeWidgetItem *item) {
+    scheduleColumnsRefresh();
+    if (!item || isPlaceholder(item) || hasOnlyPlaceholder(item)) return;
+    m_collapsedAt.insert(item->data(COLUMN_NAME, Qt::UserRole).toLongLong(), m_clock.elapsed());
+}
+
+void WidgetsTreeFeeler::unloadCollapsed() {
+    if (m_collapsedAt.isEmpty()) return;
+    const qint64 now = m_clock.elapsed();
+    // От давно свёрнутых к недавним: сначала истёкшие, затем — пока не уложимся в бюджет
+    std::vector<std::pair<qint64, qint64>> candidates; // (момент сворачивания, id)
+    candidates.reserve(size_t(m_collapsedAt.size()));
+    for (auto it = m_collapsedAt.cbegin(); it != m_collapsedAt.cend(); ++it) {
+        candidates.emplace_back(it.value(), it.key());
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    QTreeWidgetItem *current = m_tree->currentItem();
+    m_tree->setUpdatesEnabled(false);
+    for (const auto &[collapsedAt, id] : candidates) {
+        if (now - collapsedAt < m_unloadAfterMs && m_idToItem.size() <= m_itemBudget) break;
+        // Узел мог уйти вместе с уже выгруженным предком
+        QTreeWidgetItem *item = m_idToItem.value(id, nullptr);
+        if (!item || item->isExpanded()) {
+            m_collapsedAt.remove(id);
+            continue;
+        }
+        // Ветку с текущим элементом не трогаем — иначе пропадёт фокус пользователя
+        bool holdsCurrent = false;
+        for (QTreeWidgetItem *p = current ? current->parent() : nullptr; p && !holdsCurrent; p = p->parent()) {
+            holdsCurrent = p == item;
+        }
+        if (holdsCurrent) continue;
+        unloadChildren(item);
+    }
+    m_tree->setUpdatesEnabled(true);
+}
+
+void WidgetsTreeFeeler::unloadChildren(QTreeWidgetItem *item) {
+    m_collapsedAt.remove(item->data(COLUMN_NAME, Qt::UserRole).toLongLong());
+    if (item->childCount() == 0 || hasOnlyPlaceholder(item)) return;
+    const auto children = item->takeChildren();
+    for (QTreeWidgetItem *child : children) {
+        forgetSubtree(child);
+        delete child;
+    }
+    addPlaceholderIfNeeded(item, true);
 }
 
 void WidgetsTreeFeeler::onItemClicked(QTreeWidgetItem *item, int column) {
     if (!item || column != COLUMN_NAME) return;
     const qint64 id = item->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+    if (isStub(item)) {
+        loadStub(item);
+        return;
+    }
     if (id == 0) return; // плейсхолдер
 
     qDebug() << "onItemClicked: item id:" << id;
+    emit itemClicked(id);
 
 }
 
 void WidgetsTreeFeeler::loadChildrenInto(QTreeWidgetItem *parentItem, qint64 parentId) {
-    const auto children = m_service->listChildren(parentId);
+    TRACE_SPAN("ui", "loadChildrenInto");
+    std::vector<NodeDTO> children;
+    if (m_pageCache) {
+        m_pageCache->noteForegroundActivity();
+        if (auto cached = m_pageCache->take(parentId)) children = std::move(*cached);
+        else children = m_service->listChildren(parentId, SIZE_MAX, 0, ChildOrder::Manual);
+    } else {
+        children = m_service->listChildren(parentId, SIZE_MAX, 0, ChildOrder::Manual);
+    }
     for (const auto &dto : children) {
         QTreeWidgetItem *item = makeItem(dto);
         if (parentItem) parentItem->addChild(item); else m_tree->addTopLevelItem(item);
@@ -67,6 +314,236 @@ void WidgetsTreeFeeler::loadChildrenInto(QTreeWidgetItem *parentItem, qint64 par
     }
 }
 
+void WidgetsTreeFeeler::expandSubtree(qint64 id, int depth) {
+    TRACE_SPAN("ui", "expandSubtree");
+    QTreeWidgetItem *target = id == TreeService::ROOT_ID ? m_tree->invisibleRootItem() : m_idToItem.value(id, nullptr);
+    if (!target) return;
+
+    std::vector<NodeDTO> nodes;
+    try {
+        // Порог проверяется подсчётом без сортировки: одна лишняя строка — признак, что поддерево больше лимита
+        const size_t probe = m_service->countSubtree(id, depth, size_t(EXPAND_SUBTREE_CONFIRM_LIMIT) + 1);
+        if (probe > size_t(EXPAND_SUBTREE_CONFIRM_LIMIT)) {
+            const auto answer = QMessageBox::question(m_tree, "Раскрыть всё ниже",
+                QString("В поддереве больше %1 узлов. Загрузить все?").arg(EXPAND_SUBTREE_CONFIRM_LIMIT));
+            if (answer != QMessageBox::Yes) return;
+        }
+        WaitCursor wait;
+        nodes = m_service->listSubtree(id, depth);
+    } catch (const std::exception &ex) {
+        QMessageBox::warning(m_tree, "Ошибка", QString::fromUtf8(ex.what()));
+        return;
+    }
+
+    // Строим элементы вне виджета: сначала группируем по родителю (порядок внутри группы — из запроса),
+    // затем снизу вверх навешиваем детей — виджет ещё не видит этих элементов и не перерисовывается
+    QHash<qint64, QList<QTreeWidgetItem*>> childrenOf;
+    std::vector<std::pair<QTreeWidgetItem*, const NodeDTO*>> built;
+    built.reserve(nodes.size());
+    for (const auto &dto : nodes) {
+        QTreeWidgetItem *item = makeItem(dto);
+        childrenOf[dto.parentId].append(item);
+        built.emplace_back(item, &dto);
+    }
+    for (auto it = built.rbegin(); it != built.rend(); ++it) {
+        QTreeWidgetItem *item = it->first;
+        const NodeDTO &dto = *it->second;
+        const auto kids = childrenOf.constFind(dto.id);
+        if (kids != childrenOf.constEnd()) item->addChildren(kids.value());
+        else addPlaceholderIfNeeded(item, dto.hasChildren); // глубже лимита — как при ленивой загрузке
+    }
+
+    m_tree->setUpdatesEnabled(false);
+    // Прежние дети (плейсхолдер или загруженный уровень) заменяются целиком
+    const auto oldChildren = target->takeChildren();
+    for (QTreeWidgetItem *old : oldChildren) {
+        forgetSubtree(old);
+        delete old;
+    }
+    target->addChildren(childrenOf.value(id));
+    for (const auto &[item, dto] : built) {
+        m_idToItem.insert(dto->id, item);
+        if (item->childCount() > 0 && !hasOnlyPlaceholder(item)) item->setExpanded(true);
+    }
+    if (target != m_tree->invisibleRootItem()) target->setExpanded(true);
+    m_tree->setUpdatesEnabled(true);
+}
+
+QList<QTreeWidgetItem*> WidgetsTreeFeeler::makeNodeItems(const std::vector<NodeDTO> &nodes, size_t count) {
+    QList<QTreeWidgetItem*> items;
+    for (size_t i = 0; i < count && i < nodes.size(); ++i) {
+        QTreeWidgetItem *item = makeItem(nodes[i]);
+        m_idToItem.insert(nodes[i].id, item);
+        addPlaceholderIfNeeded(item, nodes[i].hasChildren);
+        items.append(item);
+    }
+    return items;
+}
+
+void WidgetsTreeFeeler::loadWindowInto(QTreeWidgetItem *container, qint64 parentId, qint64 anchorId) {
+    // Половина окна перед узлом, остальное — начиная с него самого. Лишняя строка с каждой стороны —
+    // признак, что дальше есть ещё дети
+    const size_t half = size_t(REVEAL_WINDOW / 2);
+    auto above = m_service->listChildrenFrom(parentId, anchorId, PageDirection::Before, half + 1);
+    const bool moreAbove = above.size() > half;
+    if (moreAbove) above.erase(above.begin());
+    const size_t rest = size_t(REVEAL_WINDOW) - above.size();
+    const auto below = above.empty()
+        ? m_service->listChildren(parentId, rest + 1, 0, ChildOrder::Manual)
+        : m_service->listChildrenFrom(parentId, above.back().id, PageDirection::After, rest + 1);
+    QList<QTreeWidgetItem*> items = makeNodeItems(above, above.size());
+    items.append(makeNodeItems(below, rest));
+    if (moreAbove) items.prepend(makeStub(false));
+    if (below.size() > rest) items.append(makeStub(true));
+    container->addChildren(items);
+}
+
+void WidgetsTreeFeeler::loadStub(QTreeWidgetItem *stub) {
+    QTreeWidgetItem *container = stub->parent() ? stub->parent() : m_tree->invisibleRootItem();
+    const qint64 parentId = stub->parent()
+        ? stub->parent()->data(COLUMN_NAME, Qt::UserRole).toLongLong()
+        : TreeService::ROOT_ID;
+    const bool below = stub->data(COLUMN_NAME, ROLE_STUB_BELOW).toBool();
+    const int index = container->indexOfChild(stub);
+    // Якорь — соседний загруженный элемент: порция продолжает окно по ключу порядка
+    QTreeWidgetItem *neighbour = container->child(below ? index - 1 : index + 1);
+    if (!neighbour) {
+        delete stub;
+        return;
+    }
+    const qint64 anchorId = neighbour->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+    try {
+        if (below) {
+            // Ниже окна: следующая порция перед элементом «… ещё ниже»
+            const auto rows = m_service->listChildrenFrom(parentId, anchorId, PageDirection::After, size_t(REVEAL_WINDOW) + 1);
+            container->insertChildren(index, makeNodeItems(rows, size_t(REVEAL_WINDOW)));
+            if (rows.size() <= size_t(REVEAL_WINDOW)) delete stub;
+        } else {
+            // Выше окна: порция, примыкающая к уже загруженным, после элемента «… ещё выше»
+            auto rows = m_service->listChildrenFrom(parentId, anchorId, PageDirection::Before, size_t(REVEAL_WINDOW) + 1);
+            const bool more = rows.size() > size_t(REVEAL_WINDOW);
+            if (more) rows.erase(rows.begin());
+            container->insertChildren(index + 1, makeNodeItems(rows, rows.size()));
+            if (!more) delete stub;
+        }
+    } catch (const std::exception &ex) {
+        QMessageBox::warning(m_tree, "Ошибка", QString::fromUtf8(ex.what()));
+    }
+}
+
+bool WidgetsTreeFeeler::revealNode(qint64 id) {
+    TRACE_SPAN("ui", "revealNode");
+    const auto chain = m_service->ancestorChain(id); // корень ... id
+    if (chain.size() < 2) return false;
+
+    m_tree->setUpdatesEnabled(false);
+    QTreeWidgetItem *container = m_tree->invisibleRootItem();
+    QTreeWidgetItem *item = nullptr;
+    for (size_t i = 1; i < chain.size(); ++i) {
+        const qint64 parentId = chain[i - 1];
+        const qint64 childId = chain[i];
+        item = m_idToItem.value(childId, nullptr);
+        if (!item) {
+            // Дети не загружены (плейсхолдер) или загружено окно без нужного узла —
+            // вместо полной загрузки берём только окно вокруг его позиции
+            const auto oldChildren = container->takeChildren();
+            for (QTreeWidgetItem *old : oldChildren) {
+                forgetSubtree(old);
+                delete old;
+            }
+            loadWindowInto(container, parentId, childId);
+            item = m_idToItem.value(childId, nullptr);
+            if (!item) break; // дерево изменилось между запросами
+        }
+        // Дети уже на месте — раскрытие не запустит ленивую загрузку
+        if (container != m_tree->invisibleRootItem()) container->setExpanded(true);
+        container = item;
+    }
+    m_tree->setUpdatesEnabled(true);
+    if (!item) return false;
+
+    m_tree->clearSelection();
+    m_tree->setCurrentItem(item);
+    item->setSelected(true);
+    m_tree->scrollToItem(item, QAbstractItemView::PositionAtCenter);
+    return true;
+}
+
+QList<qint64> WidgetsTreeFeeler::expandedIds() const {
+    QList<qint64> out;
+    for (auto it = m_idToItem.cbegin(); it != m_idToItem.cend(); ++it) {
+        if (it.value()->isExpanded()) out.append(it.key());
+    }
+    return out;
+}
+
+QList<qint64> WidgetsTreeFeeler::selectedIds() const {
+    QList<qint64> out;
+    for (QTreeWidgetItem *item : m_tree->selectedItems()) {
+        const qint64 id = item->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+        if (id != 0) out.append(id);
+    }
+    return out;
+}
+
+void WidgetsTreeFeeler::restoreState(const QList<qint64> &expanded, const QList<qint64> &selected) {
+    TRACE_SPAN("ui", "restoreState");
+    std::vector<qint64> parents { TreeService::ROOT_ID };
+    for (const qint64 id : expanded) {
+        if (id != TreeService::ROOT_ID) parents.push_back(id);
+    }
+    std::vector<NodeDTO> nodes;
+    try {
+        nodes = m_service->listChildrenOfMany(parents);
+    } catch (const std::exception &ex) {
+        QMessageBox::warning(m_tree, "Ошибка", QString::fromUtf8(ex.what()));
+        return;
+    }
+
+    // Группировка по родителю и сборка снизу вверх вне виджета (как в expandSubtree)
+    QHash<qint64, QList<QTreeWidgetItem*>> childrenOf;
+    std::vector<std::pair<QTreeWidgetItem*, const NodeDTO*>> built;
+    built.reserve(nodes.size());
+    for (const auto &dto : nodes) {
+        QTreeWidgetItem *item = makeItem(dto);
+        childrenOf[dto.parentId].append(item);
+        built.emplace_back(item, &dto);
+    }
+    for (const auto &[item, dto] : built) {
+        const auto kids = childrenOf.constFind(dto->id);
+        if (kids != childrenOf.constEnd()) item->addChildren(kids.value());
+        else addPlaceholderIfNeeded(item, dto->hasChildren);
+    }
+
+    m_tree->setUpdatesEnabled(false);
+    m_tree->clear();
+    m_idToItem.clear();
+    m_collapsedAt.clear();
+    m_tree->invisibleRootItem()->addChildren(childrenOf.value(TreeService::ROOT_ID));
+    // Ветки, чей родитель не попал в дерево (свёрнут или удалён), не прикреплены — удаляем их верхушки
+    std::vector<QTreeWidgetItem*> detached;
+    for (const auto &[item, dto] : built) {
+        if (item->treeWidget()) m_idToItem.insert(dto->id, item);
+        else if (!item->parent()) detached.push_back(item);
+    }
+    for (QTreeWidgetItem *item : detached) delete item;
+    // Удалённые элементы не трогаем: сначала проверка по m_idToItem
+    for (const auto &[item, dto] : built) {
+        if (m_idToItem.contains(dto->id) && item->childCount() > 0 && !hasOnlyPlaceholder(item)) item->setExpanded(true);
+    }
+
+    QTreeWidgetItem *current = nullptr;
+    for (const qint64 id : selected) {
+        QTreeWidgetItem *item = m_idToItem.value(id, nullptr);
+        if (!item) continue;
+        item->setSelected(true);
+        if (!current) current = item;
+    }
+    if (current) m_tree->setCurrentItem(current, COLUMN_NAME, QItemSelectionModel::NoUpdate);
+    m_tree->setUpdatesEnabled(true);
+    if (current) m_tree->scrollToItem(current);
+}
+
 void WidgetsTreeFeeler::addPlaceholderIfNeeded(QTreeWidgetItem *item, bool hasChildren) {
     if (hasChildren) {
         auto *ph = new QTreeWidgetItem();
@@ -81,7 +558,10 @@ bool WidgetsTreeFeeler::isPlaceholder(QTreeWidgetItem *item) const {
 }
 
 void WidgetsTreeFeeler::onItemExpanded(QTreeWidgetItem *item) {
+    TRACE_SPAN("ui", "onItemExpanded");
     if (!item) return;
+    m_collapsedAt.remove(item->data(COLUMN_NAME, Qt::UserRole).toLongLong());
+    scheduleColumnsRefresh();
     if (hasOnlyPlaceholder(item)) {
         // удалить плейсхолдер и подгрузить настоящих детей
         auto *ph = item->child(0);
@@ -90,6 +570,63 @@ void WidgetsTreeFeeler::onItemExpanded(QTreeWidgetItem *item) {
         const qint64 id = item->data(COLUMN_NAME, Qt::UserRole).toLongLong();
         loadChildrenInto(item, id);
     }
+    rememberExpanded(item->data(COLUMN_NAME, Qt::UserRole).toLongLong());
+    hintSiblings(item);
+}
+
+void WidgetsTreeFeeler::setPrefetch(std::shared_ptr<ChildPageCache> cache, ChildPrefetcher *prefetcher) {
+    m_pageCache = std::move(cache);
+    m_prefetcher = prefetcher;
+    if (!m_tree) return;
+    m_tree->setMouseTracking(true); // itemEntered приходит только с отслеживанием мыши
+    connect(m_tree, &QTreeWidget::itemEntered, this, &WidgetsTreeFeeler::onItemEntered, Qt::UniqueConnection);
+}
+
+void WidgetsTreeFeeler::hintPrefetch(const std::vector<qint64> &ids) {
+    if (m_prefetcher && !ids.empty()) m_prefetcher->hint(ids);
+}
+
+void WidgetsTreeFeeler::onItemEntered(QTreeWidgetItem *item, int column) {
+    Q_UNUSED(column);
+    // Наведение на свёрнутый узел с незагруженными детьми — самый вероятный следующий клик
+    if (item && !isPlaceholder(item) && hasOnlyPlaceholder(item)) {
+        hintPrefetch({ item->data(COLUMN_NAME, Qt::UserRole).toLongLong() });
+    }
+}
+
+void WidgetsTreeFeeler::hintSiblings(QTreeWidgetItem *item) {
+    if (!m_prefetcher) return;
+    QTreeWidgetItem *container = item->parent() ? item->parent() : m_tree->invisibleRootItem();
+    const int index = container->indexOfChild(item);
+    std::vector<qint64> ids;
+    // Ближайшие соседи первыми: ниже, выше, через одного и т.д.
+    for (int d = 1; d <= PREFETCH_SIBLINGS; ++d) {
+        for (const int i : { index + d, index - d }) {
+            if (i < 0 || i >= container->childCount()) continue;
+            QTreeWidgetItem *sibling = container->child(i);
+            if (!isPlaceholder(sibling) && hasOnlyPlaceholder(sibling)) {
+                ids.push_back(sibling->data(COLUMN_NAME, Qt::UserRole).toLongLong());
+            }
+        }
+    }
+    hintPrefetch(ids);
+}
+
+void WidgetsTreeFeeler::rememberExpanded(qint64 id) {
+    m_expandHistory.removeAll(id);
+    m_expandHistory.prepend(id);
+    while (m_expandHistory.size() > EXPAND_HISTORY_SIZE) m_expandHistory.removeLast();
+}
+
+void WidgetsTreeFeeler::setExpandHistory(const QList<qint64> &ids) {
+    m_expandHistory = ids.mid(0, EXPAND_HISTORY_SIZE);
+    // Из истории подсказываем то, что сейчас не раскрыто: при повторном раскрытии дети уже будут в кеше
+    std::vector<qint64> hints;
+    for (const qint64 id : m_expandHistory) {
+        QTreeWidgetItem *item = m_idToItem.value(id, nullptr);
+        if (item && hasOnlyPlaceholder(item)) hints.push_back(id);
+    }
+    hintPrefetch(hints);
 }
 
 void WidgetsTreeFeeler::onItemChanged(QTreeWidgetItem *item, int column) {
@@ -124,14 +661,31 @@ void WidgetsTreeFeeler::onCustomContextMenuRequested(const QPoint &pos) {
     QAction *addAct = menu.addAction("Добавить ребёнка");
     QAction *renAct = menu.addAction("Переименовать");
     QAction *delAct = menu.addAction("Удалить");
+    QAction *expandAct = menu.addAction("Раскрыть всё ниже");
+    menu.addSeparator();
+    QAction *attachAct = menu.addAction("Прикрепить файл…");
+    QAction *saveAttAct = menu.addAction("Сохранить вложение…");
 
     if (!item || item->data(COLUMN_NAME, Qt::UserRole).toLongLong() == 0) {
         renAct->setEnabled(false);
+        expandAct->setEnabled(false);
+        attachAct->setEnabled(false);
+        saveAttAct->setEnabled(false);
     }
 
     QObject::connect(addAct, &QAction::triggered, this, [this, item]() { createChild(item); });
     QObject::connect(renAct, &QAction::triggered, this, [this, item]() { renameItem(item); });
-    QObject::connect(delAct, &QAction::triggered, this, [this, item]() { deleteItem(item); });
+    QObject::connect(delAct, &QAction::triggered, this, [this, item]() {
+        // Клик по одному из выделенных — удаляется всё выделение, иначе только элемент под курсором
+        const auto selected = m_tree->selectedTopMostItems();
+        if (item && item->isSelected() && selected.size() > 1) deleteItems(selected);
+        else deleteItem(item);
+    });
+    QObject::connect(expandAct, &QAction::triggered, this, [this, item]() {
+        expandSubtree(item->data(COLUMN_NAME, Qt::UserRole).toLongLong());
+    });
+    QObject::connect(attachAct, &QAction::triggered, this, [this, item]() { attachFile(item); });
+    QObject::connect(saveAttAct, &QAction::triggered, this, [this, item]() { saveAttachment(item); });
 
     menu.exec(m_tree->viewport()->mapToGlobal(pos));
 }
@@ -201,18 +755,187 @@ void WidgetsTreeFeeler::deleteItem(QTreeWidgetItem *item) {
     if (QMessageBox::question(m_tree, "Подтверждение", "Удалить узел и все дочерние?") != QMessageBox::Yes) return;
     try {
         m_service->deleteNode(id);
+        forgetSubtree(item);
+        delete item;
+    } catch (const std::exception &ex) {
+        QMessageBox::warning(m_tree, "Ошибка", QString::fromUtf8(ex.what()));
+    }
+}
+
+void WidgetsTreeFeeler::deleteItems(const QList<QTreeWidgetItem*> &items) {
+    std::vector<qint64> ids;
+    ids.reserve(size_t(items.size()));
+    for (QTreeWidgetItem *item : items) {
+        if (!isPlaceholder(item)) ids.push_back(item->data(COLUMN_NAME, Qt::UserRole).toLongLong());
+    }
+    if (ids.empty()) return;
+    if (QMessageBox::question(m_tree, "Подтверждение",
+                              QString("Удалить узлов: %1 (вместе с дочерними)?").arg(ids.size())) != QMessageBox::Yes) return;
+    try {
+        m_service->deleteNodes(ids);
+    } catch (const std::exception &ex) {
+        QMessageBox::warning(m_tree, "Ошибка", QString::fromUtf8(ex.what()));
+        return;
+    }
+    m_tree->setUpdatesEnabled(false);
+    for (QTreeWidgetItem *item : items) {
+        if (isPlaceholder(item)) continue;
+        forgetSubtree(item);
         delete item;
+    }
+    m_tree->setUpdatesEnabled(true);
+}
+
+void WidgetsTreeFeeler::attachFile(QTreeWidgetItem *item) {
+    if (!item) return;
+    const qint64 id = item->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+    if (id == 0) return;
+    const QString path = QFileDialog::getOpenFileName(m_tree, "Прикрепить файл");
+    if (path.isEmpty()) return;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QMessageBox::warning(m_tree, "Ошибка", file.errorString());
+        return;
+    }
+    try {
+        {
+            WaitCursor wait;
+            m_service->attachFile(id, QFileInfo(path).fileName(), file);
+        }
+        refreshAttachmentInfo(item);
+    } catch (const std::exception &ex) {
+        QMessageBox::warning(m_tree, "Ошибка", QString::fromUtf8(ex.what()));
+    }
+}
+
+void WidgetsTreeFeeler::saveAttachment(QTreeWidgetItem *item) {
+    if (!item) return;
+    const qint64 id = item->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+    if (id == 0) return;
+    try {
+        const auto list = m_service->listAttachments(id);
+        if (list.empty()) {
+            QMessageBox::information(m_tree, "Вложения", "У узла нет вложений");
+            return;
+        }
+        QStringList names;
+        for (const auto &a : list) names << QString("%1 (%2)").arg(a.name, QLocale().formattedDataSize(a.size));
+        bool ok = false;
+        const QString chosen = QInputDialog::getItem(m_tree, "Вложения", "Вложение:", names, 0, false, &ok);
+        if (!ok) return;
+        const auto &att = list.at(size_t(names.indexOf(chosen)));
+        const QString path = QFileDialog::getSaveFileName(m_tree, "Сохранить вложение", att.name);
+        if (path.isEmpty()) return;
+
+        QFile out(path);
+        if (!out.open(QIODevice::WriteOnly)) {
+            QMessageBox::warning(m_tree, "Ошибка", out.errorString());
+            return;
+        }
+        // Копируем порциями: вложение может быть в сотни мегабайт
+        auto in = m_service->openAttachment(att.id);
+        WaitCursor wait;
+        while (!in->atEnd()) {
+            const QByteArray part = in->read(ATTACHMENT_COPY_CHUNK);
+            if (part.isEmpty() || out.write(part) != part.size()) {
+                wait.release();
+                QMessageBox::warning(m_tree, "Ошибка", "Не удалось сохранить вложение");
+                return;
+            }
+        }
     } catch (const std::exception &ex) {
         QMessageBox::warning(m_tree, "Ошибка", QString::fromUtf8(ex.what()));
     }
 }
 
-void WidgetsTreeFeeler::onRequestMove(qint64 nodeId, qint64 newParentId, bool &accepted) {
+void WidgetsTreeFeeler::refreshAttachmentInfo(QTreeWidgetItem *item) {
+    const qint64 id = item->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+    int count = 0;
+    qint64 bytes = 0;
+    for (const auto &a : m_service->listAttachments(id)) {
+        ++count;
+        bytes += a.size;
+    }
+    // Смена иконки/подсказки — тоже itemChanged: без блокировки onItemChanged записал бы ложное переименование
+    QSignalBlocker blocker(m_tree);
+    decorateAttachments(item, count, bytes);
+}
+
+void WidgetsTreeFeeler::onRequestMove(const QList<QTreeWidgetItem*> &items, QTreeWidgetItem *newParentItem, int row, bool &accepted) {
+    TRACE_SPAN("ui", "onRequestMove");
+    accepted = false;
+    if (newParentItem && isPlaceholder(newParentItem)) return;
+    QList<QTreeWidgetItem*> moving;
+    std::vector<qint64> ids;
+    for (QTreeWidgetItem *item : items) {
+        if (!item || isPlaceholder(item)) continue;
+        moving.append(item);
+        ids.push_back(item->data(COLUMN_NAME, Qt::UserRole).toLongLong());
+    }
+    if (moving.isEmpty()) return;
+
+    const qint64 newParentId = newParentItem
+        ? newParentItem->data(COLUMN_NAME, Qt::UserRole).toLongLong()
+        : TreeService::ROOT_ID;
+    QTreeWidgetItem *container = newParentItem ? newParentItem : m_tree->invisibleRootItem();
+    const bool loaded = !hasOnlyPlaceholder(container);
+
+    // Соседи по месту вставки (без самих перемещаемых элементов); сервис возьмёт их ключи
+    qint64 prevId = 0;
+    qint64 nextId = 0;
+    if (loaded && row >= 0) {
+        for (int i = row - 1; i >= 0 && prevId == 0; --i) {
+            QTreeWidgetItem *c = container->child(i);
+            if (!moving.contains(c) && !isPlaceholder(c)) prevId = c->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+        }
+        for (int i = row; i < container->childCount() && prevId == 0 && nextId == 0; ++i) {
+            QTreeWidgetItem *c = container->child(i);
+            if (!moving.contains(c) && !isPlaceholder(c)) nextId = c->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+        }
+    }
+
     try {
-        m_service->moveNode(nodeId, newParentId);
+        m_service->moveNodes(ids, newParentId, prevId, nextId);
         accepted = true;
     } catch (const std::exception &ex) {
-        accepted = false;
         QMessageBox::warning(m_tree, "Перемещение", QString::fromUtf8(ex.what()));
+        return;
+    }
+
+    // Переносим элементы в виджете сами — так позиции совпадают с ручным порядком в БД.
+    // Вынимаем все, затем вставляем одной пачкой без промежуточных перерисовок.
+    m_tree->setUpdatesEnabled(false);
+    int insertAt = row < 0 ? container->childCount() : row;
+    for (QTreeWidgetItem *item : moving) {
+        QTreeWidgetItem *oldContainer = item->parent() ? item->parent() : m_tree->invisibleRootItem();
+        const int oldIndex = oldContainer->indexOfChild(item);
+        if (oldContainer == container && oldIndex < insertAt) --insertAt;
+        oldContainer->takeChild(oldIndex);
+    }
+    if (!loaded) {
+        // Дети нового родителя ещё не загружены — узлы появятся при раскрытии
+        for (QTreeWidgetItem *item : moving) {
+            forgetSubtree(item);
+            delete item;
+        }
+        m_tree->setUpdatesEnabled(true);
+        return;
+    }
+    if (row < 0) insertAt = container->childCount();
+    container->insertChildren(insertAt, moving);
+    m_tree->clearSelection();
+    for (QTreeWidgetItem *item : moving) item->setSelected(true);
+    m_tree->setCurrentItem(moving.front(), COLUMN_NAME, QItemSelectionModel::NoUpdate);
+    m_tree->setUpdatesEnabled(true);
+}
+
+void WidgetsTreeFeeler::forgetSubtree(QTreeWidgetItem *item) {
+    const qint64 id = item->data(COLUMN_NAME, Qt::UserRole).toLongLong();
+    if (id != 0) {
+        m_idToItem.remove(id);
+        m_collapsedAt.remove(id);
+    }
+    for (int i = 0; i < item->childCount(); ++i) {
+        forgetSubtree(item->child(i));
     }
 }
@@ -0,0 +1,277 @@
+// tree_replay — воспроизведение журнала нагрузки (WorkloadRecorder) на копии базы.
+// Журнал пишется окном ("Сервис → Запись нагрузки...") вместе со снимком базы на момент начала записи
+// (<log>.base.sqlite). Снимок копируется во временный файл, вызовы сервиса выполняются в записанном
+// порядке (с исходными паузами, ускоренными в --speed раз, или подряд при --speed 0), и печатается JSON:
+// по каждой операции — число вызовов, ошибки, перцентили задержки при записи и при воспроизведении.
+// id созданных при записи узлов сопоставляются с id, созданными при воспроизведении.
+#include "AppRepoOptions.h"
+#include "Db.h"
+#include "INodeFactory.h"
+#include "INodeRepository.h"
+#include "QueryStats.h"
+#include "TreeService.h"
+#include "WorkloadRecorder.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QtSql/QSqlDatabase>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace {
+
+struct OpReport {
+    LatencyHistogram recorded;
+    LatencyHistogram replayed;
+    qint64 recordedErrors {0};
+    qint64 replayedErrors {0};
+};
+
+class Replayer {
+public:
+    explicit Replayer(TreeService &service) : m_service(service) {}
+
+    // Вызов сервиса по записи; исключения сервиса пробрасываются
+    void apply(const WorkloadRecord &r) {
+        const QVariantList &a = r.args;
+        switch (r.op) {
+        case WorkloadOp::CreateNode: {
+            const qint64 id = m_service.createNode(mapId(a.value(0)), a.value(1).toString(), payloadArg(a, 2));
+            if (r.ok && r.result > 0) m_ids.insert(r.result, id);
+            break;
+        }
+        case WorkloadOp::RenameNode:
+            m_service.renameNode(mapId(a.value(0)), a.value(1).toString());
+            break;
+        case WorkloadOp::MoveNodes:
+            m_service.moveNodes(mapIds(a.value(0)), mapId(a.value(1)), mapId(a.value(2)), mapId(a.value(3)));
+            break;
+        case WorkloadOp::DeleteNode:
+            m_service.deleteNode(mapId(a.value(0)));
+            break;
+        case WorkloadOp::DeleteNodes:
+            m_service.deleteNodes(mapIds(a.value(0)));
+            break;
+        case WorkloadOp::SetPayload:
+            m_service.setPayload(mapId(a.value(0)), payloadArg(a, 1).value_or(QString()));
+            break;
+        case WorkloadOp::GetPayload:
+            m_service.getPayload(mapId(a.value(0)));
+            break;
+        case WorkloadOp::ListChildren: {
+            const qint64 limit = a.value(1).toLongLong();
+            m_service.listChildren(mapId(a.value(0)), limit < 0 ? SIZE_MAX : size_t(limit),
+                                   size_t(a.value(2).toLongLong()), ChildOrder(a.value(3).toInt()));
+            break;
+        }
+        case WorkloadOp::ListChildrenFrom: {
+            const qint64 limit = a.value(3).toLongLong();
+            m_service.listChildrenFrom(mapId(a.value(0)), mapId(a.value(1)), PageDirection(a.value(2).toInt()),
+                                       limit < 0 ? SIZE_MAX : size_t(limit), ChildOrder(a.value(4).toInt()));
+            break;
+        }
+        case WorkloadOp::ListChildrenOfMany:
+            m_service.listChildrenOfMany(mapIds(a.value(0)), ChildOrder(a.value(1).toInt()));
+            break;
+        case WorkloadOp::ListSubtree: {
+            const qint64 limit = a.value(2).toLongLong();
+            m_service.listSubtree(mapId(a.value(0)), a.value(1).toInt(), limit < 0 ? SIZE_MAX : size_t(limit));
+            break;
+        }
+        case WorkloadOp::BuildPath:
+            m_service.buildPath(mapId(a.value(0)));
+            break;
+        case WorkloadOp::ResolvePath:
+            m_service.resolvePath(a.value(0).toString(), NameMatch(a.value(1).toInt()));
+            break;
+        case WorkloadOp::FindChild:
+            m_service.findChild(mapId(a.value(0)), a.value(1).toString(), NameMatch(a.value(2).toInt()));
+            break;
+        }
+    }
+
+private:
+    // Узлы, существовавшие до записи, совпадают с id в снимке; созданные во время записи — через карту
+    qint64 mapId(const QVariant &v) const {
+        const qint64 id = v.toLongLong();
+        return m_ids.value(id, id);
+    }
+
+    std::vector<qint64> mapIds(const QVariant &v) const {
+        std::vector<qint64> out;
+        for (const QVariant &id : v.toList()) out.push_back(mapId(id));
+        return out;
+    }
+
+    // Длина (-1 — без payload) и, если записан, сам текст; иначе — текст той же длины
+    static std::optional<QString> payloadArg(const QVariantList &a, int index) {
+        const qint64 length = a.value(index).toLongLong();
+        if (length < 0) return std::nullopt;
+        if (a.size() > index + 1) return a.value(index + 1).toString();
+        return QString(qsizetype(length), QChar('x'));
+    }
+
+    TreeService &m_service;
+    QHash<qint64, qint64> m_ids;
+};
+
+QJsonObject summarize(const QString &op, const OpReport &r) {
+    const auto us = [](qint64 ns) { return double(ns) / 1000.0; };
+    const auto histogram = [&](const LatencyHistogram &h) {
+        QJsonObject o;
+        o["mean_us"] = h.count() > 0 ? us(h.totalNs()) / double(h.count()) : 0.0;
+        o["p50_us"] = us(h.percentileNs(0.50));
+        o["p90_us"] = us(h.percentileNs(0.90));
+        o["p99_us"] = us(h.percentileNs(0.99));
+        o["max_us"] = us(h.maxNs());
+        return o;
+    };
+    QJsonObject o;
+    o["op"] = op;
+    o["count"] = r.replayed.count();
+    o["recorded_errors"] = r.recordedErrors;
+    o["replayed_errors"] = r.replayedErrors;
+    o["recorded"] = histogram(r.recorded);
+    o["replayed"] = histogram(r.replayed);
+    const qint64 before = r.recorded.percentileNs(0.50);
+    // > 1 — воспроизведение медленнее записи (регрессия или более медленная машина)
+    o["p50_ratio"] = before > 0 ? double(r.replayed.percentileNs(0.50)) / double(before) : 0.0;
+    return o;
+}
+
+bool copyDatabase(const QString &from, const QString &to) {
+    for (const char *suffix : {"", "-wal", "-shm"}) QFile::remove(to + suffix);
+    return QFile::copy(from, to);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("tree_replay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a recorded tree workload against a copy of its base database");
+    parser.addHelpOption();
+    const QCommandLineOption logOpt("log", "Workload log written by the application.", "path");
+    const QCommandLineOption baseOpt("base", "Database snapshot to replay against (default: <log>.base.sqlite).", "path");
+    const QCommandLineOption speedOpt("speed", "Pacing: 1 = recorded pauses, 10 = ten times faster, 0 = back to back.", "factor", "0");
+    const QCommandLineOption outOpt("out", "Write JSON to a file instead of stdout.", "path");
+    const QCommandLineOption dedupOpt("dedup", "Payload dedup on/off (default: as recorded).", "on|off");
+    const QCommandLineOption compressOpt("compress-threshold", "Payload compression threshold in bytes, 0 = off (default: as recorded).", "bytes");
+    parser.addOptions({logOpt, baseOpt, speedOpt, outOpt, dedupOpt, compressOpt});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    if (!parser.isSet(logOpt)) {
+        err << "tree_replay: --log is required\n";
+        return 2;
+    }
+    const QString logPath = parser.value(logOpt);
+    const QString basePath = parser.isSet(baseOpt) ? parser.value(baseOpt) : logPath + ".base.sqlite";
+    const double speed = parser.value(speedOpt).toDouble();
+    if (!QFileInfo::exists(basePath)) {
+        err << "tree_replay: base database not found: " << basePath << "\n";
+        return 2;
+    }
+
+    QTemporaryDir tmp;
+    const QString workPath = tmp.filePath("replay.sqlite");
+    if (!tmp.isValid() || !copyDatabase(basePath, workPath)) {
+        err << "tree_replay: cannot copy " << basePath << "\n";
+        return 1;
+    }
+
+    std::map<WorkloadOp, OpReport> reports;
+    qint64 records = 0;
+    qint64 wallMs = 0;
+    int exitCode = 0;
+    RepoOptions storage;
+    try {
+        WorkloadReader reader(logPath);
+        // Хранение payload — как при записи (заголовок журнала; у старых журналов — текущие настройки приложения),
+        // иначе задержки create/setPayload/getPayload сравнивают разные пути записи
+        storage = reader.storage().value_or(appRepoOptions());
+        if (parser.isSet(dedupOpt)) storage.dedupPayloads = parser.value(dedupOpt) == "on";
+        if (parser.isSet(compressOpt)) storage.compressThreshold = std::max(0, parser.value(compressOpt).toInt());
+        const QString conn = Db::openAndInit("replay_conn", workPath);
+        TreeService service(makeSqliteNodeRepository(QSqlDatabase::database(conn), storage), makeNodeFactory());
+        Replayer replayer(service);
+
+        QElapsedTimer clock;
+        clock.start();
+        WorkloadRecord r;
+        while (reader.next(r)) {
+            if (speed > 0) {
+                const qint64 dueUs = qint64(double(r.atUs) / speed);
+                const qint64 waitUs = dueUs - clock.nsecsElapsed() / 1000;
+                if (waitUs > 0) QThread::usleep(quint64(waitUs));
+            }
+            OpReport &rep = reports[r.op];
+            rep.recorded.record(r.durationNs);
+            if (!r.ok) ++rep.recordedErrors;
+
+            QElapsedTimer t;
+            t.start();
+            try {
+                replayer.apply(r);
+            } catch (const std::exception &) {
+                ++rep.replayedErrors;
+            }
+            rep.replayed.record(t.nsecsElapsed());
+            ++records;
+        }
+        wallMs = clock.elapsed();
+    } catch (const std::exception &ex) {
+        err << "tree_replay: " << ex.what() << "\n";
+        exitCode = 1;
+    }
+    {
+        QSqlDatabase db = QSqlDatabase::database("replay_conn", false);
+        if (db.isValid()) db.close();
+    }
+    QSqlDatabase::removeDatabase("replay_conn");
+    if (exitCode != 0) return exitCode;
+
+    QJsonArray ops;
+    for (const auto &[op, rep] : reports) ops.append(summarize(QString::fromLatin1(workloadOpName(op)), rep));
+
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["qt_version"] = QString::fromLatin1(qVersion());
+    root["log"] = logPath;
+    root["speed"] = speed;
+    root["records"] = records;
+    root["dedup_payloads"] = storage.dedupPayloads;
+    root["compress_threshold"] = storage.compressThreshold;
+    root["wall_ms"] = wallMs;
+    root["results"] = ops;
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outOpt)) {
+        QFile f(parser.value(outOpt));
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "tree_replay: cannot write " << parser.value(outOpt) << "\n";
+            return 1;
+        }
+        f.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
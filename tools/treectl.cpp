@@ -0,0 +1,334 @@
+// treectl — пакетные операции над деревом без GUI (tree_core, только QtCore/QtSql).
+// Сценарий читается построчно из stdin (или --script) и выполняется одной транзакцией:
+// при первой ошибке всё откатывается, файл БД остаётся как до запуска.
+//
+// Команды (пути вида a/b/c от корня; аргумент с пробелами — в двойных кавычках, \" и \\ внутри):
+//   mkdir <path>                  узел и недостающие промежуточные узлы
+//   create <path> [payload]       узел; родитель должен существовать; payload — остаток строки
+//   rename <path> <name>
+//   move <path> <newParentPath>   в конец ручного порядка нового родителя
+//   delete <path>                 вместе с поддеревом
+//   set-payload <path> <payload>  payload — остаток строки
+//   get-payload <path>            payload в stdout (одна строка)
+//   export <path> [file]          поддерево в JSON {name, payload, children} (stdout без file)
+//   import <parentPath> <file>    JSON того же вида; безымянный корень — импорт только его детей
+// Пустые строки и строки с '#' в начале пропускаются.
+#include "AppRepoOptions.h"
+#include "Db.h"
+#include "INodeFactory.h"
+#include "INodeRepository.h"
+#include "SqlTransaction.h"
+#include "TreeService.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct ScriptError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Разбор строки сценария: слова по пробелам, "..." — одно слово; rest() — необработанный остаток
+class LineReader {
+public:
+    explicit LineReader(const QString &line) : m_line(line) {}
+
+    bool atEnd() {
+        skipSpaces();
+        return m_pos >= m_line.size();
+    }
+
+    QString word() {
+        skipSpaces();
+        if (m_pos >= m_line.size()) throw ScriptError("missing argument");
+        QString out;
+        if (m_line[m_pos] == '"') {
+            ++m_pos;
+            while (m_pos < m_line.size() && m_line[m_pos] != '"') {
+                if (m_line[m_pos] == '\\' && m_pos + 1 < m_line.size()) ++m_pos;
+                out += m_line[m_pos++];
+            }
+            if (m_pos >= m_line.size()) throw ScriptError("unterminated quote");
+            ++m_pos;
+        } else {
+            while (m_pos < m_line.size() && !m_line[m_pos].isSpace()) out += m_line[m_pos++];
+        }
+        return out;
+    }
+
+    QString rest() {
+        skipSpaces();
+        const QString out = m_line.mid(m_pos).trimmed();
+        m_pos = m_line.size();
+        return out;
+    }
+
+    void expectEnd() {
+        if (!atEnd()) throw ScriptError("unexpected arguments: " + rest().toStdString());
+    }
+
+private:
+    void skipSpaces() {
+        while (m_pos < m_line.size() && m_line[m_pos].isSpace()) ++m_pos;
+    }
+
+    QString m_line;
+    qsizetype m_pos {0};
+};
+
+class ScriptRunner {
+public:
+    ScriptRunner(TreeService &service, QTextStream &out) : m_service(service), m_out(out) {}
+
+    void run(const QString &line) {
+        LineReader r(line);
+        const QString cmd = r.word();
+        if (cmd == "mkdir") {
+            const QString path = r.word();
+            r.expectEnd();
+            mkdir(path);
+        } else if (cmd == "create") {
+            const QString path = r.word();
+            const QString payload = r.rest();
+            const auto [parentPath, name] = splitLast(path);
+            m_service.createNode(m_service.resolvePath(parentPath), name,
+                                 payload.isEmpty() ? std::nullopt : std::optional<QString>(payload));
+        } else if (cmd == "rename") {
+            const QString path = r.word();
+            const QString name = r.word();
+            r.expectEnd();
+            m_service.renameNode(resolveNode(path), name);
+        } else if (cmd == "move") {
+            const QString path = r.word();
+            const QString target = r.word();
+            r.expectEnd();
+            m_service.moveNode(resolveNode(path), m_service.resolvePath(target));
+        } else if (cmd == "delete") {
+            const QString path = r.word();
+            r.expectEnd();
+            m_service.deleteNode(resolveNode(path));
+        } else if (cmd == "set-payload") {
+            const QString path = r.word();
+            const QString payload = r.rest();
+            if (payload.isEmpty()) throw ScriptError("missing payload");
+            m_service.setPayload(resolveNode(path), payload);
+        } else if (cmd == "get-payload") {
+            const QString path = r.word();
+            r.expectEnd();
+            m_out << m_service.getPayload(resolveNode(path)) << "\n";
+        } else if (cmd == "export") {
+            const QString path = r.word();
+            const QString file = r.atEnd() ? QString() : r.word();
+            r.expectEnd();
+            exportTree(path, file);
+        } else if (cmd == "import") {
+            const QString parentPath = r.word();
+            const QString file = r.word();
+            r.expectEnd();
+            importTree(parentPath, file);
+        } else {
+            throw ScriptError("unknown command: " + cmd.toStdString());
+        }
+    }
+
+private:
+    // Узел по непустому пути (корень нельзя переименовать/перенести/удалить)
+    qint64 resolveNode(const QString &path) {
+        const qint64 id = m_service.resolvePath(path);
+        if (id == TreeService::ROOT_ID) throw ScriptError("path must not be the root");
+        return id;
+    }
+
+    static std::pair<QString, QString> splitLast(const QString &path) {
+        const QString trimmed = path.trimmed();
+        const qsizetype slash = trimmed.lastIndexOf('/');
+        if (slash < 0) return {QString(), trimmed};
+        return {trimmed.left(slash), trimmed.mid(slash + 1)};
+    }
+
+    void mkdir(const QString &path) {
+        qint64 current = TreeService::ROOT_ID;
+        for (const QString &segment : path.split('/', Qt::SkipEmptyParts)) {
+            const auto child = m_service.findChild(current, segment);
+            current = child.has_value() ? child->id : m_service.createNode(current, segment);
+        }
+    }
+
+    // Поддерево читается одним запросом, payload — одной пачкой
+    void exportTree(const QString &path, const QString &file) {
+        const qint64 rootId = m_service.resolvePath(path);
+        const std::vector<NodeDTO> nodes = m_service.listSubtree(rootId, -1);
+        std::vector<qint64> ids {rootId};
+        for (const auto &n : nodes) ids.push_back(n.id);
+        const auto payloads = m_service.getPayloads(ids);
+
+        QHash<qint64, std::vector<const NodeDTO*>> childrenOf;
+        for (const auto &n : nodes) childrenOf[n.parentId].push_back(&n);
+
+        const auto build = [&](auto &&self, qint64 id, const QString &name) -> QJsonObject {
+            QJsonObject o;
+            o["name"] = name;
+            const auto p = payloads.find(id);
+            if (p != payloads.end()) o["payload"] = p->second;
+            QJsonArray children;
+            for (const NodeDTO *child : childrenOf.value(id)) children.append(self(self, child->id, child->name));
+            if (!children.isEmpty()) o["children"] = children;
+            return o;
+        };
+        const QString rootName = rootId == TreeService::ROOT_ID ? QString() : splitLast(m_service.buildPath(rootId)).second;
+        const QByteArray json = QJsonDocument(build(build, rootId, rootName)).toJson(QJsonDocument::Indented);
+
+        if (file.isEmpty()) {
+            m_out << json;
+            return;
+        }
+        QFile f(file);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            throw ScriptError("cannot write " + file.toStdString());
+        }
+        f.write(json);
+    }
+
+    void importTree(const QString &parentPath, const QString &file) {
+        QFile f(file);
+        if (!f.open(QIODevice::ReadOnly)) throw ScriptError("cannot read " + file.toStdString());
+        QJsonParseError err;
+        const QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &err);
+        if (!doc.isObject()) throw ScriptError("invalid JSON in " + file.toStdString() + ": " + err.errorString().toStdString());
+        const qint64 parentId = m_service.resolvePath(parentPath);
+        const QJsonObject root = doc.object();
+        if (root.value("name").toString().isEmpty()) {
+            importChildren(parentId, root);
+        } else {
+            importNode(parentId, root);
+        }
+    }
+
+    void importNode(qint64 parentId, const QJsonObject &o) {
+        const QJsonValue payload = o.value("payload");
+        const qint64 id = m_service.createNode(parentId, o.value("name").toString(),
+                                               payload.isString() ? std::optional<QString>(payload.toString()) : std::nullopt);
+        importChildren(id, o);
+    }
+
+    void importChildren(qint64 parentId, const QJsonObject &o) {
+        for (const QJsonValue &child : o.value("children").toArray()) {
+            importNode(parentId, child.toObject());
+        }
+    }
+
+    TreeService &m_service;
+    QTextStream &m_out;
+};
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("treectl");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs a tree script (stdin by default) against a database in one transaction");
+    parser.addHelpOption();
+    const QCommandLineOption dbOpt("db", "SQLite database file.", "path");
+    const QCommandLineOption scriptOpt("script", "Read the script from a file instead of stdin.", "path");
+    const QCommandLineOption dryRunOpt("dry-run", "Run the script and roll the transaction back.");
+    parser.addOptions({dbOpt, scriptOpt, dryRunOpt});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    if (!parser.isSet(dbOpt)) {
+        err << "treectl: --db is required\n";
+        return 2;
+    }
+
+    QFile scriptFile;
+    if (parser.isSet(scriptOpt)) {
+        scriptFile.setFileName(parser.value(scriptOpt));
+        if (!scriptFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            err << "treectl: cannot read " << parser.value(scriptOpt) << "\n";
+            return 2;
+        }
+    } else if (!scriptFile.open(stdin, QIODevice::ReadOnly | QIODevice::Text)) {
+        err << "treectl: cannot read stdin\n";
+        return 2;
+    }
+
+    int exitCode = 0;
+    {
+        QString conn;
+        try {
+            conn = Db::openAndInit("treectl_conn", parser.value(dbOpt));
+        } catch (const std::exception &ex) {
+            err << "treectl: " << ex.what() << "\n";
+            return 1;
+        }
+        QSqlDatabase db = QSqlDatabase::database(conn);
+        // Payload пишутся так же, как в приложении: общее хранилище и сжатие по настройкам
+        TreeService service(makeSqliteNodeRepository(db, appRepoOptions()), makeNodeFactory());
+        QTextStream out(stdout);
+        ScriptRunner runner(service, out);
+
+        // Внешняя транзакция на весь сценарий: операции репозитория внутри неё — SAVEPOINT-ы
+        if (!SqlTx::begin(db)) {
+            err << "treectl: " << db.lastError().text() << "\n";
+            return 1;
+        }
+        QElapsedTimer clock;
+        clock.start();
+        QTextStream in(&scriptFile);
+        int lineNo = 0;
+        int commands = 0;
+        while (!in.atEnd()) {
+            const QString line = in.readLine();
+            ++lineNo;
+            const QString trimmed = line.trimmed();
+            if (trimmed.isEmpty() || trimmed.startsWith('#')) continue;
+            try {
+                runner.run(trimmed);
+                ++commands;
+            } catch (const std::exception &ex) {
+                err << "treectl: line " << lineNo << ": " << ex.what() << "\n";
+                exitCode = 1;
+                break;
+            }
+        }
+
+        if (exitCode != 0 || parser.isSet(dryRunOpt)) {
+            SqlTx::rollback(db);
+            if (exitCode != 0) err << "treectl: rolled back, database unchanged\n";
+        } else if (!SqlTx::commit(db)) {
+            err << "treectl: commit failed: " << db.lastError().text() << "\n";
+            exitCode = 1;
+        }
+        out.flush();
+        const qint64 ms = clock.elapsed();
+        err << QString("treectl: %1 commands in %2 ms (%3 ops/s)%4\n")
+                   .arg(commands)
+                   .arg(ms)
+                   .arg(ms > 0 ? qint64(commands) * 1000 / ms : qint64(commands))
+                   .arg(parser.isSet(dryRunOpt) && exitCode == 0 ? ", dry run" : "");
+    }
+    {
+        QSqlDatabase db = QSqlDatabase::database("treectl_conn", false);
+        if (db.isValid()) db.close();
+    }
+    QSqlDatabase::removeDatabase("treectl_conn");
+    return exitCode;
+}